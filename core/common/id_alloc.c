@@ -0,0 +1,123 @@
+#include "id_alloc.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "string.h"
+
+void id_alloc_init(struct id_allocator *allocator, size_t max_ids, size_t ids) {
+    allocator->capacity = ids - ids % ID_WORD_BITS;
+    allocator->summary_words = ID_SUMMARY_WORDS(max_ids);
+    allocator->hint = 0;
+
+    memset(allocator->bits, 0, (allocator->summary_words + allocator->capacity / ID_WORD_BITS) * sizeof(size_t));
+}
+
+void id_alloc_grow(struct id_allocator *allocator, size_t ids) {
+    size_t *used = allocator->bits + allocator->summary_words;
+    size_t words = allocator->capacity / ID_WORD_BITS;
+    size_t new_words = ids / ID_WORD_BITS;
+
+    if (new_words <= words) {
+        return;
+    }
+
+    // summary bits for words past the end are always clear, so only the new words themselves have to be cleared
+    memset(used + words, 0, (new_words - words) * sizeof(size_t));
+    allocator->capacity = new_words * ID_WORD_BITS;
+}
+
+/// finds the first word with a free id in it in the range from `start` up to but not including `end`, returning SIZE_MAX if there aren't any
+static size_t find_free_word(const struct id_allocator *allocator, size_t start, size_t end) {
+    for (size_t i = start / ID_WORD_BITS; i * ID_WORD_BITS < end; i ++) {
+        size_t summary = allocator->bits[i];
+
+        if (i == start / ID_WORD_BITS) {
+            // words before the start are treated as full so they're skipped over
+            summary |= ((size_t) 1 << (start % ID_WORD_BITS)) - 1;
+        }
+
+        if (summary == SIZE_MAX) {
+            continue;
+        }
+
+        size_t index = i * ID_WORD_BITS + id_lowest_clear_bit(summary);
+        return index < end ? index : SIZE_MAX;
+    }
+
+    return SIZE_MAX;
+}
+
+size_t id_alloc_many(struct id_allocator *allocator, size_t count, size_t *ids) {
+    size_t *used = allocator->bits + allocator->summary_words;
+    size_t words = allocator->capacity / ID_WORD_BITS;
+    size_t allocated = 0;
+
+    while (allocated < count && words > 0) {
+        // next-fit: carry on from just after the last id that was allocated, then wrap around to the start
+        size_t start = allocator->hint < allocator->capacity ? allocator->hint : 0;
+        size_t index = start / ID_WORD_BITS;
+        size_t skipped = ((size_t) 1 << (start % ID_WORD_BITS)) - 1;
+
+        if ((used[index] | skipped) == SIZE_MAX) {
+            skipped = 0;
+            index = find_free_word(allocator, index + 1, words);
+
+            if (index == SIZE_MAX) {
+                index = find_free_word(allocator, 0, start / ID_WORD_BITS + 1);
+            }
+
+            if (index == SIZE_MAX) {
+                break;
+            }
+        }
+
+        // take as many ids as are needed from this word before moving on to the next one
+        size_t value = used[index] | skipped;
+
+        while (value != SIZE_MAX && allocated < count) {
+            unsigned int bit = id_lowest_clear_bit(value);
+            value |= (size_t) 1 << bit;
+            used[index] |= (size_t) 1 << bit;
+
+            ids[allocated ++] = index * ID_WORD_BITS + bit;
+            allocator->hint = index * ID_WORD_BITS + bit + 1;
+        }
+
+        if (used[index] == SIZE_MAX) {
+            allocator->bits[index / ID_WORD_BITS] |= (size_t) 1 << (index % ID_WORD_BITS);
+        }
+    }
+
+    return allocated;
+}
+
+size_t id_alloc(struct id_allocator *allocator) {
+    size_t id;
+    return id_alloc_many(allocator, 1, &id) == 1 ? id : SIZE_MAX;
+}
+
+bool id_alloc_mark_used(struct id_allocator *allocator, size_t id) {
+    if (id >= allocator->capacity) {
+        return false;
+    }
+
+    size_t *word = &allocator->bits[allocator->summary_words + id / ID_WORD_BITS];
+    *word |= (size_t) 1 << (id % ID_WORD_BITS);
+
+    if (*word == SIZE_MAX) {
+        allocator->bits[id / ID_WORD_BITS / ID_WORD_BITS] |= (size_t) 1 << (id / ID_WORD_BITS % ID_WORD_BITS);
+    }
+
+    return true;
+}
+
+bool id_free(struct id_allocator *allocator, size_t id) {
+    if (id >= allocator->capacity) {
+        return false;
+    }
+
+    allocator->bits[allocator->summary_words + id / ID_WORD_BITS] &= ~((size_t) 1 << (id % ID_WORD_BITS));
+    allocator->bits[id / ID_WORD_BITS / ID_WORD_BITS] &= ~((size_t) 1 << (id / ID_WORD_BITS % ID_WORD_BITS));
+
+    return true;
+}
@@ -0,0 +1,77 @@
+#pragma once
+
+// allocator for small integer ids (thread ids, pids, slot numbers, etc.) backed by a two-level bitset
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/// how many ids are stored in each word of an id allocator
+#define ID_WORD_BITS (sizeof(size_t) * 8)
+
+/// how many summary words an id allocator that can fit up to `max_ids` ids needs
+#define ID_SUMMARY_WORDS(max_ids) (((max_ids) / ID_WORD_BITS + ID_WORD_BITS - 1) / ID_WORD_BITS)
+
+/// \brief the size in bytes of an id allocator that can be grown to fit up to `max_ids` ids and currently fits `ids` of them
+///
+/// both of these are rounded down to a multiple of `ID_WORD_BITS`
+#define ID_ALLOCATOR_SIZE(max_ids, ids) (sizeof(struct id_allocator) + (ID_SUMMARY_WORDS(max_ids) + (ids) / ID_WORD_BITS) * sizeof(size_t))
+
+/// \brief a bitset of used ids, along with a summary bitset of which of its words are full so that allocation doesn't have to look at every word
+///
+/// this has no pointers in it and is kept in a single block of memory, so that it can be stored in an untyped object and grown by resizing it
+struct id_allocator {
+    /// how many ids can currently be allocated, which is always a multiple of `ID_WORD_BITS`
+    size_t capacity;
+    /// how many words of summary bits there are at the start of `bits`
+    size_t summary_words;
+    /// the id after the last one that was allocated, which is where the search for the next free id starts
+    size_t hint;
+    /// \brief the summary bits, followed by the bitset of used ids
+    ///
+    /// each summary bit is set if the word of used ids it refers to is full
+    size_t bits[];
+};
+
+/// gets the index of the lowest clear bit in the given value, which must not have every bit set
+static inline unsigned int id_lowest_clear_bit(size_t value) {
+    value = ~value;
+
+#ifdef ARCH_68000
+    // the 68000 has no instruction for this, so a binary search is done instead of checking one bit at a time
+    unsigned int bit = 0;
+
+    for (unsigned int shift = ID_WORD_BITS / 2; shift > 0; shift >>= 1) {
+        if ((value & (((size_t) 1 << shift) - 1)) == 0) {
+            value >>= shift;
+            bit += shift;
+        }
+    }
+
+    return bit;
+#else
+    return (unsigned int) __builtin_ctzl((unsigned long) value);
+#endif
+}
+
+/// initializes an id allocator that can be grown to fit up to `max_ids` ids, which currently has room for `ids` of them
+void id_alloc_init(struct id_allocator *allocator, size_t max_ids, size_t ids);
+
+/// \brief grows an id allocator so that it fits `ids` ids, after the memory it's stored in has been resized to `ID_ALLOCATOR_SIZE(max_ids, ids)` bytes
+///
+/// `ids` must be no greater than the `max_ids` the allocator was initialized with
+void id_alloc_grow(struct id_allocator *allocator, size_t ids);
+
+/// allocates an id, starting after the last id that was allocated and wrapping around. if no ids are available, SIZE_MAX is returned
+size_t id_alloc(struct id_allocator *allocator);
+
+/// \brief allocates up to `count` ids at once, storing them in `ids`
+///
+/// returns how many ids were allocated, which is less than `count` if the allocator ran out of free ids
+size_t id_alloc_many(struct id_allocator *allocator, size_t count, size_t *ids);
+
+/// marks an id as used without allocating it, for ids that are reserved. returns false if the id is out of range
+bool id_alloc_mark_used(struct id_allocator *allocator, size_t id);
+
+/// frees an id so that it can be allocated again. returns false if the id is out of range
+bool id_free(struct id_allocator *allocator, size_t id);
@@ -42,6 +42,10 @@
 #define EPERM 18
 /// read-only filesystem
 #define EROFS 19
+/// device or resource busy
+#define EBUSY 20
+/// too many objects leased
+#define ETOOMANYLEASES 21
 
 // TODO: should more posix errno values be supported?
 
@@ -4,8 +4,11 @@
 #include <stddef.h>
 #include "string.h"
 
+struct invocation;
+
 #define SYSCALL_YIELD 0
 #define SYSCALL_INVOKE 1
+#define SYSCALL_INVOKE_BATCH 2
 
 static inline void syscall_yield(void) {
     register size_t kind asm ("d0") = SYSCALL_YIELD;
@@ -23,6 +26,18 @@ static inline size_t syscall_invoke(size_t address, size_t depth, size_t handler
     return return_value;
 }
 
+static inline size_t syscall_invoke_batch(struct invocation *invocations, size_t count, uint8_t flags) {
+    register size_t return_value asm ("d0");
+    register size_t kind asm ("d0") = SYSCALL_INVOKE_BATCH;
+    register size_t _count asm ("d1") = count;
+    register size_t _flags asm ("d2") = flags;
+    // the kernel moves a0 and d1 past any invocations that were made before the batch had to be restarted, keeping count of them in d3
+    register size_t _made asm ("d3") = 0;
+    register struct invocation *_invocations asm ("a0") = invocations;
+    __asm__ __volatile__ ("trap #0" : "=r" (return_value), "+r" (_count), "+r" (_made), "+r" (_invocations) : "r" (kind), "r" (_flags) : "memory");
+    return return_value;
+}
+
 /// the registers structure for the 68000 platform
 struct thread_registers {
     uint32_t stack_pointer;
@@ -25,6 +25,33 @@ __SYSCALL_PREFIX void syscall_yield(void);
 /// and no operation will be performed. otherwise, the return value depends on the specific invocation made
 __SYSCALL_PREFIX size_t syscall_invoke(size_t address, size_t depth, size_t handler_number, size_t argument);
 
+/// a single capability invocation in a batch passed to `syscall_invoke_batch`
+struct invocation {
+    /// the address of the capability to invoke
+    size_t address;
+    /// how many bits of the address field are valid and should be used to search through the calling thread's address space
+    size_t depth;
+    /// the number of the handler to invoke
+    size_t handler_number;
+    /// the argument passed to the handler
+    size_t argument;
+    /// once this invocation has been made, its return value is stored here
+    size_t result;
+};
+
+/// \brief if this flag is passed to `syscall_invoke_batch`, no more invocations are made once one of them returns a non-zero value
+///
+/// since some invocations (i.e. `untyped_lock` and `untyped_sizeof`) return non-zero values on success, they should only be placed at the end of batches that use this flag
+#define BATCH_STOP_ON_ERROR 1
+
+/// \brief makes each of the given invocations in order, storing their return values in their `result` fields
+///
+/// this behaves the same as calling `syscall_invoke` for each invocation, without the overhead of a system call for each one.
+/// if an invocation blocks the calling thread (i.e. `endpoint_receive`), no more invocations in the batch are made.
+/// invocations that are split up into steps (i.e. `node_revoke`) let other threads run between each step, after which the batch carries on from where it left off.
+/// the number of invocations that were made is returned
+__SYSCALL_PREFIX size_t syscall_invoke_batch(struct invocation *invocations, size_t count, uint8_t flags);
+
 /// flags that describe the access rights for a given capability
 typedef uint8_t access_flags_t;
 
@@ -66,32 +93,117 @@ struct node_move_args {
     size_t dest_slot;
 };
 
-/// the handler number for the `node_delete` invocation
+/// \brief the handler number for the `node_delete` invocation
+///
+/// deleting a node, or the last capability referring to a thread, deletes every capability in the node or in the thread's root node along with it.
+/// this is done a few capabilities at a time with other threads running in between, and a thread that's being deleted this way is stopped before any of its capabilities are
 #define NODE_DELETE 2
 
 /// the handler number for the `node_revoke` invocation
 #define NODE_REVOKE 3
 
-/// the handler number for the `untyped_lock` invocation
+/// the handler number for the `node_copy_range` invocation
+#define NODE_COPY_RANGE 4
+
+/// the handler number for the `node_move_range` invocation
+#define NODE_MOVE_RANGE 5
+
+/// \brief arguments passed to the `node_copy_range` and `node_move_range` invocations on a capability node
+///
+/// the capabilities that are copied or moved are in the same node as the one at `source_address`, and are picked by the bits set in `slots`.
+/// if bit `n` is set, the capability `n` slots after the one at `source_address` is placed `n` slots after `dest_slot`. empty source slots are skipped.
+/// if any of the capabilities can't be copied or moved, no more of them are and an error is returned
+struct node_range_args {
+    /// the address of the first capability to copy or move
+    size_t source_address;
+    /// how many bits of the source_address field are valid and should be used to search
+    /// through the calling thread's address space
+    size_t source_depth;
+    /// the index of the slot in this node that the first capability is placed in
+    size_t dest_slot;
+    /// which slots after the first capability should be copied or moved, where the lowest bit is the first capability itself
+    size_t slots;
+};
+
+/// the handler number for the `node_delete_range` invocation
+#define NODE_DELETE_RANGE 6
+
+/// \brief arguments passed to the `node_delete_range` invocation on a capability node
+///
+/// if bit `n` of `slots` is set, the capability `n` slots after `first_slot` is deleted. unlike `node_delete`, slots that are already empty are skipped over
+struct node_delete_range_args {
+    /// the index of the first slot in this node that could be deleted
+    size_t first_slot;
+    /// which slots after the first one should be deleted, where the lowest bit is the first slot itself
+    size_t slots;
+};
+
+/// \brief the handler number for the `untyped_lock` invocation
+///
+/// this locks an untyped object in place and returns a pointer to it. locks are counted, so the object stays locked until `untyped_unlock` has been called
+/// once for every time it was locked. NULL is returned if the object has been locked too many times
 #define UNTYPED_LOCK 0
 
 /// the handler number for the `untyped_unlock` invocation
 #define UNTYPED_UNLOCK 1
 
-/// the handler number for the `untyped_try_lock` invocation
+/// \brief the handler number for the `untyped_try_lock` invocation
+///
+/// this is the same as `untyped_lock`, except that NULL is returned instead if the object is already locked (or leased) by anything
 #define UNTYPED_TRY_LOCK 2
 
 /// the handler number for the `untyped_sizeof` invocation
 #define UNTYPED_SIZEOF 3
 
+/// \brief the handler number for the `untyped_lease` invocation
+///
+/// this locks an untyped object and returns a pointer to it like `untyped_lock` does, however the object is unlocked automatically the next time
+/// the calling thread calls `endpoint_receive` (or `address_space_release_leases`) instead of needing a matching `untyped_unlock`.
+/// leasing an object that's already leased by the calling thread just returns the same pointer again.
+/// NULL is returned if the object can't be locked or if the calling thread already has too many objects leased. `address_space_lease` can be used instead
+/// to tell these apart
+#define UNTYPED_LEASE 4
+
+/// \brief the handler number for the `untyped_resize` invocation
+///
+/// this resizes an untyped object to the size in bytes given as the argument, keeping its contents up to whichever of the old and new sizes is smaller.
+/// since the object may be moved, it can't be resized while it's locked unless the only lock on it is a lease held by the calling thread,
+/// in which case it has to be leased again to get its new address. EBUSY is returned if the object is locked, and ENOMEM if there isn't enough memory to grow it
+#define UNTYPED_RESIZE 5
+
 /// the handler number for the `address_space_alloc` invocation
 #define ADDRESS_SPACE_ALLOC 0
 
+/// the handler number for the `address_space_stats` invocation
+#define ADDRESS_SPACE_STATS 1
+
+/// the handler number for the `address_space_set_watermark` invocation
+#define ADDRESS_SPACE_SET_WATERMARK 2
+
+/// the handler number for the `address_space_release_leases` invocation, which releases all the objects leased by the calling thread with `untyped_lease`
+#define ADDRESS_SPACE_RELEASE_LEASES 3
+
+/// \brief the handler number for the `address_space_lease` invocation
+///
+/// this leases every untyped object in a list in one go, filling in a table with pointers to them. either all of the objects are leased or none of them are.
+/// 0 is returned on success, ETOOMANYLEASES if the calling thread can't hold that many leases, EBUSY if an object has been locked too many times,
+/// and ENOCAPABILITY or ECAPINVAL if an address doesn't refer to an untyped capability
+#define ADDRESS_SPACE_LEASE 4
+
+/// the maximum number of untyped objects that each thread can have leased with `untyped_lease` or `address_space_lease` at once
+#define MAX_LEASES 8
+
 #define TYPE_UNTYPED 0 // is this a good name for user-modifiable memory?
 #define TYPE_NODE 1
 #define TYPE_THREAD 2
 #define TYPE_ENDPOINT 3
 
+/// \brief hints that an object will be locked for its entire lifetime (i.e. program code and data)
+///
+/// objects allocated with this flag are placed at the top of memory so that they don't fragment the space available for movable objects.
+/// this flag only has an effect on untyped objects
+#define ALLOC_FLAG_PINNED 1
+
 /// arguments passed to the `address_space_alloc` invocation on an address space capability
 struct alloc_args {
     /// the type of the object to create
@@ -103,6 +215,87 @@ struct alloc_args {
     /// how many bits of the address field are valid and should be used to search
     /// through the calling thread's address space
     size_t depth;
+    /// flags that affect how this object is allocated
+    uint8_t flags;
+    /// \brief if a capability node is being created, this is how many bits of an address its guard takes up
+    ///
+    /// these bits are skipped over when looking up capabilities in the node, and must match the value of `guard`.
+    /// this allows large sparse capability spaces to be searched through without needing as many levels of nodes
+    uint8_t guard_bits;
+    /// the value of the new capability node's guard
+    size_t guard;
+};
+
+/// \brief arguments passed to the `address_space_set_watermark` invocation on an address space capability
+///
+/// once the heap of the address space drops below either threshold or an allocation in it fails, a message with no contents is sent to the given endpoint
+/// with the badge of the given endpoint capability, so that the receiving thread can free up any memory it doesn't need.
+/// only one watermark can be set at a time, and it's cleared once the message is sent, so it has to be set again to get another message.
+/// setting a watermark with an endpoint depth of 0 clears the watermark
+struct watermark_args {
+    /// the address of the endpoint capability that the message should be sent to
+    size_t endpoint_address;
+    /// how many bits of the endpoint_address field are valid and should be used to search
+    /// through the calling thread's address space
+    size_t endpoint_depth;
+    /// the message is sent once there's less than this many bytes of memory available
+    size_t free_memory;
+    /// the message is sent once the largest allocation that can be made without moving anything is smaller than this many bytes
+    size_t largest_free_block;
+};
+
+/// arguments passed to the `address_space_lease` invocation on an address space capability
+struct lease_args {
+    /// the addresses of the untyped capabilities referring to the objects to lease
+    const size_t *addresses;
+    /// how many bits of each address are valid and should be used to search through the calling thread's address space
+    size_t depth;
+    /// a pointer to each leased object is written here, in the same order as their addresses
+    void **pointers;
+    /// how many objects should be leased. this can't be more than `MAX_LEASES`
+    size_t count;
+};
+
+/// how many size classes are tracked in the free block histogram of `struct heap_stats`
+#define HEAP_SIZE_CLASSES (sizeof(size_t) * 8)
+
+/// statistics about the heap of an address space, filled in by the `address_space_stats` invocation
+struct heap_stats {
+    /// how much total memory is contained in the heap, in bytes
+    size_t total_memory;
+    /// how much memory has been used in the heap, in bytes
+    size_t used_memory;
+    /// how many allocations have been made
+    size_t allocations;
+    /// how many allocations have been freed
+    size_t frees;
+    /// how many allocations have failed
+    size_t failed_allocations;
+    /// how many times an allocated block has been moved to a different location in memory
+    size_t relocations;
+    /// how many bytes have been copied in total when moving allocated blocks
+    size_t bytes_relocated;
+    /// \brief the largest number of bytes that have been copied with interrupts disabled while moving an allocated block
+    ///
+    /// blocks are copied in chunks with interrupts enabled except for the last one, so this is a measure of the longest time interrupts have been disabled by the heap
+    size_t largest_critical_copy;
+    /// \brief how many times compaction has found a block that it could otherwise have moved locked in place
+    ///
+    /// every locked block that directly follows an available block adds one to this each time compaction searches past it,
+    /// so it goes up with how often compaction runs rather than with how long blocks stay locked for
+    size_t pinned_encounters;
+    /// the size of the largest allocation that can currently be made without moving anything
+    size_t largest_free_block;
+    /// how many free blocks are being held in object caches for reuse
+    size_t cached_blocks;
+    /// how many capability lookups have been answered from a thread's lookup cache
+    size_t lookup_cache_hits;
+    /// how many capability lookups have had to search through capability nodes
+    size_t lookup_cache_misses;
+    /// \brief how many free blocks are in each size class
+    ///
+    /// a block is in size class `n` if its size in bytes (including its header) is at least `1 << n` and less than `2 << n`
+    size_t free_blocks[HEAP_SIZE_CLASSES];
 };
 
 /// the handler number for the `thread_read_registers` invocation
@@ -364,9 +364,8 @@ static void main_loop(const struct state *state) {
         syscall_invoke(FD_REPLY_ENDPOINT(received).address, SIZE_MAX, ENDPOINT_SEND, (size_t) &reply); // return value is ignored here since it doesn't matter if the reply fails to send
 
         // delete any leftover capabilities that were transferred and temporary capabilities not sent.
-        for (size_t i = 0; i < IPC_CAPABILITY_SLOTS + 1; i ++) {
-            syscall_invoke(state->node.address, state->node.depth, NODE_DELETE, i);
-        }
+        const struct node_delete_range_args delete_args = {0, (1 << (IPC_CAPABILITY_SLOTS + 1)) - 1};
+        syscall_invoke(state->node.address, state->node.depth, NODE_DELETE_RANGE, (size_t) &delete_args);
     }
 }
 
@@ -6,6 +6,9 @@
 
 typedef uint16_t interrupt_status_t; 
 
+/// how many bytes the `trap #0` instruction used to make system calls takes up, so that a system call can be restarted by moving the program counter back by this much
+#define TRAP_INSTRUCTION_SIZE 2
+
 static inline interrupt_status_t disable_interrupts(void) {
     interrupt_status_t result;
     __asm__ __volatile__ (
@@ -145,14 +145,49 @@ void trap_handler(struct thread_registers *registers) {
     case SYSCALL_YIELD:
         yield_thread();
         break;
-    case SYSCALL_INVOKE:
-        registers->data[0] = (uint32_t) invoke_capability(
+    case SYSCALL_INVOKE: {
+        size_t return_value = invoke_capability(
             (size_t) registers->data[1],
             (size_t) registers->data[2],
             (size_t) registers->data[3],
             (size_t) registers->address[0]
         );
+
+        if (return_value == INVOCATION_RESTART) {
+            // step back over the trap instruction so that it's run again once this thread is next scheduled, giving other threads a chance to run in between.
+            // the registers holding the arguments haven't been touched, so the invocation picks up right where it left off
+            registers->program_counter -= TRAP_INSTRUCTION_SIZE;
+            yield_thread();
+        } else {
+            registers->data[0] = (uint32_t) return_value;
+        }
+        break;
+    }
+    case SYSCALL_INVOKE_BATCH: {
+        size_t restart_index;
+        size_t return_value = invoke_capability_batch(
+            (struct invocation *) registers->address[0],
+            (size_t) registers->data[1],
+            (uint8_t) registers->data[2],
+            &restart_index
+        );
+
+        if (return_value == INVOCATION_RESTART) {
+            // skip over the invocations that have already been made and run the trap instruction again once this thread is next scheduled, so that the batch resumes from the one that has to be restarted.
+            // d3 keeps count of the invocations that were skipped over so that the total number made can be returned once the batch finishes
+            registers->address[0] += (uint32_t) (restart_index * sizeof(struct invocation));
+            registers->data[1] -= (uint32_t) restart_index;
+            registers->data[3] += (uint32_t) restart_index;
+            registers->program_counter -= TRAP_INSTRUCTION_SIZE;
+            yield_thread();
+        } else {
+            registers->data[0] = (uint32_t) return_value + registers->data[3];
+        }
         break;
     }
+    }
+
+    // any threads woken up by a watermark notification should be able to be switched to right away
+    deliver_watermark_notifications();
     try_context_switch(registers);
 }
@@ -11,9 +11,56 @@
 
 #undef DEBUG_CAPABILITIES
 
+/// \brief the current lookup generation, which is compared against the generation of entries in threads' lookup caches to check whether they're still valid
+///
+/// this starts at 1 so that zeroed out cache entries are never valid
+static size_t lookup_generation = 1;
+
+static size_t lookup_cache_hits;
+static size_t lookup_cache_misses;
+
+struct invocation_handlers *capability_handlers[CAP_TYPE_COUNT] = {
+    [CAP_TYPE_NONE] = NULL,
+    [CAP_TYPE_NODE] = &node_handlers,
+    [CAP_TYPE_UNTYPED] = &untyped_handlers,
+    [CAP_TYPE_ADDRESS_SPACE] = &address_space_handlers,
+    [CAP_TYPE_THREAD] = &thread_handlers,
+    [CAP_TYPE_ENDPOINT] = &endpoint_handlers,
+    [CAP_TYPE_DEBUG] = &debug_handlers
+};
+
+/// the heaps of every address space that's been registered with `register_address_space`
+static struct heap *address_space_heaps[MAX_ADDRESS_SPACES];
+static size_t num_address_spaces;
+
+bool register_address_space(struct heap *heap) {
+    if (num_address_spaces >= MAX_ADDRESS_SPACES) {
+        return false;
+    }
+
+    address_space_heaps[num_address_spaces ++] = heap;
+    return true;
+}
+
+struct heap *find_resource_heap(void *resource) {
+    for (size_t i = 0; i < num_address_spaces; i ++) {
+        if (heap_contains(address_space_heaps[i], resource)) {
+            return address_space_heaps[i];
+        }
+    }
+
+    return NULL;
+}
+
+void deliver_watermark_notifications(void) {
+    for (size_t i = 0; i < num_address_spaces; i ++) {
+        heap_deliver_watermark(address_space_heaps[i]);
+    }
+}
+
 void update_capability_references(struct capability *capability) {
-    LIST_UPDATE_ADDRESS_NO_CONTAINER(struct capability, resource_list, capability);
-    LIST_UPDATE_ADDRESS_NO_CONTAINER(struct capability, derivation_list, capability);
+    LIST_UPDATE_ADDRESS_NO_CONTAINER(resource_list, capability);
+    LIST_UPDATE_ADDRESS_NO_CONTAINER(derivation_list, capability);
 
     // if this capability has other capabilities derived from it, update their `derived_from` references to point to the new address
     if ((capability->flags & (CAP_FLAG_ORIGINAL | CAP_FLAG_BADGED)) != 0 && capability->derivation != NULL) {
@@ -22,158 +69,274 @@ void update_capability_references(struct capability *capability) {
         }
     }
 
-    // if this is the first item in the derivation list that this capability is in and the capability it was derived from still exists,
-    // update its parent capability to point to this one
-    if (capability->derivation_list.prev == NULL && capability->derived_from != NULL) {
+    // if the capability this was derived from still exists and refers to this one as the start of its derivation list, update it to point to the new address
+    if ((capability->flags & CAP_FLAG_DERIVATION_HEAD) != 0 && capability->derived_from != NULL) {
         capability->derived_from->derivation = capability;
     }
+
+    // if the heap refers to this capability directly in order to update its resource when it's moved, update it to point to the new address
+    if ((capability->flags & CAP_FLAG_HEAP_REFERENCE) != 0 && capability->resource != NULL) {
+        heap_set_update_capability(capability->resource, capability);
+    }
 }
 
 void move_capability(struct capability *from, struct capability *to) {
+    // any addresses that went through this node won't find the same slots anymore
+    if (from->type == CAP_TYPE_NODE) {
+        lookup_generation ++;
+    }
+
     memcpy(to, from, sizeof(struct capability));
     update_capability_references(to);
-    from->handlers = NULL;
+    from->type = CAP_TYPE_NONE;
 }
 
 static void merge_derivation_lists(struct capability *to_merge) {
-    // if this capability was badged and has a child derivation list, insert it into the derivation list of its parent if it still exists
+    // if this capability was badged and has a child derivation list, join it with the derivation list of its parent if it still exists
     if ((to_merge->flags & CAP_FLAG_BADGED) != 0 && to_merge->derived_from != NULL && to_merge->derivation != NULL) {
         // update the derived_from pointers for every item in the list
         LIST_ITER_NO_CONTAINER(struct capability, derivation_list, to_merge->derivation, link) {
             link->derived_from = to_merge->derived_from;
         }
 
-        if (to_merge->derivation_list.start == to_merge->derivation_list.end) {
-            // there's only one item in the list (presumably this one) so the list doesn't need to be merged
-            to_merge->derived_from->derivation = to_merge->derivation;
-        } else {
-            // there's multiple items in the list, insert the child list right before the last item in the parent list
-            struct capability *derivation = to_merge->derivation;
-
-            struct capability *prev = to_merge->derivation_list.end->derivation_list.prev;
-            prev->derivation_list.next = derivation->derivation_list.start;
-            derivation->derivation_list.start->derivation_list.prev = prev;
-
-            to_merge->derivation_list.end->derivation_list.prev = derivation->derivation_list.end;
-            derivation->derivation_list.end->derivation_list.next = derivation->derivation_list.end;
-
-            LIST_ITER_NO_CONTAINER(struct capability, derivation_list, to_merge->derivation, link) {
-                link->derivation_list.start = to_merge->derivation_list.start;
-                link->derivation_list.end = to_merge->derivation_list.end;
-            }
+        // the parent already refers to an item in its own derivation list, which is kept as the start of the joined list
+        to_merge->derivation->flags &= (uint8_t) ~CAP_FLAG_DERIVATION_HEAD;
+        LIST_SPLICE_NO_CONTAINER(struct capability, to_merge, derivation_list, to_merge->derivation);
+    } else if ((to_merge->flags & (CAP_FLAG_ORIGINAL | CAP_FLAG_BADGED)) != 0 && to_merge->derivation != NULL) {
+        // there's nothing for the child derivation list to be joined with, so it's left on its own without anything to refer back to
+        LIST_ITER_NO_CONTAINER(struct capability, derivation_list, to_merge->derivation, link) {
+            link->derived_from = NULL;
         }
+
+        to_merge->derivation->flags &= (uint8_t) ~CAP_FLAG_DERIVATION_HEAD;
     }
 
-    // if this is the first item in the derivation list and the capability that this was derived from still exists,
-    // update the original capability's derivation pointer to the next element in the list
-    if (to_merge->derivation_list.prev == NULL && to_merge->derived_from != NULL) {
-        to_merge->derived_from->derivation = to_merge->derivation_list.next;
+    // if the capability that this was derived from still exists and refers to this one as the start of its derivation list,
+    // update its derivation pointer to the next element in the list
+    if ((to_merge->flags & CAP_FLAG_DERIVATION_HEAD) != 0 && to_merge->derived_from != NULL) {
+        if (LIST_IS_ALONE_NO_CONTAINER(to_merge, derivation_list)) {
+            to_merge->derived_from->derivation = NULL;
+        } else {
+            to_merge->derivation_list.next->flags |= CAP_FLAG_DERIVATION_HEAD;
+            to_merge->derived_from->derivation = to_merge->derivation_list.next;
+        }
     }
 
-    LIST_DELETE_NO_CONTAINER(struct capability, derivation_list, to_merge);
+    LIST_DELETE_NO_CONTAINER(derivation_list, to_merge);
 }
 
 void delete_capability(struct capability *to_delete) {
-    bool destroy_resource = false;
+    if (to_delete->type == CAP_TYPE_NODE) {
+        lookup_generation ++;
+    }
 
-    // check if this resource is heap managed and the capability to be deleted is at the start of the resource list
-    if (to_delete->resource_list.prev == NULL) {
-        if (to_delete->resource_list.next == NULL) {
-            // this is the last capability in the list, free up its resource
-            destroy_resource = true;
-        } else {
-            // move ownership of this resource to the next item in the list
-            heap_set_update_capability(to_delete->resource, &to_delete->resource_list.next->address);
-        }
+    // if this is the last capability in the list, free up its resource
+    bool destroy_resource = LIST_IS_ALONE_NO_CONTAINER(to_delete, resource_list);
+
+    if (!destroy_resource && (to_delete->flags & CAP_FLAG_HEAP_REFERENCE) != 0) {
+        // move ownership of this resource to the next item in the list
+        to_delete->resource_list.next->flags |= CAP_FLAG_HEAP_REFERENCE;
+        heap_set_update_capability(to_delete->resource, to_delete->resource_list.next);
     }
 
-    LIST_DELETE_NO_CONTAINER(struct capability, resource_list, to_delete);
+    LIST_DELETE_NO_CONTAINER(resource_list, to_delete);
 
     if (destroy_resource) {
-        if (to_delete->handlers->destructor != NULL) {
-            to_delete->handlers->destructor(to_delete);
+        const struct invocation_handlers *handlers = capability_handlers[to_delete->type];
+
+        if (handlers->destructor != NULL) {
+            handlers->destructor(to_delete);
         }
 
         if (to_delete->resource != NULL) {
-            heap_free(to_delete->heap, to_delete->resource);
+            heap_free(find_resource_heap(to_delete->resource), to_delete->resource);
         }
     }
 
-    to_delete->handlers = NULL;
+    to_delete->type = CAP_TYPE_NONE;
 }
 
 #ifdef DEBUG
 void print_capability_lists(struct capability *capability) {
-    printk("this capability: 0x%" PRIxPTR "\n", (size_t) capability);
-    struct capability *c = capability->resource_list.start;
-    printk("resource start: 0x%" PRIxPTR ", end: 0x%" PRIxPTR "\n", (size_t) c, (size_t) capability->resource_list.end);
-    for (; c != NULL; c = c->resource_list.next) {
-        printk(" - 0x%" PRIxPTR " (start 0x%" PRIxPTR ", end 0x%" PRIxPTR ")\n", (size_t) c, (size_t) c->resource_list.start, (size_t) c->resource_list.end);
+    printk("this capability: 0x%" PRIxPTR " (flags 0x%x)\n", (size_t) capability, capability->flags);
+    printk("resource list:\n");
+    LIST_ITER_NO_CONTAINER(struct capability, resource_list, capability, c) {
+        printk(" - 0x%" PRIxPTR " (prev 0x%" PRIxPTR ", next 0x%" PRIxPTR ")\n", (size_t) c, (size_t) c->resource_list.prev, (size_t) c->resource_list.next);
     }
-    c = capability->derivation_list.start;
-    printk("derivation start: 0x%" PRIxPTR ", end: 0x%" PRIxPTR "\n", (size_t) c, (size_t) capability->derivation_list.end);
-    for (; c != NULL; c = c->derivation_list.next) {
-        printk(" - 0x%" PRIxPTR " (start 0x%" PRIxPTR ", end 0x%" PRIxPTR ")\n", (size_t) c, (size_t) c->derivation_list.start, (size_t) c->derivation_list.end);
+    printk("derivation list:\n");
+    LIST_ITER_NO_CONTAINER(struct capability, derivation_list, capability, c) {
+        printk(" - 0x%" PRIxPTR " (prev 0x%" PRIxPTR ", next 0x%" PRIxPTR ")\n", (size_t) c, (size_t) c->derivation_list.prev, (size_t) c->derivation_list.next);
     }
 }
 #endif
 
-void update_capability_addresses(struct capability *slot, const struct absolute_capability_address *address, uint8_t nesting) {
-    if (slot->resource_list.prev == NULL) {
-        // only update the owner id of the node if it's the owner of the resource
-#ifdef DEBUG_CAPABILITIES
-        printk(
-            "update_capability_addresses: switching owner of 0x%x from 0x%x:0x%x (%d bits) to 0x%x:0x%x (%d bits)\n",
-            slot->resource,
-            slot->address.thread_id,
-            slot->address.address,
-            slot->address.depth,
-            address->thread_id,
-            address->address,
-            address->depth
-        );
-#endif
-        heap_set_update_capability(slot->resource, address);
+/// gets how many slots are in each chunk of a capability node
+static inline size_t slots_per_chunk(const struct capability_node *node) {
+    return (size_t) 1 << (node->slot_bits < NODE_CHUNK_BITS ? node->slot_bits : NODE_CHUNK_BITS);
+}
+
+/// gets how many chunks the slots of a capability node are split into
+static inline size_t chunks_in_node(const struct capability_node *node) {
+    return node->slot_bits < NODE_CHUNK_BITS ? 1 : (size_t) 1 << (node->slot_bits - NODE_CHUNK_BITS);
+}
+
+/// gets the slot at the given index in a capability node, or NULL if the chunk it's in hasn't been allocated yet
+static struct capability *get_node_slot(const struct capability_node *node, size_t index) {
+    struct node_chunk *chunk = node->chunks[index >> NODE_CHUNK_BITS];
+
+    if (chunk == NULL) {
+        return NULL;
     }
 
-    // update the address of this capability
-    slot->address = *address;
+    return &chunk->capabilities[index & (((size_t) 1 << NODE_CHUNK_BITS) - 1)];
+}
 
-    if (slot->handlers == &node_handlers) {
-        struct capability_node *node = (struct capability_node *) slot->resource;
+/// called by the heap when a chunk of a capability node is moved
+static void on_chunk_moved(void *resource) {
+    struct node_chunk *chunk = (struct node_chunk *) resource;
+    struct capability *capability = &chunk->capabilities[0];
 
-        node->nested_nodes = nesting;
+    chunk->node->chunks[chunk->index] = chunk;
 
-        struct capability *slot_in_node = &node->capabilities[0];
-        for (size_t i = 0; i < ((size_t) 1 << node->slot_bits); i ++, slot_in_node ++) {
-            if (slot_in_node->handlers == NULL) {
-                continue;
+    for (size_t i = 0; i < slots_per_chunk(chunk->node); i ++, capability ++) {
+        if (capability->type != CAP_TYPE_NONE) {
+            update_capability_references(capability);
+        }
+    }
+
+    lookup_generation ++;
+}
+
+/// \brief gets the chunk of a capability node with the given index, allocating it if it hasn't been already
+///
+/// the node is locked while the chunk is being allocated. if the chunk couldn't be allocated, NULL is returned
+static struct node_chunk *get_or_alloc_chunk(struct heap *heap, struct capability_node *node, size_t index) {
+    if (node->chunks[index] != NULL) {
+        return node->chunks[index];
+    }
+
+    bool should_unlock = heap_lock(node);
+    size_t total_slots = slots_per_chunk(node);
+    struct node_chunk *chunk = (struct node_chunk *) heap_alloc(heap, sizeof(struct node_chunk) + total_slots * sizeof(struct capability));
+
+    if (chunk != NULL) {
+        chunk->node = node;
+        chunk->index = index;
+
+        struct capability *slots = &chunk->capabilities[0];
+        for (size_t i = 0; i < total_slots; i ++) {
+            (slots ++)->type = CAP_TYPE_NONE;
+        }
+
+        node->chunks[index] = chunk;
+        heap_set_update_function(chunk, on_chunk_moved);
+        heap_unlock(chunk);
+    }
+
+    if (should_unlock) {
+        heap_unlock(node);
+    }
+
+    return chunk;
+}
+
+/// gets how many levels of nodes a node is nested in, including itself
+static uint8_t node_level(const struct capability_node *node) {
+    uint8_t level = 1;
+
+    for (; node->parent != NULL; node = node->parent) {
+        level ++;
+    }
+
+    return level;
+}
+
+/// recalculates the height of a node from the heights of the nodes inside of it, updating the heights of the nodes it's inside of if it changed
+static void update_node_height(struct capability_node *node) {
+    while (node != NULL) {
+        uint8_t height = 1;
+
+        for (uint8_t i = MAX_NESTED_NODES - 1; i > 0; i --) {
+            if (node->child_heights[i - 1] != 0) {
+                height = i + 1;
+                break;
             }
+        }
+
+        if (height == node->height) {
+            return;
+        }
+
+        struct capability_node *parent = node->parent;
+
+        if (parent != NULL) {
+            parent->child_heights[node->height - 1] --;
+            parent->child_heights[height - 1] ++;
+        }
+
+        node->height = height;
+        node = parent;
+    }
+}
+
+size_t check_node_placement(const struct capability *slot, const struct capability_node *container) {
+    if (slot->type != CAP_TYPE_NODE) {
+        return 0;
+    }
 
-            struct absolute_capability_address new_address;
-            new_address.address = (i << address->depth) | address->address;
-            new_address.depth = address->depth + node->slot_bits;
-            new_address.thread_id = address->thread_id;
-            new_address.bucket_number = address->bucket_number;
+    const struct capability_node *node = (const struct capability_node *) slot->resource;
+    uint8_t level = 0;
 
-            update_capability_addresses(slot_in_node, &new_address, nesting + 1);
+    // make sure the node isn't being placed inside of itself, counting how many levels deep the container is along the way
+    for (; container != NULL; container = container->parent) {
+        if (container == node) {
+            return ECAPINVAL;
         }
+
+        level ++;
+    }
+
+    if (level + node->height > MAX_NESTED_NODES) {
+        return ETOOMUCHNESTING;
+    }
+
+    return 0;
+}
+
+void set_node_container(struct capability *slot, struct capability_node *container) {
+    if (slot->type != CAP_TYPE_NODE) {
+        return;
+    }
+
+    struct capability_node *node = (struct capability_node *) slot->resource;
+
+    if (node->parent == container) {
+        return;
+    }
+
+    if (node->parent != NULL) {
+        node->parent->child_heights[node->height - 1] --;
+        update_node_height(node->parent);
+    }
+
+    node->parent = container;
+
+    if (container != NULL) {
+        container->child_heights[node->height - 1] ++;
+        update_node_height(container);
     }
 }
 
-void copy_capability(struct capability *source, struct capability *dest, size_t address, size_t depth) {
+void copy_capability(struct capability *source, struct capability *dest) {
     memcpy(dest, source, sizeof(struct capability));
 #ifdef DEBUG_CAPABILITIES
     printk("copy_capability: source: 0x%x, dest: 0x%x\n", source, dest);
 #endif
 
-    dest->flags &= (uint8_t) ~(CAP_FLAG_ORIGINAL | CAP_FLAG_BADGED);
-
-    dest->address.address = address;
-    dest->address.depth = depth;
+    dest->flags &= (uint8_t) ~(CAP_FLAG_ORIGINAL | CAP_FLAG_BADGED | CAP_FLAG_HEAP_REFERENCE | CAP_FLAG_DERIVATION_HEAD);
 
     // add the newly copied capability to the resource list of the one it was copied from
-    LIST_INSERT_NO_CONTAINER(struct capability, source, resource_list, dest);
+    LIST_INSERT_NO_CONTAINER(source, resource_list, dest);
 
 #ifdef DEBUG_CAPABILITIES
     printk("copy_capability: source derivation: 0x%x, derived_from: 0x%x\n", source->derivation, source->derived_from);
@@ -185,15 +348,16 @@ void copy_capability(struct capability *source, struct capability *dest, size_t
         if (source->derivation == NULL) {
             // this new derivation is the first element in the list
             source->derivation = dest;
+            dest->flags |= CAP_FLAG_DERIVATION_HEAD;
 
             LIST_INIT_NO_CONTAINER(dest, derivation_list);
         } else {
             // add this new derivation to the derivation list originating from the source capability
-            LIST_INSERT_NO_CONTAINER(struct capability, source->derivation, derivation_list, dest);
+            LIST_INSERT_NO_CONTAINER(source->derivation, derivation_list, dest);
         }
     } else {
         // this capability isn't an original derivation, just add it to the derivation list of the source
-        LIST_INSERT_NO_CONTAINER(struct capability, source, derivation_list, dest);
+        LIST_INSERT_NO_CONTAINER(source, derivation_list, dest);
     }
 
     dest->derivation = NULL;
@@ -206,32 +370,87 @@ void copy_capability(struct capability *source, struct capability *dest, size_t
 #endif
 }
 
-static const char *handlers_to_name(const struct invocation_handlers *handlers) {
-    if (handlers == &debug_handlers) {
-        return "debug";
-    } else if (handlers == &endpoint_handlers) {
-        return "endpoint";
-    } else if (handlers == &thread_handlers) {
-        return "thread";
-    } else if (handlers == &node_handlers) {
+static const char *type_to_name(uint8_t type) {
+    switch (type) {
+    case CAP_TYPE_NONE:
+        return "nothing";
+    case CAP_TYPE_NODE:
         return "node";
-    } else if (handlers == &untyped_handlers) {
+    case CAP_TYPE_UNTYPED:
         return "untyped";
-    } else if (handlers == &address_space_handlers) {
+    case CAP_TYPE_ADDRESS_SPACE:
         return "address space";
-    } else if (handlers == NULL) {
-        return "nothing";
-    } else {
+    case CAP_TYPE_THREAD:
+        return "thread";
+    case CAP_TYPE_ENDPOINT:
+        return "endpoint";
+    case CAP_TYPE_DEBUG:
+        return "debug";
+    default:
         return "unknown";
     }
 }
 
 /* ==== capability node ==== */
 
+/// \brief deletes the capabilities in a node and any nodes nested inside of it, until either the node is empty or `*remaining` capabilities have been deleted
+///
+/// chunks are freed as soon as every slot in them is empty, so the chunks that are left keep track of how far along this is if it has to be picked up again later.
+/// returns true if the node is empty
+static bool empty_node(struct capability_node *node, size_t *remaining) {
+    struct heap *heap = find_resource_heap(node);
+
+    for (size_t i = 0; i < chunks_in_node(node); i ++) {
+        struct node_chunk *chunk = node->chunks[i];
+
+        if (chunk == NULL) {
+            continue;
+        }
+
+        struct capability *capability = &chunk->capabilities[0];
+
+        for (size_t j = 0; j < slots_per_chunk(node); j ++, capability ++) {
+            if (capability->type == CAP_TYPE_NONE) {
+                continue;
+            }
+
+            if (*remaining == 0 || !empty_capability(capability, remaining)) {
+                return false;
+            }
+
+            merge_derivation_lists(capability);
+            delete_capability(capability);
+            (*remaining) --;
+        }
+
+        heap_free(heap, chunk);
+        node->chunks[i] = NULL;
+
+        // cached lookups may still point to slots in this chunk
+        lookup_generation ++;
+    }
+
+    return true;
+}
+
+bool empty_capability(struct capability *capability, size_t *remaining) {
+    const struct invocation_handlers *handlers = capability_handlers[capability->type];
+
+    // only the last capability referring to a resource destroys it, so nothing else is deleted along with any of the others
+    if (handlers->empty == NULL || !LIST_IS_ALONE_NO_CONTAINER(capability, resource_list)) {
+        return true;
+    }
+
+    return handlers->empty(capability, remaining);
+}
+
 static size_t node_copy(size_t address, size_t depth, struct capability *slot, size_t argument) {
+    (void) address;
+    (void) depth;
+
     const struct node_copy_args *args = (struct node_copy_args *) argument;
 
-    // resource lock/unlock is omitted here since no allocations take place
+    // resource lock/unlock is omitted here since the node is locked while its chunks are allocated
     struct capability_node *node = (struct capability_node *) slot->resource;
 
     // make sure slot id is valid
@@ -239,11 +458,11 @@ static size_t node_copy(size_t address, size_t depth, struct capability *slot, s
         return EINVAL;
     }
 
-    struct capability *dest = &node->capabilities[args->dest_slot];
+    struct capability *dest = get_node_slot(node, args->dest_slot);
 
     // make sure destination slot is empty
-    if (dest->handlers != NULL) {
-        printk("node_copy: destination slot is occupied (contains %s)\n", handlers_to_name(dest->handlers));
+    if (dest != NULL && dest->type != CAP_TYPE_NONE) {
+        printk("node_copy: destination slot is occupied (contains %s)\n", type_to_name(dest->type));
         return ECAPEXISTS;
     }
 
@@ -255,7 +474,7 @@ static size_t node_copy(size_t address, size_t depth, struct capability *slot, s
 
     // make sure the source capability is eligible for copying.
     // copying of capability nodes isn't allowed because i just don't know how to deal with it currently and it may just overcomplicate things
-    if (result.slot->handlers == &node_handlers) {
+    if (result.slot->type == CAP_TYPE_NODE) {
         printk("node_copy: capability nodes are not able to be copied\n");
         unlock_looked_up_capability(&result);
         return ECAPINVAL;
@@ -268,7 +487,15 @@ static size_t node_copy(size_t address, size_t depth, struct capability *slot, s
         return ECAPINVAL;
     }
 
-    copy_capability(result.slot, dest, address | (args->dest_slot << depth), depth + node->slot_bits);
+    // the source capability's chunk is locked, so it won't move if the destination's chunk has to be allocated
+    if (get_or_alloc_chunk(find_resource_heap(node), node, args->dest_slot >> NODE_CHUNK_BITS) == NULL) {
+        unlock_looked_up_capability(&result);
+        return ENOMEM;
+    }
+
+    dest = get_node_slot(node, args->dest_slot);
+
+    copy_capability(result.slot, dest);
 
     if (args->should_set_badge) {
         dest->badge = args->badge;
@@ -281,9 +508,12 @@ static size_t node_copy(size_t address, size_t depth, struct capability *slot, s
 }
 
 static size_t node_move(size_t address, size_t depth, struct capability *slot, size_t argument) {
+    (void) address;
+    (void) depth;
+
     const struct node_copy_args *args = (struct node_copy_args *) argument;
 
-    // resource lock/unlock is omitted here since no allocations take place
+    // resource lock/unlock is omitted here since the node is locked while its chunks are allocated
     struct capability_node *node = (struct capability_node *) slot->resource;
 
     // make sure slot id is valid
@@ -291,10 +521,10 @@ static size_t node_move(size_t address, size_t depth, struct capability *slot, s
         return EINVAL;
     }
 
-    struct capability *dest = &node->capabilities[args->dest_slot];
+    struct capability *dest = get_node_slot(node, args->dest_slot);
 
     // make sure destination slot is empty
-    if (dest->handlers != NULL) {
+    if (dest != NULL && dest->type != CAP_TYPE_NONE) {
         return ECAPEXISTS;
     }
 
@@ -303,22 +533,53 @@ static size_t node_move(size_t address, size_t depth, struct capability *slot, s
         return ENOCAPABILITY;
     }
 
-    move_capability(result.slot, dest);
+    size_t placement_result = check_node_placement(result.slot, node);
 
-    // update the address of the capability to its new slot
-    dest->address.address = address | (args->dest_slot << depth);
-    dest->address.depth = depth + node->slot_bits;
+    if (placement_result != 0) {
+        printk("node_move: can't move %s into this node\n", type_to_name(result.slot->type));
+        unlock_looked_up_capability(&result);
+        return placement_result;
+    }
 
-    if ((dest->flags & CAP_FLAG_IS_HEAP_MANAGED) != 0 && dest->resource_list.prev == NULL) {
-        // only update the owner id of the node if it's the owner of the resource
-        heap_set_update_capability(dest->resource, &dest->address);
+    // the source capability's chunk is locked, so it won't move if the destination's chunk has to be allocated
+    if (get_or_alloc_chunk(find_resource_heap(node), node, args->dest_slot >> NODE_CHUNK_BITS) == NULL) {
+        unlock_looked_up_capability(&result);
+        return ENOMEM;
     }
 
+    dest = get_node_slot(node, args->dest_slot);
+
+    move_capability(result.slot, dest);
+    set_node_container(dest, node);
+
     unlock_looked_up_capability(&result);
 
     return 0;
 }
 
+/// \brief deletes the capability in the given slot of a node, counting it and anything deleted along with it against `*remaining`
+///
+/// if the slot is empty, `ENOCAPABILITY` is returned. if the capability can't be deleted without going over `*remaining`, as much of it is deleted as possible and `INVOCATION_RESTART` is returned
+static size_t delete_slot(struct capability_node *node, size_t index, size_t *remaining) {
+    struct capability *to_delete = get_node_slot(node, index);
+
+    // make sure there's actually a capability here
+    if (to_delete == NULL || to_delete->type == CAP_TYPE_NONE) {
+        return ENOCAPABILITY;
+    }
+
+    // nodes (and the root nodes of threads) are emptied out a few capabilities at a time, so that deleting a big one doesn't hold up every other thread
+    if (*remaining == 0 || !empty_capability(to_delete, remaining)) {
+        return INVOCATION_RESTART;
+    }
+
+    merge_derivation_lists(to_delete);
+    delete_capability(to_delete);
+    (*remaining) --;
+
+    return 0;
+}
+
 static size_t node_delete(size_t address, size_t depth, struct capability *slot, size_t argument) {
     (void) address;
     (void) depth;
@@ -331,17 +592,8 @@ static size_t node_delete(size_t address, size_t depth, struct capability *slot,
         return EINVAL;
     }
 
-    struct capability *to_delete = &node->capabilities[argument];
-
-    // make sure there's actually a capability here
-    if (to_delete->handlers == NULL) {
-        return ENOCAPABILITY;
-    }
-
-    merge_derivation_lists(to_delete);
-    delete_capability(to_delete);
-
-    return 0;
+    size_t remaining = DELETE_STEP_LIMIT;
+    return delete_slot(node, argument, &remaining);
 }
 
 static size_t node_revoke(size_t address, size_t depth, struct capability *slot, size_t argument) {
@@ -356,68 +608,236 @@ static size_t node_revoke(size_t address, size_t depth, struct capability *slot,
         return EINVAL;
     }
 
-    struct capability *to_revoke = &node->capabilities[argument];
+    struct capability *to_revoke = get_node_slot(node, argument);
 
     // make sure there's actually a capability here and that this capability is eligible for revocation
-    if (to_revoke->handlers == NULL) {
+    if (to_revoke == NULL || to_revoke->type == CAP_TYPE_NONE) {
         return ENOCAPABILITY;
     }
 
-    if (to_revoke->handlers == &node_handlers || (to_revoke->flags & (CAP_FLAG_BADGED | CAP_FLAG_ORIGINAL)) == 0) {
+    if (to_revoke->type == CAP_TYPE_NODE || (to_revoke->flags & (CAP_FLAG_BADGED | CAP_FLAG_ORIGINAL)) == 0) {
         return ECAPINVAL;
     }
 
-    if (to_revoke->derivation == NULL) {
-        // no capabilities have been derived from this capability, so nothing needs to be done here :3
+    // delete all the capabilities that have been derived from this one, a few at a time.
+    // capabilities are only deleted once nothing is derived from them, so what's left of the derivation tree is all that has to be kept track of between steps
+    for (size_t deleted = 0; to_revoke->derivation != NULL; deleted ++) {
+        if (deleted == DELETE_STEP_LIMIT) {
+            return INVOCATION_RESTART;
+        }
+
+        struct capability *leaf = to_revoke->derivation;
+
+        while ((leaf->flags & (CAP_FLAG_ORIGINAL | CAP_FLAG_BADGED)) != 0 && leaf->derivation != NULL) {
+            leaf = leaf->derivation;
+        }
+
+        merge_derivation_lists(leaf);
+        delete_capability(leaf);
+    }
+
+    return 0;
+}
+
+/// gets the index of the highest bit set in a bitmask of slots, which must not be 0
+static size_t last_slot_in(size_t slots) {
+    size_t last = 0;
+
+    while (slots > 1) {
+        slots >>= 1;
+        last ++;
+    }
+
+    return last;
+}
+
+/// checks whether every slot in a range starting at `first` and ending `last` slots later is in the given node
+static inline bool is_range_in_node(const struct capability_node *node, size_t first, size_t last) {
+    size_t total_slots = (size_t) 1 << node->slot_bits;
+    return first < total_slots && last < total_slots - first;
+}
+
+/// \brief copies or moves the capability in one slot of a node into an empty slot of another node
+///
+/// if the source slot is empty, nothing is done and 0 is returned
+static size_t copy_or_move_slot(struct capability_node *source_node, size_t source_slot, struct capability_node *dest_node, size_t dest_slot, bool should_move) {
+    struct capability *source = get_node_slot(source_node, source_slot);
+
+    if (source == NULL || source->type == CAP_TYPE_NONE) {
         return 0;
     }
 
-    // delete all the capabilities that have been derived from this one.
-    // derivation lists don't have to be merged here since they'll all be deleted anyways
-    LIST_ITER_NO_CONTAINER(struct capability, derivation_list, to_revoke->derivation, c) {
-        if ((c->flags & (CAP_FLAG_ORIGINAL | CAP_FLAG_BADGED)) != 0 && c->derivation != NULL) {
-            // this capability has a second derivation tree level, walk it and delete those capabilities too
-            LIST_ITER_NO_CONTAINER(struct capability, derivation_list, c->derivation, d) {
-                delete_capability(d);
-            }
+    const struct capability *dest = get_node_slot(dest_node, dest_slot);
+
+    if (dest != NULL && dest->type != CAP_TYPE_NONE) {
+        return ECAPEXISTS;
+    }
+
+    if (should_move) {
+        size_t placement_result = check_node_placement(source, dest_node);
+
+        if (placement_result != 0) {
+            return placement_result;
         }
+    } else if (source->type == CAP_TYPE_NODE) {
+        return ECAPINVAL;
+    }
+
+    // the source slot's chunk is locked so that it won't move if the destination's chunk has to be allocated
+    struct node_chunk *source_chunk = source_node->chunks[source_slot >> NODE_CHUNK_BITS];
+    bool should_unlock = heap_lock(source_chunk);
+    size_t return_value = 0;
+
+    if (get_or_alloc_chunk(find_resource_heap(dest_node), dest_node, dest_slot >> NODE_CHUNK_BITS) == NULL) {
+        return_value = ENOMEM;
+    } else if (should_move) {
+        struct capability *moved = get_node_slot(dest_node, dest_slot);
+        move_capability(source, moved);
+        set_node_container(moved, dest_node);
+    } else {
+        copy_capability(source, get_node_slot(dest_node, dest_slot));
+    }
+
+    if (should_unlock) {
+        heap_unlock(source_chunk);
+    }
+
+    return return_value;
+}
 
-        delete_capability(c);
+/// handles the `node_copy_range` and `node_move_range` invocations
+static size_t copy_or_move_range(struct capability *slot, const struct node_range_args *args, bool should_move) {
+    // resource lock/unlock is omitted here since the node is locked while its chunks are allocated
+    struct capability_node *node = (struct capability_node *) slot->resource;
+
+    if (args->slots == 0) {
+        return 0;
+    }
+
+    size_t last = last_slot_in(args->slots);
+
+    if (!is_range_in_node(node, args->dest_slot, last)) {
+        return EINVAL;
     }
 
-    to_revoke->derivation = NULL;
+    struct look_up_result result;
+    if (!look_up_capability_relative(args->source_address, args->source_depth, &result)) {
+        return ENOCAPABILITY;
+    }
+
+    // the source node is kept locked instead of the chunk of the first capability, since the capabilities being copied or moved can be in any of its chunks
+    struct capability_node *source_node = result.node;
+    size_t first_source = result.index;
+    bool should_unlock = heap_lock(source_node);
+    unlock_looked_up_capability(&result);
+
+    size_t return_value = is_range_in_node(source_node, first_source, last) ? 0 : EINVAL;
+
+    // if capabilities are being moved to later slots in the same node, they're moved starting at the end so that none of them are in the way of the others
+    bool backwards = source_node == node && args->dest_slot > first_source;
+
+    for (size_t i = 0; i <= last && return_value == 0; i ++) {
+        size_t offset = backwards ? last - i : i;
+
+        if ((args->slots & ((size_t) 1 << offset)) != 0) {
+            return_value = copy_or_move_slot(source_node, first_source + offset, node, args->dest_slot + offset, should_move);
+        }
+    }
+
+    if (should_unlock) {
+        heap_unlock(source_node);
+    }
+
+    return return_value;
+}
+
+static size_t node_copy_range(size_t address, size_t depth, struct capability *slot, size_t argument) {
+    (void) address;
+    (void) depth;
+
+    return copy_or_move_range(slot, (const struct node_range_args *) argument, false);
+}
+
+static size_t node_move_range(size_t address, size_t depth, struct capability *slot, size_t argument) {
+    (void) address;
+    (void) depth;
+
+    return copy_or_move_range(slot, (const struct node_range_args *) argument, true);
+}
+
+static size_t node_delete_range(size_t address, size_t depth, struct capability *slot, size_t argument) {
+    (void) address;
+    (void) depth;
+
+    const struct node_delete_range_args *args = (const struct node_delete_range_args *) argument;
+
+    // resource lock/unlock is omitted here since no allocations take place
+    struct capability_node *node = (struct capability_node *) slot->resource;
+
+    if (args->slots == 0) {
+        return 0;
+    }
+
+    size_t last = last_slot_in(args->slots);
+
+    if (!is_range_in_node(node, args->first_slot, last)) {
+        return EINVAL;
+    }
+
+    // slots that have already been deleted are empty by the time this is restarted, so they're skipped over along with any others that are empty
+    size_t remaining = DELETE_STEP_LIMIT;
+
+    for (size_t i = 0; i <= last; i ++) {
+        if ((args->slots & ((size_t) 1 << i)) != 0 && delete_slot(node, args->first_slot + i, &remaining) == INVOCATION_RESTART) {
+            return INVOCATION_RESTART;
+        }
+    }
 
     return 0;
 }
 
 static void on_node_moved(void *resource) {
     struct capability_node *node = (struct capability_node *) resource;
-    struct capability *capability = &node->capabilities[0];
 
-    for (size_t i = 0; i < ((size_t) 1 << node->slot_bits); i ++, capability ++) {
-        if (capability->handlers != NULL) {
-            update_capability_references(capability);
+    // the slots themselves are in the node's chunks, so only the chunks' and any nested nodes' references to the node have to be updated
+    for (size_t i = 0; i < chunks_in_node(node); i ++) {
+        struct node_chunk *chunk = node->chunks[i];
+
+        if (chunk == NULL) {
+            continue;
+        }
+
+        chunk->node = node;
+
+        struct capability *capability = &chunk->capabilities[0];
+
+        for (size_t j = 0; j < slots_per_chunk(node); j ++, capability ++) {
+            if (capability->type == CAP_TYPE_NODE) {
+                ((struct capability_node *) capability->resource)->parent = node;
+            }
         }
     }
 }
 
 static void node_destructor(struct capability *node_capability) {
-    struct capability_node *node = (struct capability_node *) node_capability->resource;
-    struct capability *capability = &node->capabilities[0];
+    set_node_container(node_capability, NULL);
 
-    for (size_t i = 0; i < ((size_t) 1 << node->slot_bits); i ++, capability ++) {
-        if (capability->handlers != NULL) {
-            merge_derivation_lists(capability);
-            delete_capability(capability);
-        }
-    }
+    // anything that can be restarted empties nodes out with node_empty before deleting them, so this only has anything left to delete
+    // if the node is being deleted by something that can't be restarted
+    size_t remaining = SIZE_MAX;
+    empty_node((struct capability_node *) node_capability->resource, &remaining);
+}
+
+static bool node_empty(struct capability *node_capability, size_t *remaining) {
+    return empty_node((struct capability_node *) node_capability->resource, remaining);
 }
 
 struct invocation_handlers node_handlers = {
-    .num_handlers = 4,
-    .handlers = {node_copy, node_move, node_delete, node_revoke},
+    .num_handlers = 7,
+    .handlers = {node_copy, node_move, node_delete, node_revoke, node_copy_range, node_move_range, node_delete_range},
     .on_moved = on_node_moved,
-    .destructor = node_destructor
+    .destructor = node_destructor,
+    .empty = node_empty
 };
 
 void *alloc_node(struct heap *heap, size_t slot_bits) {
@@ -426,8 +846,8 @@ void *alloc_node(struct heap *heap, size_t slot_bits) {
         slot_bits = (sizeof(size_t) * 8) - 1;
     }
 
-    size_t total_slots = (size_t) 1 << slot_bits;
-    size_t alloc_size = sizeof(struct capability_node) + total_slots * sizeof(struct capability);
+    size_t total_chunks = slot_bits < NODE_CHUNK_BITS ? 1 : (size_t) 1 << (slot_bits - NODE_CHUNK_BITS);
+    size_t alloc_size = sizeof(struct capability_node) + total_chunks * sizeof(struct node_chunk *);
 
     struct capability_node *new = (struct capability_node *) heap_alloc(heap, alloc_size);
     if (new == NULL) {
@@ -435,18 +855,29 @@ void *alloc_node(struct heap *heap, size_t slot_bits) {
     }
 
     new->slot_bits = slot_bits; // this is guaranteed to fit within a uint8_t due to the above sanity check. if (sizeof(size_t) * 8) - 1 is greater than 256 then you have other problems really
-    new->nested_nodes = 1; // to be filled out in populate_capability_slot() if this isn't the kernel root node
+    new->height = 1;
+    new->guard_bits = 0;
+    new->guard = 0;
+    new->parent = NULL;
 
-    struct capability *slots = &new->capabilities[0];
-    for (size_t i = 0; i < total_slots; i ++) {
-        (slots ++)->handlers = NULL;
+    for (size_t i = 0; i < MAX_NESTED_NODES - 1; i ++) {
+        new->child_heights[i] = 0;
+    }
+
+    for (size_t i = 0; i < total_chunks; i ++) {
+        new->chunks[i] = NULL;
     }
 
     return new;
 }
 
+/// \brief stands in for slots in chunks of capability nodes that haven't been allocated yet
+///
+/// lookups that end up at one of these slots return this, and it's never written to
+static struct capability empty_slot;
+
 bool look_up_capability(struct capability *root, size_t address, size_t depth, struct look_up_result *result) {
-    if (root->handlers != &node_handlers) {
+    if (root->type != CAP_TYPE_NODE) {
         return false;
     }
 
@@ -458,28 +889,39 @@ bool look_up_capability(struct capability *root, size_t address, size_t depth, s
         address &= (((size_t) 1 << depth) - 1); // make sure there aren't any invalid bits outside of the address
     }
 
-    bool should_unlock = heap_lock(root->resource);
+    // nodes don't need to be locked during the search since nothing is allocated, only the chunk containing the slot that's found is locked
     struct capability_node *node = (struct capability_node *) root->resource;
     size_t actual_depth = 0;
 
     while (1) {
+        if (node->guard_bits != 0) {
+            // skip over this node's guard, making sure that it matches the address
+            if ((!use_first_non_node && depth < node->guard_bits + node->slot_bits) || (address & (((size_t) 1 << node->guard_bits) - 1)) != node->guard) {
+                return false;
+            }
+
+            address >>= node->guard_bits;
+            depth -= node->guard_bits;
+            actual_depth += node->guard_bits;
+        }
+
         size_t index_in_node = address & (((size_t) 1 << node->slot_bits) - 1);
-        struct capability *slot = &node->capabilities[index_in_node];
+        struct node_chunk *chunk = node->chunks[index_in_node >> NODE_CHUNK_BITS];
+        struct capability *slot = chunk == NULL ? &empty_slot : get_node_slot(node, index_in_node);
 
-        if ((use_first_non_node && slot->handlers != &node_handlers) || depth == node->slot_bits) {
+        if ((use_first_non_node && slot->type != CAP_TYPE_NODE) || depth == node->slot_bits) {
             // finished the search!
             result->slot = slot;
             result->depth = actual_depth + node->slot_bits;
-            result->container = node;
-            result->should_unlock = should_unlock;
+            result->container = chunk;
+            result->should_unlock = chunk != NULL && heap_lock(chunk);
+            result->node = node;
+            result->index = index_in_node;
             return true;
         }
 
         // sanity check. if the depth value doesn't match how many bits are in the node or if the slot doesn't contain a node, give up
-        if (depth < node->slot_bits || slot->handlers != &node_handlers) {
-            if (should_unlock) {
-                heap_unlock(node);
-            }
+        if (depth < node->slot_bits || slot->type != CAP_TYPE_NODE) {
             return false;
         }
 
@@ -487,15 +929,7 @@ bool look_up_capability(struct capability *root, size_t address, size_t depth, s
         depth -= node->slot_bits;
         actual_depth += node->slot_bits;
 
-        bool next_should_unlock = heap_lock(slot->resource);
-        struct capability_node *next = (struct capability_node *) slot->resource;
-
-        if (should_unlock) {
-            heap_unlock(node);
-        }
-
-        should_unlock = next_should_unlock;
-        node = next;
+        node = (struct capability_node *) slot->resource;
     }
 }
 
@@ -505,6 +939,68 @@ void unlock_looked_up_capability(struct look_up_result *result) {
     }
 }
 
+bool allocate_looked_up_slot(struct look_up_result *result) {
+    if (result->container != NULL) {
+        return true;
+    }
+
+    struct node_chunk *chunk = get_or_alloc_chunk(find_resource_heap(result->node), result->node, result->index >> NODE_CHUNK_BITS);
+
+    if (chunk == NULL) {
+        return false;
+    }
+
+    result->slot = get_node_slot(result->node, result->index);
+    result->container = chunk;
+    result->should_unlock = heap_lock(chunk);
+
+    return true;
+}
+
+/// looks up a capability relative to the given thread's root capability node, using the thread's lookup cache if possible
+static bool look_up_capability_cached(struct thread_capability *thread, size_t address, size_t depth, struct look_up_result *result) {
+    if (depth == SIZE_MAX) {
+        // the result of these lookups depends on what's in the slots along the way, so they aren't cached
+        return look_up_capability(&thread->root_capability, address, depth, result);
+    }
+
+    address &= (((size_t) 1 << depth) - 1);
+
+    // the lower bits of an address pick the slot in the root node, so the bits after them are mixed in to keep addresses in the same nested node from colliding
+    struct lookup_cache_entry *entry = &thread->lookup_cache[(address ^ (address >> ROOT_CAP_SLOT_BITS)) % LOOKUP_CACHE_SIZE];
+
+    if (entry->generation == lookup_generation && entry->address == address && entry->depth == depth) {
+        lookup_cache_hits ++;
+
+        result->slot = entry->slot;
+        result->depth = depth;
+        result->container = entry->container;
+        result->should_unlock = heap_lock(entry->container);
+        result->node = entry->container->node;
+        result->index = (entry->container->index << NODE_CHUNK_BITS) | (size_t) (entry->slot - entry->container->capabilities);
+        return true;
+    }
+
+    lookup_cache_misses ++;
+
+    if (!look_up_capability(&thread->root_capability, address, depth, result)) {
+        return false;
+    }
+
+    // slots in chunks that haven't been allocated yet aren't cached, since they'll be somewhere else once they are
+    if (result->container == NULL) {
+        return true;
+    }
+
+    entry->generation = lookup_generation;
+    entry->address = address;
+    entry->depth = depth;
+    entry->container = (struct node_chunk *) result->container;
+    entry->slot = result->slot;
+
+    return true;
+}
+
 bool look_up_capability_relative(size_t address, size_t depth, struct look_up_result *result) {
     if (scheduler_state.current_thread == NULL) {
         printk("look_up_capability_relative: no current thread!\n");
@@ -512,7 +1008,7 @@ bool look_up_capability_relative(size_t address, size_t depth, struct look_up_re
     }
 
     bool should_unlock = heap_lock(scheduler_state.current_thread);
-    bool return_value = look_up_capability(&scheduler_state.current_thread->root_capability, address, depth, result);
+    bool return_value = look_up_capability_cached(scheduler_state.current_thread, address, depth, result);
 
     if (should_unlock) {
         heap_unlock(scheduler_state.current_thread);
@@ -530,7 +1026,7 @@ bool look_up_capability_absolute(const struct absolute_capability_address *addre
         return false;
     }
 
-    bool return_value = look_up_capability(&thread->root_capability, address->address, address->depth, result);
+    bool return_value = look_up_capability_cached(thread, address->address, address->depth, result);
 
     if (should_unlock) {
         heap_unlock(thread);
@@ -545,15 +1041,15 @@ static void list_capability_node_slots(struct capability_node *node) {
     size_t last_empty = -1;
     size_t i = 0;
     for (; i < ((size_t) 1 << node->slot_bits); i ++) {
-        const struct capability *slot = &node->capabilities[i];
+        const struct capability *slot = get_node_slot(node, i);
 
-        if (slot->handlers != NULL) {
+        if (slot != NULL && slot->type != CAP_TYPE_NONE) {
             if (last_empty != -1) {
                 printk("0x%" PRIxPTR " to 0x%" PRIxPTR ": nothing\n", last_empty, i);
                 last_empty = -1;
             }
 
-            printk("0x%" PRIxPTR ": %s\n", i, handlers_to_name(slot->handlers));
+            printk("0x%" PRIxPTR ": %s\n", i, type_to_name(slot->type));
         } else if (last_empty == -1) {
             last_empty = i;
         }
@@ -565,13 +1061,8 @@ static void list_capability_node_slots(struct capability_node *node) {
 }
 #endif
 
-size_t populate_capability_slot(struct heap *heap, size_t address, size_t depth, void *resource, struct invocation_handlers *handlers, uint8_t flags) {
+size_t populate_capability_slot(struct heap *heap, size_t address, size_t depth, void *resource, uint8_t type, uint8_t flags) {
     struct look_up_result result;
-//#ifdef DEBUG
-#if 0
-    result.container = NULL;
-#endif
-
     if (!look_up_capability_relative(address, depth, &result)) {
         printk("populate_capability_slot: failed to look up slot at 0x%" PRIxPTR " (%" PRIdPTR " bits)\n", address, depth);
 
@@ -583,8 +1074,8 @@ size_t populate_capability_slot(struct heap *heap, size_t address, size_t depth,
     }
 
     // make sure destination slot is empty
-    if (result.slot->handlers != NULL) {
-        printk("populate_capability_slot: slot at 0x%" PRIxPTR " (%" PRIdPTR " bits) isn't empty (contains %s)\n", address, depth, handlers_to_name(result.slot->handlers));
+    if (result.slot->type != CAP_TYPE_NONE) {
+        printk("populate_capability_slot: slot at 0x%" PRIxPTR " (%" PRIdPTR " bits) isn't empty (contains %s)\n", address, depth, type_to_name(result.slot->type));
 
         if ((flags & CAP_FLAG_IS_HEAP_MANAGED) != 0) {
             heap_free(heap, resource);
@@ -592,20 +1083,16 @@ size_t populate_capability_slot(struct heap *heap, size_t address, size_t depth,
 
 //#ifdef DEBUG
 #if 0
-        if (result.container != NULL) {
-            list_capability_node_slots(result.container);
-        }
+        list_capability_node_slots(result.node);
 #endif
 
         unlock_looked_up_capability(&result);
         return ECAPEXISTS;
     }
 
-    if (handlers == &node_handlers && result.container != NULL) {
-        const struct capability_node *container = (struct capability_node *) result.container;
-
+    if (type == CAP_TYPE_NODE) {
         // make sure this new node isn't too many layers of nesting deep
-        if (container->nested_nodes >= MAX_NESTED_NODES) {
+        if (node_level(result.node) >= MAX_NESTED_NODES) {
             printk("populate_capability_slot: too many levels of nesting\n");
 
             if ((flags & CAP_FLAG_IS_HEAP_MANAGED) != 0) {
@@ -615,32 +1102,32 @@ size_t populate_capability_slot(struct heap *heap, size_t address, size_t depth,
             unlock_looked_up_capability(&result);
             return ETOOMUCHNESTING;
         }
+    }
+
+    // the resource is still locked from when it was allocated, so it won't move if the slot has to be allocated
+    if (!allocate_looked_up_slot(&result)) {
+        printk("populate_capability_slot: failed to allocate slot at 0x%" PRIxPTR " (%" PRIdPTR " bits)\n", address, depth);
+
+        if ((flags & CAP_FLAG_IS_HEAP_MANAGED) != 0) {
+            heap_free(heap, resource);
+        }
 
-        // update the nested nodes count of this new node
-        struct capability_node *node = (struct capability_node *) resource;
-        node->nested_nodes = container->nested_nodes + 1;
+        return ENOMEM;
     }
 
     memset(result.slot, 0, sizeof(struct capability));
-    result.slot->handlers = handlers;
+    result.slot->type = type;
     result.slot->resource = resource;
     result.slot->flags = flags | CAP_FLAG_ORIGINAL;
     result.slot->access_rights = UINT8_MAX; // all rights given
     LIST_INIT_NO_CONTAINER(result.slot, resource_list);
     // everything else here assumes NULL is 0
 
-    if (scheduler_state.current_thread != NULL) {
-        // get thread id and bucket number from current thread
-        result.slot->address.thread_id = scheduler_state.current_thread->thread_id;
-        result.slot->address.bucket_number = scheduler_state.current_thread->bucket_number;
-    }
-
-    result.slot->address.address = address;
-    result.slot->address.depth = result.depth;
-    result.slot->heap = heap;
+    set_node_container(result.slot, result.node);
 
     if ((flags & CAP_FLAG_IS_HEAP_MANAGED) != 0) {
-        heap_set_update_capability(resource, &result.slot->address);
+        result.slot->flags |= CAP_FLAG_HEAP_REFERENCE;
+        heap_set_update_capability(resource, result.slot);
         heap_unlock(resource);
     }
 
@@ -648,46 +1135,74 @@ size_t populate_capability_slot(struct heap *heap, size_t address, size_t depth,
     return 0;
 }
 
-static uint8_t nesting_depth_search(const struct capability *node_capability) {
-    const struct capability_node *node = (struct capability_node *) node_capability->resource;
-    uint8_t nesting_value = node->nested_nodes;
+/* ==== untyped memory ==== */
 
-    const struct capability *capability = &node->capabilities[0];
-    for (size_t i = 0; i < ((size_t) 1 << node->slot_bits); i ++, capability ++) {
-        if (capability->handlers != &node_handlers) {
-            continue;
-        }
+// TODO: wrap these in a mutex
 
-        uint8_t new_nesting = nesting_depth_search(capability);
+void release_leases(struct thread_capability *thread) {
+    for (uint8_t i = 0; i < thread->num_leases; i ++) {
+        heap_unlock(thread->leases[i]);
+    }
+
+    thread->num_leases = 0;
+}
 
-        if (new_nesting > nesting_value) {
-            nesting_value = new_nesting;
+/// finds the given thread's lease on the given resource, returning NULL if it isn't leased by that thread
+static void **find_lease(struct thread_capability *thread, void *resource) {
+    for (uint8_t i = 0; i < thread->num_leases; i ++) {
+        if (thread->leases[i] == resource) {
+            return &thread->leases[i];
         }
     }
 
-    return nesting_value;
+    return NULL;
 }
 
-uint8_t get_nested_nodes_depth(const struct capability *node_capability) {
-    if (node_capability->handlers != &node_handlers) {
-        return 0;
+bool drop_lease(struct thread_capability *thread, void *resource) {
+    void **lease = find_lease(thread, resource);
+
+    if (lease == NULL) {
+        return false;
     }
 
-    const struct capability_node *node = (struct capability_node *) node_capability->resource;
-    return nesting_depth_search(node_capability) - node->nested_nodes;
+    // the order of leases doesn't matter, so the last one is moved into the gap
+    *lease = thread->leases[-- thread->num_leases];
+    return true;
 }
 
-/* ==== untyped memory ==== */
+/// leases an object for the given thread, returning 0 if it's now leased by that thread or an error value otherwise
+static size_t lease_resource(struct thread_capability *thread, void *resource) {
+    if (find_lease(thread, resource) != NULL) {
+        // this thread already has this object leased, so it doesn't need to be locked again
+        return 0;
+    }
 
-// TODO: wrap these in a mutex
+    if (thread->num_leases >= MAX_LEASES) {
+        return ETOOMANYLEASES;
+    }
+
+    if (!heap_lock(resource)) {
+        return EBUSY;
+    }
+
+    thread->leases[thread->num_leases ++] = resource;
+
+#ifdef DEBUG_CAPABILITIES
+    printk("lease_resource: thread 0x%x leased 0x%" PRIxPTR " (%d leases held)\n", thread->thread_id, (size_t) resource, thread->num_leases);
+#endif
+
+    return 0;
+}
 
 static size_t untyped_lock(size_t address, size_t depth, struct capability *slot, size_t argument) {
     (void) address;
     (void) depth;
     (void) argument;
 
+    // locks are counted, so every call to this has to be matched with a call to untyped_unlock
     if (!heap_lock(slot->resource)) {
-        printk("untyped_lock: attempted to lock a memory region twice!\n");
+        printk("untyped_lock: memory region has been locked too many times\n");
+        return (size_t) NULL;
     }
     return (size_t) slot->resource;
 }
@@ -706,7 +1221,8 @@ static size_t untyped_try_lock(size_t address, size_t depth, struct capability *
     (void) depth;
     (void) argument;
 
-    if (heap_lock(slot->resource)) {
+    // locks are counted now, so this would always succeed like untyped_lock does if it didn't check whether anything else already has the object locked
+    if (heap_pins(slot->resource) == 0 && heap_lock(slot->resource)) {
         return (size_t) slot->resource;
     } else {
         return (size_t) NULL;
@@ -721,9 +1237,94 @@ static size_t untyped_sizeof(size_t address, size_t depth, struct capability *sl
     return heap_sizeof(slot->resource);
 }
 
+static size_t untyped_lease(size_t address, size_t depth, struct capability *slot, size_t argument) {
+    (void) address;
+    (void) depth;
+    (void) argument;
+
+    switch (lease_resource(scheduler_state.current_thread, slot->resource)) {
+    case 0:
+        return (size_t) slot->resource;
+    case ETOOMANYLEASES:
+        printk("untyped_lease: thread 0x%x has too many objects leased\n", scheduler_state.current_thread->thread_id);
+        return (size_t) NULL;
+    default:
+        printk("untyped_lease: memory region has been locked too many times\n");
+        return (size_t) NULL;
+    }
+}
+
+static size_t untyped_resize(size_t address, size_t depth, struct capability *slot, size_t argument) {
+    (void) address;
+    (void) depth;
+
+    size_t size = argument;
+
+    if (size == 0) {
+        return EINVAL;
+    }
+
+    // objects are rounded up in size the same way as they are in address_space_alloc
+    if (size <= SMALL_UNTYPED_MAX_SIZE) {
+        size = SMALL_UNTYPED_MIN_SIZE;
+        for (; size < argument; size <<= 1);
+    }
+
+    // the object may be moved, which would invalidate any pointers to it other than one the calling thread can get again by leasing it
+    void **lease = find_lease(scheduler_state.current_thread, slot->resource);
+
+    if (heap_pins(slot->resource) > (lease != NULL ? 1 : 0)) {
+        printk("untyped_resize: object at 0x%" PRIxPTR " can't be resized while it's locked\n", (size_t) slot->resource);
+        return EBUSY;
+    }
+
+    // the object has to be locked while it's being resized so that it isn't moved by anything else in the meantime
+    if (lease == NULL && !heap_lock(slot->resource)) {
+        return EBUSY;
+    }
+
+    void *resource = heap_realloc(find_resource_heap(slot->resource), slot->resource, size);
+
+    if (resource == NULL) {
+        if (lease == NULL) {
+            heap_unlock(slot->resource);
+        }
+
+        return ENOMEM;
+    }
+
+    // the capabilities referring to the object have been updated by the heap if it was moved, however the calling thread's lease on it hasn't been
+    if (lease != NULL) {
+        *lease = resource;
+    } else {
+        heap_unlock(resource);
+    }
+
+    return 0;
+}
+
+static void untyped_destructor(struct capability *slot) {
+    // the object is about to be freed, so any leases on it are dropped without unlocking it.
+    // it's almost always leased by nobody or only by the calling thread, so other threads are only searched if something else is still keeping it locked
+    uint8_t pins = heap_pins(slot->resource);
+
+    if (pins == 0) {
+        return;
+    }
+
+    if (scheduler_state.current_thread != NULL && drop_lease(scheduler_state.current_thread, slot->resource)) {
+        pins --;
+    }
+
+    if (pins > 0) {
+        drop_leases_on(slot->resource);
+    }
+}
+
 struct invocation_handlers untyped_handlers = {
-    .num_handlers = 4,
-    .handlers = {untyped_lock, untyped_unlock, untyped_try_lock, untyped_sizeof},
+    .num_handlers = 6,
+    .handlers = {untyped_lock, untyped_unlock, untyped_try_lock, untyped_sizeof, untyped_lease, untyped_resize},
+    .destructor = untyped_destructor
 };
 
 /* ==== address space ==== */
@@ -764,7 +1365,7 @@ static size_t address_space_alloc(size_t address, size_t depth, struct capabilit
 
     // allocate resource
     void *resource = NULL;
-    struct invocation_handlers *handlers;
+    uint8_t type = CAP_TYPE_NONE;
 
 #ifdef DEBUG_CAPABILITIES
     printk(
@@ -777,20 +1378,46 @@ static size_t address_space_alloc(size_t address, size_t depth, struct capabilit
 
     switch (args->type) {
     case TYPE_UNTYPED:
-        resource = heap_alloc(heap, args->size);
-        handlers = &untyped_handlers;
-        break;
+        {
+            size_t size = args->size;
+
+            if (size <= SMALL_UNTYPED_MAX_SIZE) {
+                size = SMALL_UNTYPED_MIN_SIZE;
+                for (; size < args->size; size <<= 1);
+            }
+
+            if ((args->flags & ALLOC_FLAG_PINNED) != 0) {
+                resource = heap_alloc_pinned(heap, size);
+            } else {
+                resource = heap_alloc(heap, size);
+            }
+
+            type = CAP_TYPE_UNTYPED;
+            break;
+        }
     case TYPE_NODE:
+        // the guard has to fit within its bits, and the guard and slot bits together have to fit within an address
+        if ((args->guard_bits != 0 && args->size + args->guard_bits >= sizeof(size_t) * 8) || (args->guard >> args->guard_bits) != 0) {
+            printk("address_space_alloc: invalid guard 0x%" PRIxPTR " (%d bits) for node with %" PRIdPTR " slot bits\n", args->guard, args->guard_bits, args->size);
+            return EINVAL;
+        }
+
         resource = alloc_node(heap, args->size);
-        handlers = &node_handlers;
+
+        if (resource != NULL) {
+            ((struct capability_node *) resource)->guard_bits = args->guard_bits;
+            ((struct capability_node *) resource)->guard = args->guard;
+        }
+
+        type = CAP_TYPE_NODE;
         break;
     case TYPE_THREAD:
         resource = alloc_thread(heap);
-        handlers = &thread_handlers;
+        type = CAP_TYPE_THREAD;
         break;
     case TYPE_ENDPOINT:
         resource = alloc_endpoint(heap);
-        handlers = &endpoint_handlers;
+        type = CAP_TYPE_ENDPOINT;
         break;
     }
 
@@ -800,55 +1427,180 @@ static size_t address_space_alloc(size_t address, size_t depth, struct capabilit
     }
 
 #ifdef DEBUG_CAPABILITIES
-    printk("address_space_alloc: allocated resource 0x%x with handlers 0x%x\n", resource, handlers);
+    printk("address_space_alloc: allocated resource 0x%x with type %d (%s)\n", resource, type, type_to_name(type));
 #endif
 
-    return populate_capability_slot(heap, args->address, args->depth, resource, handlers, CAP_FLAG_IS_HEAP_MANAGED);
+    return populate_capability_slot(heap, args->address, args->depth, resource, type, CAP_FLAG_IS_HEAP_MANAGED);
 }
 
-struct invocation_handlers address_space_handlers = {
-    .num_handlers = 1,
-    .handlers = {address_space_alloc}
-};
+static size_t address_space_stats(size_t address, size_t depth, struct capability *slot, size_t argument) {
+    (void) address;
+    (void) depth;
 
-/* ==== misc ==== */
+    const struct address_space_capability *heap_resource = (struct address_space_capability *) slot->resource;
+
+    struct heap_stats *stats = (struct heap_stats *) argument;
+
+    heap_get_stats(heap_resource->heap_pointer, stats);
+    stats->lookup_cache_hits = lookup_cache_hits;
+    stats->lookup_cache_misses = lookup_cache_misses;
+
+    return 0;
+}
+
+/// called by `deliver_watermark_notifications` once the heap has dropped below the watermark set by `address_space_set_watermark`
+static void notify_watermark(void *data) {
+    struct capability *endpoint = (struct capability *) data;
+
+    // the endpoint capability may have been revoked since the watermark was set
+    if (endpoint->type != CAP_TYPE_NONE) {
+        endpoint_notify(endpoint);
+    }
+}
+
+static size_t address_space_set_watermark(size_t address, size_t depth, struct capability *slot, size_t argument) {
+    (void) address;
+    (void) depth;
+
+    const struct watermark_args *args = (struct watermark_args *) argument;
+    struct address_space_capability *address_space = (struct address_space_capability *) slot->resource;
+    struct heap *heap = address_space->heap_pointer;
+
+    // get rid of the previous watermark and the endpoint it referred to
+    heap_set_watermark(heap, 0, 0, NULL, NULL);
+
+    if (address_space->watermark_endpoint != NULL) {
+        if (address_space->watermark_endpoint->type != CAP_TYPE_NONE) {
+            // this copy is about to be freed, so it can't be left in its derivation list
+            merge_derivation_lists(address_space->watermark_endpoint);
+            delete_capability(address_space->watermark_endpoint);
+        }
+
+        heap_free(heap, address_space->watermark_endpoint);
+        address_space->watermark_endpoint = NULL;
+    }
+
+    if (args->endpoint_depth == 0) {
+        return 0;
+    }
 
-void update_capability_resource(const struct absolute_capability_address *address, void *new_resource_address) {
     struct look_up_result result;
 
-    if (address->address == 0 && address->depth == 0) {
-        // this capability is the root capability of a thread, look up the thread and use its root capability slot
+    if (!look_up_capability_relative(args->endpoint_address, args->endpoint_depth, &result)) {
+        return ENOCAPABILITY;
+    }
+
+    if (result.slot->type != CAP_TYPE_ENDPOINT) {
+        printk("address_space_set_watermark: capability at 0x%" PRIxPTR " (%" PRIdPTR " bits) isn't an endpoint\n", args->endpoint_address, args->endpoint_depth);
+        unlock_looked_up_capability(&result);
+        return ECAPINVAL;
+    }
 
-        struct thread_capability *thread;
-        result.should_unlock = look_up_thread_by_id(address->thread_id, address->bucket_number, &thread);
-        result.container = (void *) thread;
+    // the heap refers to this copy of the endpoint capability directly, so it stays locked until the watermark is replaced
+    struct capability *endpoint = (struct capability *) heap_alloc(heap, sizeof(struct capability));
 
-        if (thread == NULL) {
-            printk("update_capability_resource: couldn't find thread 0x%x in bucket %d\n", address->thread_id, address->bucket_number);
-            return;
+    if (endpoint == NULL) {
+        unlock_looked_up_capability(&result);
+        return ENOMEM;
+    }
+
+    copy_capability(result.slot, endpoint);
+    unlock_looked_up_capability(&result);
+
+    address_space->watermark_endpoint = endpoint;
+    heap_set_watermark(heap, args->free_memory, args->largest_free_block, notify_watermark, endpoint);
+
+    return 0;
+}
+
+static size_t address_space_release_leases(size_t address, size_t depth, struct capability *slot, size_t argument) {
+    (void) address;
+    (void) depth;
+    (void) slot;
+    (void) argument;
+
+    release_leases(scheduler_state.current_thread);
+    return 0;
+}
+
+static size_t address_space_lease(size_t address, size_t depth, struct capability *slot, size_t argument) {
+    (void) address;
+    (void) depth;
+    (void) slot;
+
+    const struct lease_args *args = (struct lease_args *) argument;
+    struct thread_capability *thread = scheduler_state.current_thread;
+
+    if (args->count > MAX_LEASES) {
+        return ETOOMANYLEASES;
+    }
+
+    // new leases are always added to the end of the thread's list, so if something can't be leased the ones made here can be undone by unlocking everything
+    // past where the list ended beforehand
+    uint8_t previous_leases = thread->num_leases;
+    size_t result = 0;
+
+    for (size_t i = 0; i < args->count; i ++) {
+        struct look_up_result look_up_result;
+
+        if (!look_up_capability_relative(args->addresses[i], args->depth, &look_up_result)) {
+            result = ENOCAPABILITY;
+            break;
         }
 
-        result.slot = &thread->root_capability;
-    } else if (!look_up_capability_absolute(address, &result)) {
-        printk("update_capability_resource: couldn't locate capability at 0x%x:0x%" PRIxPTR " (%" PRIdPTR " bits)\n", address->thread_id, address->address, address->depth);
-        return;
+        if (look_up_result.slot->type != CAP_TYPE_UNTYPED) {
+            printk("address_space_lease: capability at 0x%" PRIxPTR " (%" PRIdPTR " bits) isn't untyped\n", args->addresses[i], args->depth);
+            result = ECAPINVAL;
+        } else {
+            result = lease_resource(thread, look_up_result.slot->resource);
+            args->pointers[i] = look_up_result.slot->resource;
+        }
+
+        unlock_looked_up_capability(&look_up_result);
+
+        if (result != 0) {
+            break;
+        }
+    }
+
+    if (result != 0) {
+        for (uint8_t i = previous_leases; i < thread->num_leases; i ++) {
+            heap_unlock(thread->leases[i]);
+        }
+
+        thread->num_leases = previous_leases;
     }
 
-    if (result.slot->handlers == NULL) {
+    return result;
+}
+
+struct invocation_handlers address_space_handlers = {
+    .num_handlers = 5,
+    .handlers = {address_space_alloc, address_space_stats, address_space_set_watermark, address_space_release_leases, address_space_lease}
+};
+
+/* ==== misc ==== */
+
+void update_capability_resource(struct capability *capability, void *new_resource_address) {
+    if (capability->type == CAP_TYPE_NONE) {
         printk("update_capability_resource: attempted to update resource of invalid capability\n");
-        unlock_looked_up_capability(&result);
         return;
     }
 
-    LIST_ITER_NO_CONTAINER(struct capability, resource_list, result.slot, item) {
+    LIST_ITER_NO_CONTAINER(struct capability, resource_list, capability, item) {
         item->resource = new_resource_address;
     }
 
-    if (result.slot->handlers->on_moved != NULL) {
-        result.slot->handlers->on_moved(result.slot->resource);
+    // the slots in a relocated node are somewhere else now
+    if (capability->type == CAP_TYPE_NODE) {
+        lookup_generation ++;
     }
 
-    unlock_looked_up_capability(&result);
+    const struct invocation_handlers *handlers = capability_handlers[capability->type];
+
+    if (handlers->on_moved != NULL) {
+        handlers->on_moved(capability->resource);
+    }
 }
 
 size_t invoke_capability(size_t address, size_t depth, size_t handler_number, size_t argument) {
@@ -861,11 +1613,11 @@ size_t invoke_capability(size_t address, size_t depth, size_t handler_number, si
         return ENOCAPABILITY;
     }
 
-    struct invocation_handlers *handlers = result.slot->handlers;
+    const struct invocation_handlers *handlers = capability_handlers[result.slot->type];
 
     // TODO: add guard value to invocation numbers so you can't accidentally run a different invocation than was intended
     if (handlers == NULL || handler_number >= handlers->num_handlers) {
-        printk("invoke_capability: invocation %" PRIdPTR " on capability 0x%" PRIxPTR " (%" PRIdPTR " bits, type %s) is invalid\n", handler_number, address, depth, handlers_to_name(handlers));
+        printk("invoke_capability: invocation %" PRIdPTR " on capability 0x%" PRIxPTR " (%" PRIdPTR " bits, type %s) is invalid\n", handler_number, address, depth, type_to_name(result.slot->type));
         unlock_looked_up_capability(&result);
 
         // TODO: see above
@@ -885,3 +1637,29 @@ size_t invoke_capability(size_t address, size_t depth, size_t handler_number, si
 
     return return_value;
 }
+
+size_t invoke_capability_batch(struct invocation *invocations, size_t count, uint8_t flags, size_t *restart_index) {
+    for (size_t i = 0; i < count; i ++) {
+        struct invocation *invocation = &invocations[i];
+        size_t result = invoke_capability(invocation->address, invocation->depth, invocation->handler_number, invocation->argument);
+
+        if (result == INVOCATION_RESTART) {
+            // the results of the invocations before this one have already been stored, so the batch can be picked up again from here
+            *restart_index = i;
+            return INVOCATION_RESTART;
+        }
+
+        invocation->result = result;
+
+        // stop if the invocation blocked this thread, since the rest of the batch would be made on its behalf while it isn't running
+        if (scheduler_state.current_thread != NULL && scheduler_state.current_thread->exec_mode != EXEC_MODE_RUNNING) {
+            return i + 1;
+        }
+
+        if ((flags & BATCH_STOP_ON_ERROR) != 0 && invocation->result != 0) {
+            return i + 1;
+        }
+    }
+
+    return count;
+}
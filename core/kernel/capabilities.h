@@ -7,6 +7,8 @@
 #include "sys/kernel.h"
 #include "linked_list.h"
 
+struct heap;
+
 /// if this flag is set, the resource managed by this capability is allocated on and managed in the heap,
 /// and as such references to it should be properly updated by the heap manager
 #define CAP_FLAG_IS_HEAP_MANAGED 1
@@ -20,6 +22,16 @@
 /// if this flag is set, this capability is the original in a derivation tree
 #define CAP_FLAG_ORIGINAL 8
 
+/// \brief if this flag is set, this capability is the one in its resource list that the heap refers to in order to update the resource's address when it's moved
+///
+/// resource lists are circular, so this takes the place of being at the start of the list
+#define CAP_FLAG_HEAP_REFERENCE 16
+
+/// \brief if this flag is set, this capability is the one in its derivation list that the capability it was derived from refers to with its `derivation` pointer
+///
+/// derivation lists are circular, so this takes the place of being at the start of the list
+#define CAP_FLAG_DERIVATION_HEAD 32
+
 struct absolute_capability_address {
     /// the id of the thread that this capability belongs to
     uint16_t thread_id;
@@ -31,17 +43,34 @@ struct absolute_capability_address {
     size_t depth;
 };
 
+/// slots with this type are empty
+#define CAP_TYPE_NONE 0
+#define CAP_TYPE_NODE 1
+#define CAP_TYPE_UNTYPED 2
+#define CAP_TYPE_ADDRESS_SPACE 3
+#define CAP_TYPE_THREAD 4
+#define CAP_TYPE_ENDPOINT 5
+#define CAP_TYPE_DEBUG 6
+
+/// how many different types of capabilities there are, including `CAP_TYPE_NONE`
+#define CAP_TYPE_COUNT 7
+
+/// \brief a single capability slot
+///
+/// since every slot in every capability node pays for this, it only holds what can't be found elsewhere. the address of a capability is determined by where its slot is,
+/// the heap its resource is in is found with `find_resource_heap`, and its invocation handlers are found from its type in `capability_handlers`.
+/// on the 68000 this is 36 bytes instead of the 72 bytes it used to be, so a chunk of 16 slots takes up 584 bytes instead of 1160
 struct capability {
-    /// the invocation handlers for this capability
-    struct invocation_handlers *handlers;
-    /// the resource that this capability points to
-    void *resource;
+    /// what kind of capability this is, or `CAP_TYPE_NONE` if this slot is empty
+    uint8_t type;
     /// additional flags describing the state of this capability
     uint8_t flags;
-    /// identifier that can be set to differentiate this specific capability from otherwise identical ones
-    size_t badge;
     /// flags that describe the ways in which a thread can access this capability's resources
     access_flags_t access_rights;
+    /// the resource that this capability points to
+    void *resource;
+    /// identifier that can be set to differentiate this specific capability from otherwise identical ones
+    size_t badge;
     /// used to keep track of all the capabilities that depend on this resource,
     /// so that all of their pointers to the resource can be updated when it's moved
     LIST_NO_CONTAINER(struct capability) resource_list;
@@ -52,12 +81,11 @@ struct capability {
     struct capability *derived_from;
     /// points to the start of this capability's derivation list, if applicable
     struct capability *derivation;
-    /// the absolute address of this capability
-    struct absolute_capability_address address;
-    /// if this capability is managed by a heap, this points to the heap that manages it
-    struct heap *heap;
 };
 
+/// the invocation handlers for each type of capability, indexed by type
+extern struct invocation_handlers *capability_handlers[CAP_TYPE_COUNT];
+
 /// updates any references to a recently moved capability slot
 void update_capability_references(struct capability *capability);
 
@@ -67,17 +95,33 @@ void move_capability(struct capability *from, struct capability *to);
 /// deletes a capability, freeing up its resources if there are no more capabilities sharing it
 void delete_capability(struct capability *to_delete);
 
-/// updates the address of a capability's resource, given its address in capability space
-void update_capability_resource(const struct absolute_capability_address *address, void *new_resource_address);
+/// updates the address of a capability's resource, along with that of every other capability in its resource list
+void update_capability_resource(struct capability *capability, void *new_resource_address);
 
-/// recursively updates addresses and thread ids starting at a given capability
-void update_capability_addresses(struct capability *slot, const struct absolute_capability_address *address, uint8_t nesting);
+struct capability_node;
+
+/// \brief checks whether the capability in the given slot can be placed in a slot of the given capability node, or made a thread's root node if `container` is NULL
+///
+/// capabilities other than nodes can be placed anywhere. nodes can't be placed inside of themselves, and can't be placed anywhere they'd end up more than `MAX_NESTED_NODES` levels deep.
+/// if the capability can be placed there, 0 is returned. otherwise, an error code is returned
+size_t check_node_placement(const struct capability *slot, const struct capability_node *container);
+
+/// \brief updates how the nesting of capability nodes is tracked after the capability in the given slot is placed in a slot of the given capability node
+///
+/// if `container` is NULL, the node isn't inside of any node (i.e. it's a thread's root node or it's about to be deleted). this does nothing if the slot doesn't contain a node
+void set_node_container(struct capability *slot, struct capability_node *container);
 
 struct look_up_result {
+    /// the slot that was found. if the chunk this slot is in hasn't been allocated yet, this points to an empty slot that mustn't be written to
     struct capability *slot;
     size_t depth;
+    /// the chunk of the capability node that contains the slot, or NULL if it hasn't been allocated yet
     void *container;
     bool should_unlock;
+    /// the capability node that contains the slot
+    struct capability_node *node;
+    /// the index of the slot in its node
+    size_t index;
 };
 
 /// \brief looks up a capability from its address within the given capability node
@@ -98,16 +142,35 @@ bool look_up_capability_absolute(const struct absolute_capability_address *addre
 // TODO: find a better name for this
 void unlock_looked_up_capability(struct look_up_result *result);
 
-/// populates a capability slot at the given address and search depth with the given heap-managed resource and invocation handlers
-size_t populate_capability_slot(struct heap *heap, size_t address, size_t depth, void *resource, struct invocation_handlers *handlers, uint8_t flags);
+/// \brief makes sure that the slot found by a capability lookup has been allocated, so that a capability can be placed in it
+///
+/// since this may allocate memory, anything that's referred to by pointer across this call and that isn't part of the lookup result must be locked beforehand.
+/// on success, true is returned. on failure, false is returned
+bool allocate_looked_up_slot(struct look_up_result *result);
+
+/// how many entries are in each thread's capability lookup cache
+#define LOOKUP_CACHE_SIZE 4
 
-/// \brief copies a capability to the given empty slot
+/// \brief an entry in a thread's capability lookup cache, which maps an address and depth to the slot it was last found at
 ///
-/// the parameters `address` and `depth` make up the address of the destination capability in capability space
-void copy_capability(struct capability *source, struct capability *dest, size_t address, size_t depth);
+/// entries are only valid as long as their generation matches the current lookup generation, which changes whenever a capability node is moved, deleted or relocated in the heap
+struct lookup_cache_entry {
+    size_t generation;
+    size_t address;
+    size_t depth;
+    /// the chunk of the capability node containing the slot, which is locked for as long as the looked up capability is in use
+    struct node_chunk *container;
+    struct capability *slot;
+};
+
+/// populates a capability slot at the given address and search depth with the given heap-managed resource and capability type
+size_t populate_capability_slot(struct heap *heap, size_t address, size_t depth, void *resource, uint8_t type, uint8_t flags);
+
+/// copies a capability to the given empty slot
+void copy_capability(struct capability *source, struct capability *dest);
 
 /// the maximum number of invocation handlers that a capability can have
-#define MAX_HANDLERS 5
+#define MAX_HANDLERS 7
 
 struct invocation_handlers {
     /// how many invocation handlers in this struct are valid
@@ -120,50 +183,141 @@ struct invocation_handlers {
     ///
     /// this allows for resources to be cleaned up if required and for references to this capability's resource to be removed.
     void (*destructor)(struct capability *slot);
+    /// \brief called before the last capability referring to a resource is deleted by something that can be restarted, if anything has to be deleted along with it
+    ///
+    /// this should delete what the destructor would otherwise delete in one go, until either there's nothing left or `*remaining` capabilities have been deleted,
+    /// and return true once the destructor won't have to delete anything else
+    bool (*empty)(struct capability *slot, size_t *remaining);
 };
 
+/// \brief deletes whatever deleting the given capability would delete along with it, until either there's nothing left or `*remaining` capabilities have been deleted
+///
+/// this only does anything if the capability is the last one referring to its resource. returns true once the capability can be deleted without deleting anything else
+bool empty_capability(struct capability *capability, size_t *remaining);
+
 /// \brief how many capability nodes can be nested in a given thread's capability space
 ///
-/// this limitation exists to help prevent stack overflows when moving a node into a new thread
-/// or when deleting a node
+/// this limitation exists to help prevent stack overflows when deleting a node
 #define MAX_NESTED_NODES 4
 
+/// \brief a capability node
+///
+/// nesting is tracked relative to the node's position in the tree rather than from the root of a capability space, so that moving a node along with everything in it
+/// only has to update the nodes it's moved between and the few nodes above them
 struct capability_node {
     /// \brief the size of this node, stored as the amount of bits that size takes up
     ///
     /// this value can be converted to the number of slots in this capability node by shifting 1 left by it (`1 << slot_bits`)
     uint8_t slot_bits;
-    uint8_t nested_nodes;
-    /// the individual capability slots that this capability node contains
+    /// how many levels of nodes there are starting at this one, including itself
+    uint8_t height;
+    /// \brief how many bits of an address are taken up by this node's guard
+    ///
+    /// when looking up a capability, these bits of the address are skipped over before the bits that select a slot in this node,
+    /// which allows sparse capability spaces to be searched through in fewer levels of nodes
+    uint8_t guard_bits;
+    /// the value that the guard bits of an address must match in order for a lookup to continue through this node
+    size_t guard;
+    /// the node that this node is in a slot of, or NULL if it isn't in one. this is updated whenever the node it's in is moved in the heap
+    struct capability_node *parent;
+    /// how many nodes directly inside this one there are of each height, indexed by height minus 1, which is used to recalculate this node's height when one is removed
+    size_t child_heights[MAX_NESTED_NODES - 1];
+    /// the chunks that the capability slots of this node are split into, each of which is NULL until a capability is placed in one of its slots
+    struct node_chunk *chunks[];
+};
+
+/// \brief how many slots are in each chunk of a capability node, stored as the amount of bits that number takes up
+///
+/// nodes with fewer slots than this only have one chunk, which is the size of the node
+#define NODE_CHUNK_BITS 4
+
+/// \brief a chunk of the slots in a capability node
+///
+/// chunks are allocated separately from their nodes when they're first used, so that large nodes with few capabilities in them don't take up much memory
+struct node_chunk {
+    /// the capability node that this chunk is a part of
+    struct capability_node *node;
+    /// the index of this chunk in its node
+    size_t index;
+    /// the individual capability slots that this chunk contains
     struct capability capabilities[];
 };
 
 /// \brief allocates memory for a capability node and initializes it
 ///
 /// the size of this capability node is determined by slot_bits, where 2 raised to the power of slot_bits is the number of slots in this node.s
-/// if successful, a pointer to the allocated memory is returned
+/// memory for the slots themselves isn't allocated until they're used. the new node has no guard. if successful, a pointer to the allocated memory is returned
 void *alloc_node(struct heap *heap, size_t slot_bits);
 
 /// invocation handlers for capability nodes
 extern struct invocation_handlers node_handlers;
 
-/// gets how deep the tree of nodes is starting from the given capability node
-uint8_t get_nested_nodes_depth(const struct capability *node);
+/// the maximum number of address spaces that can be registered with `register_address_space`
+#define MAX_ADDRESS_SPACES 4
+
+/// \brief registers the heap of an address space, so that `find_resource_heap` can find the resources that are allocated in it
+///
+/// on success, true is returned. if there's no room left for another address space, false is returned
+bool register_address_space(struct heap *heap);
+
+/// gets the heap of the registered address space that the given resource was allocated in, or NULL if it isn't in any of them
+struct heap *find_resource_heap(void *resource);
+
+/// \brief sends any watermark notifications that are waiting to be sent by the heaps of the registered address spaces
+///
+/// this is called on the way out of every system call, once nothing in the kernel is partway through using a heap
+void deliver_watermark_notifications(void);
 
 struct address_space_capability {
     struct heap *heap_pointer; // pointer to a statically allocated heap object
+    /// \brief the endpoint that's sent a message when the heap drops below its watermark, or NULL if no watermark is set
+    ///
+    /// this is a copy of the endpoint capability that was passed to `address_space_set_watermark`, which is kept locked so that the heap can refer to it
+    struct capability *watermark_endpoint;
     // TODO: support address spaces other than the one belonging to the kernel
 };
 
+/// the size that small untyped objects are rounded up to at minimum
+#define SMALL_UNTYPED_MIN_SIZE 8
+
+/// untyped objects this size or smaller are rounded up to a power of two, so that they can be allocated from the heap's object caches
+#define SMALL_UNTYPED_MAX_SIZE 64
+
 /// invocation handlers for address space capabilities
 extern struct invocation_handlers address_space_handlers;
 
 /// invocation handlers for untyped capabilities
 extern struct invocation_handlers untyped_handlers;
 
-/// in-kernel equivalent of syscall_invoke()
+struct thread_capability;
+
+/// \brief releases all the leases held by the given thread, unlocking the objects they refer to
+///
+/// this is called whenever a thread calls `endpoint_receive`, so that leases only last for as long as a server is handling a single message
+void release_leases(struct thread_capability *thread);
+
+/// drops the given thread's lease on an object that's about to be freed without unlocking it, returning true if the thread had it leased
+bool drop_lease(struct thread_capability *thread, void *resource);
+
+/// \brief returned by invocation handlers that have done as much work as they're allowed to at once but haven't finished yet
+///
+/// this is never returned to userland. instead, the system call is made again once the thread is next scheduled, so handlers that return this have to be able to pick up where they left off
+#define INVOCATION_RESTART SIZE_MAX
+
+/// how many capabilities can be deleted by one step of an invocation that deletes many of them, before other threads get a chance to run
+#define DELETE_STEP_LIMIT 32
+
+/// \brief in-kernel equivalent of syscall_invoke()
+///
+/// if `INVOCATION_RESTART` is returned, the invocation has to be made again with the same arguments in order to finish it
 size_t invoke_capability(size_t address, size_t depth, size_t handler_number, size_t argument);
 
+/// \brief in-kernel equivalent of syscall_invoke_batch()
+///
+/// if one of the invocations has to be restarted, no more invocations are made and `INVOCATION_RESTART` is returned, with the index of that invocation stored in `restart_index`.
+/// the batch should then be made again starting from that invocation, so that the ones before it aren't made twice
+size_t invoke_capability_batch(struct invocation *invocations, size_t count, uint8_t flags, size_t *restart_index);
+
 /// the value of size_bits for the kernel's root capability node
 #define ROOT_CAP_SLOT_BITS 4
 
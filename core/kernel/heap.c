@@ -7,27 +7,221 @@
 
 #undef DEBUG_HEAP
 
-static bool split_header(struct heap_header *header, size_t at) {
-    // don't bother splitting headers if there isn't enough space to fit a new one
-    if (at >= header->size - sizeof(struct heap_header)) {
-        return false;
-    } else if (at <= sizeof(struct heap_header)) {
+/// gets the size class of a block of the given size, which is the index of the highest bit set in it
+static inline size_t size_class(size_t size) {
+    size_t class = 0;
+
+    while (size > 1) {
+        size >>= 1;
+        class ++;
+    }
+
+    return class;
+}
+
+/// \brief links to the neighboring blocks in an available block's free list or object cache
+///
+/// these are stored directly after the header of an available block instead of in the header itself, since available blocks have no contents
+struct free_list_links {
+    struct heap_header *prev;
+    struct heap_header *next;
+};
+
+/// the size of the smallest block that can exist in the heap, which is just big enough to hold its free list links once it becomes available
+#define MIN_BLOCK_SIZE (sizeof(struct heap_header) + sizeof(struct free_list_links))
+
+/// gets the free list links of an available block
+static inline struct free_list_links *links(struct heap_header *header) {
+    return (struct free_list_links *) ((uint8_t *) header + sizeof(struct heap_header));
+}
+
+/// gets the region of the heap that the given block is in
+static inline const struct heap_region *region_of(const struct heap *heap, const struct heap_header *header) {
+    const struct heap_region *region = &heap->regions[0];
+
+    for (size_t i = 1; i < heap->num_regions && ((void *) header < region->start || (void *) header >= region->end); i ++) {
+        region = &heap->regions[i];
+    }
+
+    return region;
+}
+
+/// gets the header of the block directly after the given one, or NULL if the given block is the last one in its region of the heap
+static inline struct heap_header *next_header(const struct heap *heap, const struct heap_header *header) {
+    struct heap_header *next = (struct heap_header *) ((uint8_t *) header + header->size);
+    return (void *) next >= region_of(heap, header)->end ? NULL : next;
+}
+
+/// sets the `prev` link of the block after the given one (if there is one) to point back to it, after the given block's size has changed
+static inline void relink_next(const struct heap *heap, struct heap_header *header) {
+    struct heap_header *next = next_header(heap, header);
+
+    if (next != NULL) {
+        next->prev = header;
+    }
+}
+
+/// makes sure that the compaction cursor of a heap doesn't point to a block header that's about to stop existing, by pointing it to the block that's taking its place instead
+static inline void replace_cursor(struct heap *heap, const struct heap_header *removed, struct heap_header *replacement) {
+    if (heap->compact_cursor == removed) {
+        heap->compact_cursor = replacement;
+    }
+}
+
+/// gets the size of the block required for an allocation of the given size, including its header
+static inline size_t adjusted_size(size_t actual_size) {
+    // every block has to be big enough to hold free list links once it's freed
+    if (actual_size < sizeof(struct free_list_links)) {
+        actual_size = sizeof(struct free_list_links);
+    }
+
+    return ((actual_size + sizeof(struct heap_header)) + 3) & (size_t) ~3;
+}
+
+/// gets the object cache that holds blocks of the given size, or NULL if there isn't one
+static struct heap_cache *find_cache(struct heap *heap, size_t size) {
+    for (size_t i = 0; i < heap->num_caches; i ++) {
+        if (heap->caches[i].block_size == size) {
+            return &heap->caches[i];
+        }
+    }
+
+    return NULL;
+}
+
+/// adds an available block to the free list for its size class
+static void free_list_insert(struct heap *heap, struct heap_header *header) {
+    size_t class = size_class(header->size);
+    struct heap_header *head = heap->free_lists[class];
+
+    links(header)->prev = NULL;
+    links(header)->next = head;
+
+    if (head != NULL) {
+        links(head)->prev = header;
+    }
+
+    heap->free_lists[class] = header;
+    heap->free_list_bitmap |= (size_t) 1 << class;
+    heap->stats.free_blocks[class] ++;
+}
+
+/// adds an available block to the given object cache without merging it with any blocks around it, so that it can be reused as-is
+static void cache_insert(struct heap *heap, struct heap_cache *cache, struct heap_header *header) {
+    header->flags |= FLAG_CACHED;
+    links(header)->prev = NULL;
+    links(header)->next = cache->blocks;
+
+    if (cache->blocks != NULL) {
+        links(cache->blocks)->prev = header;
+    }
+
+    cache->blocks = header;
+    cache->count ++;
+    heap->stats.cached_blocks ++;
+}
+
+/// removes an available block from the free list for its size class, or from its object cache if it's in one.
+/// this must be called before the size, kind, or location of an available block is changed
+static void free_list_remove(struct heap *heap, struct heap_header *header) {
+    if ((header->flags & FLAG_CACHED) != 0) {
+        struct heap_cache *cache = find_cache(heap, header->size);
+        struct heap_header *prev = links(header)->prev;
+        struct heap_header *next = links(header)->next;
+
+        if (next != NULL) {
+            links(next)->prev = prev;
+        }
+
+        if (prev != NULL) {
+            links(prev)->next = next;
+        } else {
+            cache->blocks = next;
+        }
+
+        cache->count --;
+        heap->stats.cached_blocks --;
+        header->flags &= (uint8_t) ~FLAG_CACHED;
+        return;
+    }
+
+    size_t class = size_class(header->size);
+    struct heap_header *prev = links(header)->prev;
+    struct heap_header *next = links(header)->next;
+
+    if (next != NULL) {
+        links(next)->prev = prev;
+    }
+
+    if (prev != NULL) {
+        links(prev)->next = next;
+    } else {
+        heap->free_lists[class] = next;
+
+        if (next == NULL) {
+            heap->free_list_bitmap &= ~((size_t) 1 << class);
+        }
+    }
+
+    heap->stats.free_blocks[class] --;
+}
+
+/// \brief finds an available block that's at least the given size without having to move anything
+///
+/// the free list for the size class of the allocation is searched first, and if nothing fits there the first block
+/// in the next non-empty size class is used, since it's guaranteed to be big enough.
+/// if no available block is big enough, NULL is returned
+static struct heap_header *free_list_find(struct heap *heap, size_t size) {
+    size_t class = size_class(size);
+
+    for (struct heap_header *header = heap->free_lists[class]; header != NULL; header = links(header)->next) {
+        if (header->size >= size) {
+            return header;
+        }
+    }
+
+    // mask off this size class and all the ones below it
+    size_t bitmap = heap->free_list_bitmap & ~(((size_t) 2 << class) - 1);
+
+    if (bitmap == 0) {
+        return NULL;
+    }
+
+    for (class ++; (bitmap & ((size_t) 1 << class)) == 0; class ++);
+
+    return heap->free_lists[class];
+}
+
+/// \brief splits a block in two at the given offset, if there's enough space to do so
+///
+/// the newly created block is marked as available and added to the free lists.
+/// if the block being split is available, its entry in the free lists is updated to match its new size
+static bool split_header(struct heap *heap, struct heap_header *header, size_t at) {
+    // don't bother splitting headers if either of the resulting blocks would be too small to exist
+    if (at < MIN_BLOCK_SIZE || header->size < MIN_BLOCK_SIZE + at) {
         return false;
     }
 
+    bool is_available = GET_KIND(header) == KIND_AVAILABLE;
+
+    if (is_available) {
+        free_list_remove(heap, header);
+    }
+
     // the header of the newly split block
     struct heap_header *new_header = (struct heap_header *) ((uint8_t *) header + at);
     new_header->size = header->size - at;
     new_header->flags = KIND_AVAILABLE;
-    new_header->next = header->next;
     new_header->prev = header;
+    relink_next(heap, new_header);
+
+    header->size = at;
 
-    if (new_header->next != NULL) {
-        new_header->next->prev = new_header;
+    if (is_available) {
+        free_list_insert(heap, header);
     }
 
-    header->size = at;
-    header->next = new_header;
+    free_list_insert(heap, new_header);
 
     return true;
 }
@@ -44,6 +238,16 @@ void heap_init(struct heap *heap, struct init_block *init_block) {
     heap->total_memory = (size_t) init_block->memory_end - (size_t) init_block->memory_start;
     heap->used_memory = 0;
 
+    for (size_t i = 0; i < sizeof(heap->free_lists) / sizeof(heap->free_lists[0]); i ++) {
+        heap->free_lists[i] = NULL;
+    }
+    heap->free_list_bitmap = 0;
+    heap->num_caches = 0;
+    heap->compact_cursor = NULL;
+    heap->watermark.notify = NULL;
+    heap->watermark.pending = false;
+    memset(&heap->stats, 0, sizeof(struct heap_stats));
+
     void *header_start = init_block->memory_start;
     const void *header_end = (uint8_t *) header_start + sizeof(struct heap_header);
 
@@ -58,9 +262,12 @@ void heap_init(struct heap *heap, struct init_block *init_block) {
     header->flags = KIND_AVAILABLE;
     header->size = (size_t) init_block->memory_end - (size_t) init_block->memory_start;
     header->prev = NULL;
-    header->next = NULL;
 
-    heap->heap_base = header;
+    heap->regions[0].start = header;
+    heap->regions[0].end = init_block->memory_end;
+    heap->regions[0].base = header;
+    heap->num_regions = 1;
+    free_list_insert(heap, header);
 
     heap_lock_existing_region(heap, init_block->kernel_start, init_block->kernel_end);
 
@@ -72,342 +279,944 @@ void heap_init(struct heap *heap, struct init_block *init_block) {
     );
 }
 
+static struct heap_header *merge_available(struct heap *heap, struct heap_header *header);
+
 void heap_add_memory_block(struct heap *heap, void *start, void *end) {
 #ifdef DEBUG_HEAP
     printk("heap: adding memory to heap from 0x%08x - 0x%08x\n", start, end);
 #endif
 
-    (void) heap;
-    (void) start;
-    (void) end;
+    // keep block headers aligned
+    start = (void *) (((size_t) start + 3) & (size_t) ~3);
+    end = (void *) ((size_t) end & (size_t) ~3);
 
-    // TODO: this
+    if (end <= start || (size_t) end - (size_t) start < MIN_BLOCK_SIZE) {
+        printk("heap_add_memory_block: memory block at 0x%08x - 0x%08x is too small to use\n", start, end);
+        return;
+    }
+
+    for (size_t i = 0; i < heap->num_regions; i ++) {
+        if (start < heap->regions[i].end && end > heap->regions[i].start) {
+            printk("heap_add_memory_block: memory block at 0x%08x - 0x%08x overlaps with the heap\n", start, end);
+            return;
+        }
+    }
+
+    struct heap_header *header = (struct heap_header *) start;
+    header->flags = KIND_AVAILABLE;
+    header->size = (size_t) end - (size_t) start;
+    header->prev = NULL;
+
+    for (size_t i = 0; i < heap->num_regions; i ++) {
+        struct heap_region *region = &heap->regions[i];
+
+        if (region->end == start) {
+            // this block directly follows an existing region, so add it to the end of that region
+            struct heap_header *last = region->base;
+            for (struct heap_header *next = last; next != NULL; next = next_header(heap, next)) {
+                last = next;
+            }
+
+            header->prev = last;
+            region->end = end;
+
+            // if this block also directly precedes another region, it bridges the gap between the two so they're joined into one region
+            for (size_t j = 0; j < heap->num_regions; j ++) {
+                struct heap_region *following = &heap->regions[j];
+
+                if (j == i || following->start != end || following->base != following->start) {
+                    continue;
+                }
+
+                following->base->prev = header;
+                region->end = following->end;
+
+                heap->num_regions --;
+                for (size_t k = j; k < heap->num_regions; k ++) {
+                    heap->regions[k] = heap->regions[k + 1];
+                }
+
+                break;
+            }
+        } else if (region->start == end && region->base == region->start) {
+            // this block directly precedes an existing region, so add it to the start of that region
+            region->base->prev = header;
+            region->start = start;
+            region->base = header;
+        } else {
+            continue;
+        }
+
+        heap->total_memory += header->size;
+        merge_available(heap, header);
+        return;
+    }
+
+    if (heap->num_regions >= HEAP_MAX_REGIONS) {
+        printk("heap_add_memory_block: too many regions, memory block at 0x%08x - 0x%08x will not be used\n", start, end);
+        return;
+    }
+
+    struct heap_region *region = &heap->regions[heap->num_regions ++];
+    region->start = start;
+    region->end = end;
+    region->base = header;
+
+    heap->total_memory += header->size;
+    free_list_insert(heap, header);
 }
 
 void heap_lock_existing_region(struct heap *heap, void *start, void *end) {
     printk("heap_lock_existing_region: locking region from 0x%08x - 0x%08x\n", start, end);
 
+    // headers are moved around and removed here in ways that aren't worth keeping track of, so compaction just starts over afterwards
+    heap->compact_cursor = NULL;
+
     start = (uint8_t *) start - sizeof(struct heap_header);
 
-    for (struct heap_header *header = heap->heap_base; header != NULL; header = header->next) {
-        void *block_start = header;
-        const void *block_end = (uint8_t *) block_start + header->size;
+    for (size_t i = 0; i < heap->num_regions; i ++) {
+        struct heap_region *region = &heap->regions[i];
 
-        if (block_end <= start || block_start >= end) {
-            continue;
-        } else if (GET_KIND(header) != KIND_AVAILABLE) {
-            printk("heap_lock_existing_region: header at 0x%x isn't available and intersects with existing region\n", header);
+        if (end <= region->start || start >= region->end) {
             continue;
         }
-        // TODO: should movable overlapping regions be moved? will that ever come up?
 
-        if (start > block_start) {
-            size_t at = (size_t) start - (size_t) block_start;
+        for (struct heap_header *header = region->base; header != NULL; header = next_header(heap, header)) {
+            void *block_start = header;
+            const void *block_end = (uint8_t *) block_start + header->size;
 
-            if (at >= header->size - sizeof(struct heap_header)) {
-                size_t offset = header->size - at;
-                header->size = at;
+            if (block_end <= start || block_start >= end) {
+                continue;
+            } else if (GET_KIND(header) != KIND_AVAILABLE) {
+                printk("heap_lock_existing_region: header at 0x%x isn't available and intersects with existing region\n", header);
+                continue;
+            }
+            // TODO: should movable overlapping regions be moved? will that ever come up?
 
-                struct heap_header *next = header->next;
-                if (next == NULL) {
-                    continue;
-                }
+            if (start > block_start) {
+                size_t at = (size_t) start - (size_t) block_start;
+                struct heap_header *next = next_header(heap, header);
+
+                if (at >= MIN_BLOCK_SIZE && header->size < MIN_BLOCK_SIZE + at && next != NULL && GET_KIND(next) == KIND_AVAILABLE) {
+                    // there isn't enough space to split this block, so give the space at the end of it to the next block instead
+                    size_t offset = header->size - at;
+                    free_list_remove(heap, header);
+                    header->size = at;
+                    free_list_insert(heap, header);
+
+                    free_list_remove(heap, next);
 
-                if (GET_KIND(next) == KIND_AVAILABLE) {
                     struct heap_header tmp = *next;
                     tmp.size += offset;
 
                     next = (struct heap_header *) ((uint8_t *) header + at);
                     *next = tmp;
-                    header->next = next;
+                    relink_next(heap, next);
+
+                    free_list_insert(heap, next);
 
                     continue;
-                } else {
-                    printk("heap_lock_existing_region: header at 0x%x isn't available and intersects with existing region\n", next);
+                } else if (split_header(heap, header, at)) {
+                    continue;
                 }
-
-                continue;
-            } else if (split_header(header, at)) {
-                continue;
             }
-        }
 
-        if (end < block_end) {
-            size_t at = (size_t) end - (size_t) block_start;
+            if (end < block_end) {
+                size_t at = (size_t) end - (size_t) block_start;
 
-            if (at <= sizeof(struct heap_header) && header->prev != NULL) {
-                struct heap_header *prev = header->prev;
+                if (at < MIN_BLOCK_SIZE && header->size >= MIN_BLOCK_SIZE + at && header->prev != NULL) {
+                    struct heap_header *prev = header->prev;
 
-                if (GET_KIND(prev) == KIND_AVAILABLE) {
-                    prev->size -= at;
+                    if (GET_KIND(prev) == KIND_AVAILABLE) {
+                        // move this header up past the end of the region, giving the space it took up to the previous block
+                        free_list_remove(heap, prev);
+                        prev->size += at;
+                        free_list_insert(heap, prev);
 
-                    struct heap_header tmp = *header;
-                    tmp.size += at;
+                        free_list_remove(heap, header);
 
-                    header = (struct heap_header *) ((uint8_t *) header - at);
-                    *header = tmp;
-                    prev->next = header;
+                        struct heap_header tmp = *header;
+                        tmp.size -= at;
 
-                    // try this header again
-                    header = prev;
-                    continue;
+                        header = (struct heap_header *) ((uint8_t *) header + at);
+                        *header = tmp;
+                        relink_next(heap, header);
+
+                        free_list_insert(heap, header);
+
+                        // try this header again
+                        header = prev;
+                        continue;
+                    } else {
+                        printk("heap_lock_existing_region: header at 0x%x isn't available and intersects with existing region\n", prev);
+                    }
                 } else {
-                    printk("heap_lock_existing_region: header at 0x%x isn't available and intersects with existing region\n", prev);
+                    split_header(heap, header, at);
                 }
+            }
+
+            heap->used_memory += header->size;
+            free_list_remove(heap, header);
+
+            if ((uint8_t *) block_start + sizeof(struct heap_header) <= (uint8_t *) start + sizeof(struct heap_header)) {
+                SET_KIND(header, KIND_IMMOVABLE);
+                header->pins = 0;
+                header->update_ref.absolute_ptr = NULL;
+                continue;
+            }
+
+            // this header lives inside of the locked region of memory, it's better for it to just Not Exist.
+            // since the location of each header is determined by the size of the one before it, the space it takes up is given to the block before it
+            struct heap_header *next = next_header(heap, header);
+
+            if (header->prev == NULL) {
+                region->base = next;
             } else {
-                split_header(header, at);
+                header->prev->size += header->size;
+            }
+
+            if (next != NULL) {
+                next->prev = header->prev;
             }
         }
+    }
+}
 
-        heap->used_memory += header->size;
+/// \brief updates any references to the contents of the given block after they've been copied to `dest_ptr`
+///
+/// the block at `dest_ptr` is set up to have its references updated in the same way if it's moved again.
+/// interrupts should be disabled while this is called, since the old copy of the data can't be modified before all the references to it are updated
+static void update_references(const struct heap_header *header, void *dest_ptr) {
+    if ((header->flags & FLAG_CAPABILITY_RESOURCE) != 0) {
+#ifdef DEBUG_HEAP
+        printk(
+            "heap: updating capability resource referred to by slot 0x%x to 0x%x\n",
+            header->update_ref.capability,
+            dest_ptr
+        );
+#endif
+        update_capability_resource(header->update_ref.capability, dest_ptr);
+        heap_set_update_capability(dest_ptr, header->update_ref.capability);
+    } else if ((header->flags & FLAG_UPDATE_FUNCTION) != 0) {
+        header->update_ref.function(dest_ptr);
+        heap_set_update_function(dest_ptr, header->update_ref.function);
+    } else if (header->update_ref.absolute_ptr != NULL) {
+#ifdef DEBUG_HEAP
+        printk("heap: updating absolute pointer at 0x%x to 0x%x\n", header->update_ref.absolute_ptr, dest_ptr);
+#endif
+        *header->update_ref.absolute_ptr = dest_ptr;
+        heap_set_update_absolute(dest_ptr, header->update_ref.absolute_ptr);
+    }
+}
+
+/// gets the size of the largest allocation that can be made in the heap without moving anything
+static size_t find_largest_free_block(const struct heap *heap) {
+    size_t largest = 0;
+
+    // the largest available block is always in the highest non-empty size class
+    if (heap->free_list_bitmap != 0) {
+        size_t class = sizeof(heap->free_lists) / sizeof(heap->free_lists[0]) - 1;
+        for (; (heap->free_list_bitmap & ((size_t) 1 << class)) == 0; class --);
+
+        for (struct heap_header *header = heap->free_lists[class]; header != NULL; header = links(header)->next) {
+            if (header->size - sizeof(struct heap_header) > largest) {
+                largest = header->size - sizeof(struct heap_header);
+            }
+        }
+    }
+
+    return largest;
+}
+
+/// marks the heap's watermark as crossed if the heap has dropped below it or if an allocation has failed, so that `heap_deliver_watermark` notifies whatever set it
+static void check_watermark(struct heap *heap, bool failed) {
+    if (heap->watermark.notify == NULL || heap->watermark.pending) {
+        return;
+    }
+
+    if (
+        !failed
+        && heap->total_memory - heap->used_memory >= heap->watermark.free_memory
+        && (heap->watermark.largest_free_block == 0 || find_largest_free_block(heap) >= heap->watermark.largest_free_block)
+    ) {
+        return;
+    }
+
+#ifdef DEBUG_HEAP
+    printk("heap: dropped below watermark, %d bytes available\n", heap->total_memory - heap->used_memory);
+#endif
+
+    heap->watermark.pending = true;
+}
+
+void *heap_alloc_pinned(struct heap *heap, size_t actual_size) {
+    size_t size = adjusted_size(actual_size);
 
-        if ((uint8_t *) block_start + sizeof(struct heap_header) <= (uint8_t *) start + sizeof(struct heap_header)) {
-            SET_KIND(header, KIND_IMMOVABLE);
-            header->update_ref.absolute_ptr = NULL;
+    // find the highest available block that's big enough, so that this allocation ends up as far away from movable blocks as possible
+    struct heap_header *header = NULL;
+
+    for (size_t class = size_class(size); class < HEAP_SIZE_CLASSES; class ++) {
+        if ((heap->free_list_bitmap & ((size_t) 1 << class)) == 0) {
             continue;
         }
 
-        // this header lives inside of the locked region of memory, it's better for it to just Not Exist
-        if (header->prev == NULL) {
-            heap->heap_base = header->next;
-        } else {
-            header->prev->next = header->next;
+        for (struct heap_header *available = heap->free_lists[class]; available != NULL; available = links(available)->next) {
+            if (available->size >= size && (header == NULL || available > header)) {
+                header = available;
+            }
         }
+    }
+
+    if (header == NULL) {
+        // nothing fits without moving anything around, so this has to go through the normal allocation path
+        return heap_alloc(heap, actual_size);
+    }
+
+#ifdef DEBUG_HEAP
+    printk("heap_alloc_pinned: carving %d bytes from the top of available block at 0x%x (size %d)\n", size, header, header->size);
+#endif
+
+    // carve this allocation out of the top of the block, leaving the rest of it available
+    if (split_header(heap, header, header->size - size)) {
+        header = next_header(heap, header);
+    }
+
+    free_list_remove(heap, header);
+    header->flags = KIND_IMMOVABLE;
+    header->pins = 1;
+    header->update_ref.absolute_ptr = NULL;
+    heap->used_memory += header->size;
+    heap->stats.allocations ++;
+
+    check_watermark(heap, false);
+
+    return (uint8_t *) header + sizeof(struct heap_header);
+}
+
+/// merges an available block that isn't in the free lists with any available blocks around it, then adds the result to the free lists and returns it
+static struct heap_header *merge_available(struct heap *heap, struct heap_header *header) {
+    // check if the block directly after this one is available, and merge them if it is
+    struct heap_header *next = next_header(heap, header);
+    if (next != NULL && GET_KIND(next) == KIND_AVAILABLE) {
+        free_list_remove(heap, next);
+        header->size += next->size;
+        relink_next(heap, header);
+        replace_cursor(heap, next, header);
+    }
 
-        if (header->next != NULL) {
-            header->next->prev = header->prev;
+    // merge with the block directly before if applicable
+    struct heap_header *prev = header->prev;
+    if (prev != NULL && GET_KIND(prev) == KIND_AVAILABLE) {
+        free_list_remove(heap, prev);
+        prev->size += header->size;
+        relink_next(heap, prev);
+        replace_cursor(heap, header, prev);
+
+        header = prev;
+    }
+
+    free_list_insert(heap, header);
+
+    return header;
+}
+
+/// \brief empties all of a heap's object caches, merging the blocks in them with any available blocks around them
+///
+/// if any blocks were removed from the caches, true is returned
+static bool flush_caches(struct heap *heap) {
+    bool flushed = false;
+
+    for (size_t i = 0; i < heap->num_caches; i ++) {
+        struct heap_cache *cache = &heap->caches[i];
+
+        while (cache->blocks != NULL) {
+            struct heap_header *header = cache->blocks;
+            free_list_remove(heap, header);
+            merge_available(heap, header);
+            flushed = true;
         }
     }
+
+    return flushed;
 }
 
-#if defined(DEBUG) && defined(DEBUG_HEAP)
-static size_t nesting = 0;
+/// \brief copies the contents of a block that's being moved to its new location, which may overlap with its old location
+///
+/// everything but the last `HEAP_MOVE_CHUNK_SIZE` bytes is copied in chunks with interrupts enabled, then interrupts are disabled to copy the rest.
+/// interrupts are left disabled so that references to the block can be updated before anything else can see it,
+/// and the returned interrupt status should be restored once that's done
+static interrupt_status_t copy_block(struct heap *heap, void *dest, const void *src, size_t size) {
+    uint8_t *dest_bytes = (uint8_t *) dest;
+    const uint8_t *src_bytes = (const uint8_t *) src;
+    const size_t total_size = size;
+
+    if (dest_bytes <= src_bytes) {
+        // copy from the start forwards, so that nothing in the old location is overwritten before it's been copied
+        while (size > HEAP_MOVE_CHUNK_SIZE) {
+            memmove(dest_bytes, src_bytes, HEAP_MOVE_CHUNK_SIZE);
+            dest_bytes += HEAP_MOVE_CHUNK_SIZE;
+            src_bytes += HEAP_MOVE_CHUNK_SIZE;
+            size -= HEAP_MOVE_CHUNK_SIZE;
+        }
+    } else {
+        // copy from the end backwards, for the same reason
+        while (size > HEAP_MOVE_CHUNK_SIZE) {
+            size -= HEAP_MOVE_CHUNK_SIZE;
+            memmove(dest_bytes + size, src_bytes + size, HEAP_MOVE_CHUNK_SIZE);
+        }
+    }
+
+    interrupt_status_t status = disable_interrupts();
+
+    memmove(dest_bytes, src_bytes, size);
 
-static void print_spaces(void) {
-    for (size_t i = 0; i < nesting; i ++) {
-        printk(" ");
+    heap->stats.relocations ++;
+    heap->stats.bytes_relocated += total_size;
+
+    if (size > heap->stats.largest_critical_copy) {
+        heap->stats.largest_critical_copy = size;
     }
+
+    return status;
 }
-#endif
 
-void *heap_alloc(struct heap *heap, size_t actual_size) {
-    size_t size = ((actual_size + sizeof(struct heap_header)) + 3) & (size_t) ~3;
+/// \brief moves a movable block and its header to the given address, updating any references to it and returning its new header
+///
+/// the new location may overlap with the old one. the links of the moved header aren't updated, so that's up to the caller
+static struct heap_header *move_block(struct heap *heap, struct heap_header *header, void *dest) {
+    // the header is saved since it may be overwritten if the new location overlaps with the old one
+    const struct heap_header old_header = *header;
 
 #ifdef DEBUG_HEAP
-    print_spaces();
-    printk("heap_alloc: size %d (adjusted to %d)\n", actual_size, size);
+    printk("heap: moving block at 0x%x to 0x%x\n", header, dest);
 #endif
 
-    // search for a series of consecutive movable or available blocks big enough to fit the allocation
-    // TODO: optimize this by storing available blocks in an ordered linked list, then traverse that linked list to find a big enough free block (to avoid potentially expensive copies).
-    // that should be paired with occasional heap defrag passes (maybe while system isn't under load?) and allocations that are expected to be locked for their entire runtimes (i.e. program code/data)
-    // should always use the existing algorithm to hopefully reduce fragmentation
+    interrupt_status_t status = copy_block(heap, dest, header, old_header.size);
 
-    struct heap_header *start_header = heap->heap_base;
-    struct heap_header *end_header = heap->heap_base;
-    size_t total_size = start_header->size;
-    size_t to_move = 0;
-    size_t available_memory = heap->total_memory - heap->used_memory;
+    update_references(&old_header, (uint8_t *) dest + sizeof(struct heap_header));
 
-    if (size > available_memory) {
-#ifdef DEBUG_HEAP
-        print_spaces();
-        printk("heap_alloc: allocation size is greater than available memory (0x%x)\n", available_memory);
-#endif
-        return NULL;
+    restore_interrupt_status(status);
+
+    return (struct heap_header *) dest;
+}
+
+/// \brief slides all the movable blocks in a series of consecutive available or movable blocks down to the start of the series
+///
+/// all the available space in the series is collected into a single available block at the end of it, which is returned without being added to the free lists.
+/// blocks are moved one at a time from the lowest address up and their references are updated right away, since updating the references to a block
+/// can involve modifying other blocks in this same series
+static struct heap_header *slide_down(struct heap *heap, struct heap_header *start_header, struct heap_header *end_header) {
+    struct heap_header *prev = start_header->prev;
+    struct heap_header *next = next_header(heap, end_header);
+    uint8_t *series_end = (uint8_t *) end_header + end_header->size;
+    uint8_t *dest = (uint8_t *) start_header;
+
+    // the headers in the series are all moved, except for the first one which always ends up at the same address
+    if ((uint8_t *) heap->compact_cursor > (uint8_t *) start_header && (uint8_t *) heap->compact_cursor < series_end) {
+        heap->compact_cursor = start_header;
+    }
+
+    for (struct heap_header *header = start_header;;) {
+        struct heap_header *following = next_header(heap, header);
+        bool is_end = header == end_header;
+
+        if (GET_KIND(header) == KIND_AVAILABLE) {
+            free_list_remove(heap, header);
+        } else {
+            size_t size = header->size;
+            struct heap_header *moved = (uint8_t *) header == dest ? header : move_block(heap, header, dest);
+
+            moved->prev = prev;
+            prev = moved;
+            dest += size;
+        }
+
+        if (is_end) {
+            break;
+        }
+
+        header = following;
+    }
+
+    struct heap_header *available = (struct heap_header *) dest;
+    available->size = (size_t) series_end - (size_t) dest;
+    available->flags = KIND_AVAILABLE;
+    available->prev = prev;
+
+    if (next != NULL) {
+        next->prev = available;
+    }
+
+    return available;
+}
+
+/// \brief slides all the movable blocks in a series of consecutive available or movable blocks up to the end of the series
+///
+/// this is the same as `slide_down`, except blocks are moved from the highest address down and the available space ends up at the start of the series
+static struct heap_header *slide_up(struct heap *heap, struct heap_header *start_header, struct heap_header *end_header) {
+    struct heap_header *prev = start_header->prev;
+    struct heap_header *next = next_header(heap, end_header);
+    uint8_t *series_start = (uint8_t *) start_header;
+    uint8_t *dest_end = (uint8_t *) end_header + end_header->size;
+
+    if ((uint8_t *) heap->compact_cursor > series_start && (uint8_t *) heap->compact_cursor < dest_end) {
+        heap->compact_cursor = start_header;
+    }
+
+    for (struct heap_header *header = end_header;;) {
+        struct heap_header *preceding = header->prev;
+        bool is_start = header == start_header;
+
+        if (GET_KIND(header) == KIND_AVAILABLE) {
+            free_list_remove(heap, header);
+        } else {
+            dest_end -= header->size;
+            struct heap_header *moved = (uint8_t *) header == dest_end ? header : move_block(heap, header, dest_end);
+
+            if (next != NULL) {
+                next->prev = moved;
+            }
+
+            next = moved;
+        }
+
+        if (is_start) {
+            break;
+        }
+
+        header = preceding;
+    }
+
+    struct heap_header *available = (struct heap_header *) series_start;
+    available->size = (size_t) dest_end - (size_t) series_start;
+    available->flags = KIND_AVAILABLE;
+    available->prev = prev;
+
+    if (next != NULL) {
+        next->prev = available;
+    }
+
+    return available;
+}
+
+/// \brief takes the first part of an available block that isn't in the free lists for an allocation of the given size
+///
+/// the rest of the block is given back to the heap, and a pointer to the allocation is returned
+static void *take_block(struct heap *heap, struct heap_header *header, size_t size) {
+    header->flags = KIND_IMMOVABLE;
+    header->pins = 1;
+    header->update_ref.absolute_ptr = NULL;
+    heap->used_memory += header->size;
+
+    // try to split the newly created header to shave off any excess space
+    if (split_header(heap, header, size)) {
+        struct heap_header *new_header = next_header(heap, header);
+        heap->used_memory -= new_header->size;
+
+        // the excess space may be next to another available block, so it has to be merged
+        free_list_remove(heap, new_header);
+        merge_available(heap, new_header);
     }
 
-    while (1) {
+    return (uint8_t *) header + sizeof(struct heap_header);
+}
+
+/// \brief searches a region of the heap for the series of consecutive available or movable blocks with at least the given amount of available space in it
+/// that requires the least amount of data to be moved
+///
+/// if `can_evict` is true, the movable blocks in the series are going to be moved out of the region entirely instead of being slid out of the way,
+/// so the space they take up counts as available space as well as data to be moved.
+/// if a series is found that requires less data to be moved than `best_to_move`, it's stored in `best_start` and `best_end` and `best_to_move` is updated
+static void find_series(
+    const struct heap *heap,
+    const struct heap_region *region,
+    size_t size,
+    bool can_evict,
+    struct heap_header **best_start,
+    struct heap_header **best_end,
+    size_t *best_to_move
+) {
+    struct heap_header *start_header = region->base;
+    size_t available_size = 0;
+    size_t to_move = 0;
+
+    for (struct heap_header *end_header = region->base; end_header != NULL; end_header = next_header(heap, end_header)) {
         switch (GET_KIND(end_header)) {
         case KIND_AVAILABLE:
-            available_memory -= end_header->size;
+            available_size += end_header->size;
             break;
         case KIND_MOVABLE:
             to_move += end_header->size;
+
+            if (can_evict) {
+                available_size += end_header->size;
+            }
             break;
         case KIND_IMMOVABLE:
-            if (end_header->next == NULL) {
-                return NULL;
-            }
-
             // start the search over from the block following this immovable block
-            start_header = end_header = end_header->next;
-            total_size = start_header->size;
+            start_header = next_header(heap, end_header);
+            available_size = 0;
             to_move = 0;
-            available_memory = heap->total_memory - heap->used_memory;
             continue;
         }
 
-        if (total_size >= size) {
-            // found a potential series of blocks, make sure everything will work out
-            if (to_move <= available_memory) {
-                break;
+        // drop any blocks from the start of the series that aren't needed. movable blocks at the start of the series never have to be slid,
+        // and any other blocks at the start of the series aren't needed if there's enough available space without them
+        while (start_header != end_header) {
+            if (GET_KIND(start_header) == KIND_MOVABLE && !can_evict) {
+                to_move -= start_header->size;
+            } else if (available_size - start_header->size >= size) {
+                available_size -= start_header->size;
+
+                if (GET_KIND(start_header) == KIND_MOVABLE) {
+                    to_move -= start_header->size;
+                }
             } else {
-                // more data needs to be reallocated and moved around than there is available memory, attempt to find a different series of blocks
-                start_header = end_header;
-                total_size = end_header->size;
-                to_move = 0;
-                available_memory = heap->total_memory - heap->used_memory;
-                continue;
+                break;
             }
+
+            start_header = next_header(heap, start_header);
         }
 
-        if (end_header->next == NULL) {
-            return NULL;
+        if (available_size >= size && to_move < *best_to_move) {
+            *best_start = start_header;
+            *best_end = end_header;
+            *best_to_move = to_move;
         }
+    }
+}
+
+/// gets the total size of all the available blocks in a region of the heap
+static size_t region_available(const struct heap *heap, const struct heap_region *region) {
+    size_t available = 0;
 
-        end_header = end_header->next;
-        total_size += end_header->size;
+    for (struct heap_header *header = region->base; header != NULL; header = next_header(heap, header)) {
+        if (GET_KIND(header) == KIND_AVAILABLE) {
+            available += header->size;
+        }
     }
 
+    return available;
+}
+
+/// finds an available block that's at least the given size and isn't in the given region of the heap, or returns NULL if there isn't one
+static struct heap_header *free_list_find_outside(struct heap *heap, size_t size, const struct heap_region *region) {
+    for (size_t class = size_class(size); class < HEAP_SIZE_CLASSES; class ++) {
+        if ((heap->free_list_bitmap & ((size_t) 1 << class)) == 0) {
+            continue;
+        }
+
+        for (struct heap_header *header = heap->free_lists[class]; header != NULL; header = links(header)->next) {
+            if (header->size >= size && region_of(heap, header) != region) {
+                return header;
+            }
+        }
+    }
+
+    return NULL;
+}
+
+/// \brief moves a movable block into an available block somewhere else in the heap that's been removed from the free lists, giving back any space left over at the end of it
+///
+/// the block's old location is given back to the heap, and the available block that it ends up part of is returned
+static struct heap_header *relocate_block(struct heap *heap, struct heap_header *header, struct heap_header *dest) {
+    size_t size = header->size;
+    size_t dest_size = dest->size;
+    struct heap_header *dest_prev = dest->prev;
+
+    struct heap_header *moved = move_block(heap, header, dest);
+    moved->size = dest_size;
+    moved->prev = dest_prev;
+    heap->used_memory += dest_size;
+
+    if (split_header(heap, moved, size)) {
+        struct heap_header *tail = next_header(heap, moved);
+        heap->used_memory -= tail->size;
+
+        free_list_remove(heap, tail);
+        merge_available(heap, tail);
+    }
+
+    header->flags = KIND_AVAILABLE;
+    heap->used_memory -= size;
+
+    return merge_available(heap, header);
+}
+
+/// \brief moves all the movable blocks in a series of consecutive available or movable blocks out of its region, into available blocks in other regions
+///
+/// this leaves all the space in the series available, merged into a single block in the free lists.
+/// if there isn't an available block that some movable block fits in, false is returned, leaving the blocks that have already been moved where they are
+static bool evict_series(struct heap *heap, const struct heap_region *region, struct heap_header *start_header, struct heap_header *end_header) {
+    const uint8_t *series_end = (uint8_t *) end_header + end_header->size;
+
+    for (struct heap_header *header = start_header; header != NULL && (uint8_t *) header < series_end; header = next_header(heap, header)) {
+        if (GET_KIND(header) != KIND_MOVABLE) {
+            continue;
+        }
+
+        struct heap_header *dest = free_list_find_outside(heap, header->size, region);
+
+        if (dest == NULL) {
+            return false;
+        }
+
 #ifdef DEBUG_HEAP
-    print_spaces();
-    printk("heap_alloc: moving 0x%x, 0x%x available\n", to_move, available_memory);
+        printk("heap_alloc: evicting block at 0x%x to 0x%x\n", header, dest);
 #endif
 
-    // split end_header
-    size_t split_pos = size - (total_size - end_header->size);
+        free_list_remove(heap, dest);
 
-    if (split_pos >= end_header->size) {
-        split_pos = 0;
+        // the space this block was in may have been merged with available space before it, so carry on from the end of the merged block
+        header = relocate_block(heap, header, dest);
     }
 
-    // only split the end header if it's unallocated, if the allocation fails that makes it easier to clean up
-    if (GET_KIND(end_header) == KIND_AVAILABLE) {
+    return true;
+}
+
+/// the internals of `heap_alloc`, which don't count towards the heap's allocation statistics so that they can be used by `heap_realloc`
+static void *allocate(struct heap *heap, size_t actual_size) {
+    size_t size = adjusted_size(actual_size);
+
 #ifdef DEBUG_HEAP
-        print_spaces();
-        printk("heap_alloc: splitting end_header at %d\n", split_pos);
+    printk("heap_alloc: size %d (adjusted to %d)\n", actual_size, size);
 #endif
-        split_header(end_header, split_pos);
+
+    size_t available_memory = heap->total_memory - heap->used_memory;
+
+    if (size > available_memory) {
+#ifdef DEBUG_HEAP
+        printk("heap_alloc: allocation size is greater than available memory (0x%x)\n", available_memory);
+#endif
+        return NULL;
     }
 
-    if (to_move > 0) {
-        // mark all the headers that'll be occupied by this allocation as immovable,
-        // and save their old kind values just in case this allocation fails
-        // this is required so that allocated memory for newly moved headers doesn't lie inside the area taken up by the new allocation
-        for (struct heap_header *header = start_header;; header = header->next) {
-            uint8_t kind = GET_KIND(header);
-            SET_OLD_KIND(header, kind);
-            SET_KIND(header, KIND_IMMOVABLE);
+    // fast path: use an available block that's big enough by itself if there is one, since nothing has to be moved for it.
+    // blocks in an object cache for this size are preferred since they're an exact fit, and if nothing fits
+    // the caches are emptied in case merging the blocks in them frees up enough contiguous space
+    struct heap_cache *cache = find_cache(heap, size);
+    struct heap_header *free_header = cache != NULL && cache->blocks != NULL ? cache->blocks : free_list_find(heap, size);
 
-            if (kind == KIND_AVAILABLE) {
-                heap->used_memory += header->size;
-            }
+    if (free_header == NULL && flush_caches(heap)) {
+        free_header = free_list_find(heap, size);
+    }
 
-            if (header == end_header) {
-                break;
+    if (free_header != NULL) {
+#ifdef DEBUG_HEAP
+        printk("heap_alloc: using available block at 0x%x (size %d)\n", free_header, free_header->size);
+#endif
+        free_list_remove(heap, free_header);
+        free_header->flags = KIND_IMMOVABLE;
+        free_header->pins = 1;
+        free_header->update_ref.absolute_ptr = NULL;
+        heap->used_memory += free_header->size;
+
+        if (split_header(heap, free_header, size)) {
+            heap->used_memory -= next_header(heap, free_header)->size;
+        }
+
+        void *pointer = (uint8_t *) free_header + sizeof(struct heap_header);
+
+#ifdef DEBUG_HEAP
+        printk("heap_alloc: returning pointer 0x%x\n", pointer);
+#endif
+
+        return pointer;
+    }
+
+    // slow path: find the series of consecutive available or movable blocks with enough available space in it to fit the allocation
+    // that requires the least amount of data to be moved, then slide the movable blocks in it down to collect that space together
+    struct heap_header *best_start = NULL;
+    struct heap_header *best_end = NULL;
+    size_t best_to_move = SIZE_MAX;
+
+    for (size_t i = 0; i < heap->num_regions; i ++) {
+        find_series(heap, &heap->regions[i], size, false, &best_start, &best_end, &best_to_move);
+    }
+
+    // if the heap is made up of more than one region, it may be cheaper to make room by evicting movable blocks into available space in other regions,
+    // which also works when the space that's available in one region isn't enough on its own. blocks can only be evicted if there's enough space for them elsewhere
+    if (heap->num_regions > 1) {
+        const struct heap_region *evict_region = NULL;
+        struct heap_header *evict_start = NULL;
+        struct heap_header *evict_end = NULL;
+        size_t evict_to_move = best_to_move;
+
+        for (size_t i = 0; i < heap->num_regions; i ++) {
+            const struct heap_region *region = &heap->regions[i];
+            size_t outside = available_memory - region_available(heap, region);
+            size_t limit = outside < evict_to_move ? outside + 1 : evict_to_move;
+            struct heap_header *start = NULL;
+            struct heap_header *end = NULL;
+
+            find_series(heap, region, size, true, &start, &end, &limit);
+
+            if (start != NULL) {
+                evict_region = region;
+                evict_start = start;
+                evict_end = end;
+                evict_to_move = limit;
             }
         }
 
-        for (struct heap_header *header = start_header;; header = header->next) {
-            // skip any headers that don't need to be moved
-            if (GET_OLD_KIND(header) != KIND_MOVABLE) {
-                if (header == end_header) {
-                    break;
-                } else {
-                    continue;
-                }
+        if (evict_region != NULL) {
+#ifdef DEBUG_HEAP
+            printk("heap_alloc: evicting blocks from 0x%x to 0x%x, moving 0x%x\n", evict_start, evict_end, evict_to_move);
+#endif
+
+            if (evict_series(heap, evict_region, evict_start, evict_end)) {
+                struct heap_header *header = free_list_find(heap, size);
+                free_list_remove(heap, header);
+                return take_block(heap, header, size);
             }
 
-            const size_t alloc_size = header->size - sizeof(struct heap_header);
+            // some of the blocks didn't fit anywhere else, so the blocks that were moved have to be taken into account before sliding instead
+            best_start = NULL;
+            best_end = NULL;
+            best_to_move = SIZE_MAX;
+
+            for (size_t i = 0; i < heap->num_regions; i ++) {
+                find_series(heap, &heap->regions[i], size, false, &best_start, &best_end, &best_to_move);
+            }
+        }
+    }
 
-#if defined(DEBUG) && defined(DEBUG_HEAP)
-            nesting ++;
+    if (best_start == NULL) {
+#ifdef DEBUG_HEAP
+        printk("heap_alloc: couldn't find a series of blocks to fit the allocation\n");
 #endif
-            void *dest_ptr = heap_alloc(heap, alloc_size);
-#if defined(DEBUG) && defined(DEBUG_HEAP)
-            nesting --;
+        return NULL;
+    }
+
+#ifdef DEBUG_HEAP
+    printk("heap_alloc: sliding blocks from 0x%x to 0x%x, moving 0x%x\n", best_start, best_end, best_to_move);
 #endif
 
-            if (dest_ptr == NULL) {
-                // allocation failed, revert any headers that haven't been moved to their old kind values
-                for (struct heap_header *header = start_header;; header = header->next) {
-                    uint8_t kind = GET_OLD_KIND(header);
-                    SET_KIND(header, kind);
+    void *pointer = take_block(heap, slide_down(heap, best_start, best_end), size);
 
-                    if (kind == KIND_AVAILABLE) {
-                        heap->used_memory -= header->size;
-                    }
+#ifdef DEBUG_HEAP
+    printk("heap_alloc: returning pointer 0x%x\n", pointer);
+#endif
 
-                    if (header == end_header) {
-                        break;
-                    }
-                }
+    return pointer;
+}
 
-                return NULL;
-            }
+void *heap_alloc(struct heap *heap, size_t actual_size) {
+    void *pointer = allocate(heap, actual_size);
 
-            // interrupts must be disabled since the original data can't be modified after it's copied but before any references to it are updated
-            interrupt_status_t status = disable_interrupts();
+    if (pointer == NULL) {
+        heap->stats.failed_allocations ++;
+    } else {
+        heap->stats.allocations ++;
+    }
+
+    check_watermark(heap, pointer == NULL);
 
-            const void *src_ptr = (uint8_t *) header + sizeof(struct heap_header);
-            //printk("moving 0x%x to 0x%x\n", src_ptr, dest_ptr);
-            memcpy(dest_ptr, src_ptr, alloc_size);
+    return pointer;
+}
 
-            SET_OLD_KIND(header, KIND_AVAILABLE);
+void *heap_realloc(struct heap *heap, void *ptr, size_t actual_size) {
+    if (ptr == NULL) {
+        return heap_alloc(heap, actual_size);
+    }
+
+    struct heap_header *header = (struct heap_header *) ((uint8_t *) ptr - sizeof(struct heap_header));
+    size_t size = adjusted_size(actual_size);
 
-            if ((header->flags & FLAG_CAPABILITY_RESOURCE) != 0) {
 #ifdef DEBUG_HEAP
-                print_spaces();
-                printk(
-                    "heap_alloc: updating capability resource at 0x%x:0x%x (%d bits) to 0x%x\n",
-                    header->update_ref.capability.thread_id,
-                    header->update_ref.capability.address,
-                    header->update_ref.capability.depth,
-                    dest_ptr
-                );
+    printk("heap_realloc: resizing 0x%x from %d to %d (adjusted to %d)\n", ptr, heap_sizeof(ptr), actual_size, size);
 #endif
-                update_capability_resource(&header->update_ref.capability, dest_ptr);
-                heap_set_update_capability(dest_ptr, &header->update_ref.capability);
-            } else if ((header->flags & FLAG_UPDATE_FUNCTION) != 0) {
-                header->update_ref.function(dest_ptr);
-                heap_set_update_function(dest_ptr, header->update_ref.function);
-            } else if (header->update_ref.absolute_ptr != NULL) {
+
+    if (size <= header->size) {
+        // shrink in place by splitting off the end of this block and giving it back to the heap
+        if (split_header(heap, header, size)) {
+            struct heap_header *tail = next_header(heap, header);
+            heap->used_memory -= tail->size;
+
+            free_list_remove(heap, tail);
+            merge_available(heap, tail);
+        }
+
+        return ptr;
+    }
+
+    // search for a series of available or movable blocks directly following this one with enough available space in it to grow into
+    struct heap_header *end_header = header;
+    size_t available_size = 0;
+    size_t to_move = 0;
+    bool can_grow = true;
+
+    while (header->size + available_size < size) {
+        end_header = next_header(heap, end_header);
+
+        if (end_header == NULL || GET_KIND(end_header) == KIND_IMMOVABLE) {
+            can_grow = false;
+            break;
+        } else if (GET_KIND(end_header) == KIND_AVAILABLE) {
+            available_size += end_header->size;
+        } else {
+            to_move += end_header->size;
+        }
+    }
+
+    // moving the blocks in the way costs about as much as copying them, so only do it if that's cheaper than copying this block somewhere else
+    const size_t object_size = header->size - sizeof(struct heap_header);
+
+    if (can_grow && to_move <= object_size) {
 #ifdef DEBUG_HEAP
-                print_spaces();
-                printk("heap_alloc: updating absolute pointer at 0x%x to 0x%x\n", header->update_ref.absolute_ptr, header);
+        printk("heap_realloc: growing in place, moving 0x%x\n", to_move);
 #endif
-                *header->update_ref.absolute_ptr = dest_ptr;
-                heap_set_update_absolute(dest_ptr, header->update_ref.absolute_ptr);
-            }
 
-            heap_unlock(dest_ptr);
+        // slide the blocks in the way up out of the way, then absorb the available space that's left behind
+        struct heap_header *available = slide_up(heap, next_header(heap, header), end_header);
 
-            restore_interrupt_status(status);
+        header->size += available->size;
+        relink_next(heap, header);
+        replace_cursor(heap, available, header);
 
-            if (header == end_header) {
-                break;
-            }
+        heap->used_memory += available->size;
+
+        if (split_header(heap, header, size)) {
+            struct heap_header *tail = next_header(heap, header);
+            heap->used_memory -= tail->size;
+
+            free_list_remove(heap, tail);
+            merge_available(heap, tail);
         }
-    }
 
-    // set up the header and footer of the new allocation
-    start_header->size = ((size_t) end_header + end_header->size) - (size_t) start_header;
-    start_header->flags = KIND_IMMOVABLE;
-    start_header->next = end_header->next;
-    if (start_header->next != NULL) {
-        start_header->next->prev = start_header;
-    }
-    start_header->update_ref.absolute_ptr = NULL;
+        check_watermark(heap, false);
 
-    if (to_move == 0) {
-        heap->used_memory += start_header->size;
+        return ptr;
     }
 
-    // try to split the newly created header to shave off any excess space
-    if (split_header(start_header, size)) {
-        const struct heap_header *new_header = (struct heap_header *) ((uint8_t *) start_header + size);
-        heap->used_memory -= new_header->size;
+    void *new_ptr = allocate(heap, actual_size);
+
+    if (new_ptr == NULL) {
+        heap->stats.failed_allocations ++;
+        check_watermark(heap, true);
+        return NULL;
     }
 
-    void *pointer = (uint8_t *) start_header + sizeof(struct heap_header);
+    // the new block has to stay locked for as long as this one would have
+    ((struct heap_header *) ((uint8_t *) new_ptr - sizeof(struct heap_header)))->pins = header->pins;
 
 #ifdef DEBUG_HEAP
-    print_spaces();
-    printk("heap_alloc: returning pointer 0x%x\n", pointer);
+    printk("heap_realloc: moving 0x%x to 0x%x\n", ptr, new_ptr);
 #endif
 
-    return pointer;
+    interrupt_status_t status = copy_block(heap, new_ptr, ptr, object_size);
+
+    update_references(header, new_ptr);
+
+    restore_interrupt_status(status);
+
+    header->flags = KIND_AVAILABLE;
+    heap->used_memory -= header->size;
+    merge_available(heap, header);
+
+    check_watermark(heap, false);
+
+    return new_ptr;
 }
 
 void heap_free(struct heap *heap, void *ptr) {
@@ -415,67 +1224,141 @@ void heap_free(struct heap *heap, void *ptr) {
 
     header->flags = KIND_AVAILABLE;
     heap->used_memory -= header->size;
+    heap->stats.frees ++;
 
-    // check if the block directly after this one is available, and merge them if it is
-    struct heap_header *next = header->next;
-    if (next != NULL && GET_KIND(next) == KIND_AVAILABLE) {
-        header->size += next->size;
-        next = next->next;
+    // blocks of commonly allocated sizes are kept as-is so that they can be quickly reused
+    struct heap_cache *cache = find_cache(heap, header->size);
 
-        if (next->next != NULL) {
-            next->next->prev = header;
-        }
+    if (cache != NULL && cache->count < HEAP_CACHE_DEPTH) {
+        cache_insert(heap, cache, header);
+    } else {
+        merge_available(heap, header);
     }
+}
 
-    // merge with the block directly before if applicable
-    struct heap_header *prev = header->prev;
-    if (prev != NULL && GET_KIND(prev) == KIND_AVAILABLE) {
-        prev->size += header->size;
-        prev->next = header->next;
+bool heap_add_cache(struct heap *heap, size_t object_size) {
+    size_t size = adjusted_size(object_size);
+
+    if (find_cache(heap, size) != NULL) {
+        return true;
+    } else if (heap->num_caches >= HEAP_MAX_CACHES) {
+        return false;
+    }
+
+    struct heap_cache *cache = &heap->caches[heap->num_caches ++];
+    cache->block_size = size;
+    cache->count = 0;
+    cache->blocks = NULL;
+
+    return true;
+}
+
+void heap_get_stats(struct heap *heap, struct heap_stats *stats) {
+    *stats = heap->stats;
+    stats->total_memory = heap->total_memory;
+    stats->used_memory = heap->used_memory;
+    stats->largest_free_block = find_largest_free_block(heap);
+}
+
+void heap_set_watermark(struct heap *heap, size_t free_memory, size_t largest_free_block, void (*notify)(void *), void *data) {
+    heap->watermark.free_memory = free_memory;
+    heap->watermark.largest_free_block = largest_free_block;
+    heap->watermark.notify = notify;
+    heap->watermark.data = data;
+    heap->watermark.pending = false;
+
+    check_watermark(heap, false);
+}
+
+void heap_deliver_watermark(struct heap *heap) {
+    if (!heap->watermark.pending) {
+        return;
+    }
+
+    // the watermark is cleared first so that it's safe for the notify function to set it again
+    void (*notify)(void *) = heap->watermark.notify;
+    heap->watermark.notify = NULL;
+    heap->watermark.pending = false;
+    notify(heap->watermark.data);
+}
+
+bool heap_compact_step(struct heap *heap) {
+    struct heap_header *cursor = heap->compact_cursor;
+    size_t first_region = cursor != NULL ? (size_t) (region_of(heap, cursor) - heap->regions) : 0;
 
-        if (header->next != NULL) {
-            header->next->prev = prev;
+    // search the heap in address order for an available block that's directly followed by a movable block, starting from where the last step left off.
+    // if that wasn't the start of the heap, the search wraps around to the start of the region it began in, since blocks before it may have been unlocked since.
+    // blocks that compaction would otherwise be able to move that are being held in place by locks are counted along the way
+    size_t passes = cursor != NULL ? heap->num_regions + 1 : heap->num_regions;
+
+    for (size_t i = 0; i < passes; i ++) {
+        const struct heap_region *region = &heap->regions[(first_region + i) % heap->num_regions];
+        struct heap_header *header = i == 0 && cursor != NULL ? cursor : region->base;
+
+        for (; header != NULL && (i < heap->num_regions || header < cursor); header = next_header(heap, header)) {
+            struct heap_header *next = next_header(heap, header);
+
+            if (GET_KIND(header) != KIND_AVAILABLE || next == NULL) {
+                continue;
+            } else if (GET_KIND(next) == KIND_IMMOVABLE && next->pins != 0) {
+                heap->stats.pinned_encounters ++;
+                continue;
+            } else if (GET_KIND(next) != KIND_MOVABLE || next->size > HEAP_COMPACT_MAX_MOVE) {
+                continue;
+            }
+
+#ifdef DEBUG_HEAP
+            printk("heap_compact_step: moving 0x%x down to 0x%x\n", next, header);
+#endif
+
+            // slide the movable block down into the available space, which ends up after it. if the available block is in an object cache,
+            // it's taken out of it by slide_down, but the rest of the blocks in the caches are left alone so that they can still be reused
+            struct heap_header *available = slide_down(heap, header, next);
+            merge_available(heap, available);
+
+            // the block before the available space is the one that was just moved, so it isn't merged into that and its header stays where it is
+            heap->compact_cursor = available;
+
+            return true;
         }
     }
+
+    heap->compact_cursor = NULL;
+    return false;
 }
 
 #ifdef DEBUG
 const char *kind_names[] = {"available", "immovable", "movable"};
 
 void heap_list_blocks(struct heap *heap) {
-    struct heap_header *header = heap->heap_base;
+    for (size_t i = 0; i < heap->num_regions; i ++) {
+        printk("region %d (0x%08x - 0x%08x):\n", i, heap->regions[i].start, heap->regions[i].end);
 
-    while (1) {
-        printk(
-            "0x%08x - 0x%08x (size %d (0x%x)): %s",
-            header,
-            (size_t) header + header->size,
-            header->size,
-            header->size,
-            kind_names[GET_KIND(header)]
-        );
-
-        if (GET_KIND(header) == KIND_AVAILABLE) {
-            printk("\n");
-        } else if ((header->flags & FLAG_CAPABILITY_RESOURCE) != 0) {
+        for (struct heap_header *header = heap->regions[i].base; header != NULL; header = next_header(heap, header)) {
             printk(
-                ", 0x%x:0x%x (%d bits)\n",
-                header->update_ref.capability.thread_id,
-                header->update_ref.capability.address,
-                header->update_ref.capability.depth
+                "0x%08x - 0x%08x (size %d (0x%x)): %s",
+                header,
+                (size_t) header + header->size,
+                header->size,
+                header->size,
+                kind_names[GET_KIND(header)]
             );
-        } else if ((header->flags & FLAG_UPDATE_FUNCTION) != 0) {
-            printk(", function 0x%x\n", header->update_ref.function);
-        } else if (header->update_ref.absolute_ptr != NULL) {
-            printk(", 0x%x\n", header->update_ref.absolute_ptr);
-        } else {
-            printk(", no updates\n");
-        }
 
-        if (header->next != NULL) {
-            header = header->next;
-        } else {
-            break;
+            if (GET_KIND(header) == KIND_IMMOVABLE) {
+                printk(" (%d pins)", header->pins);
+            }
+
+            if (GET_KIND(header) == KIND_AVAILABLE) {
+                printk("\n");
+            } else if ((header->flags & FLAG_CAPABILITY_RESOURCE) != 0) {
+                printk(", capability slot 0x%x\n", header->update_ref.capability);
+            } else if ((header->flags & FLAG_UPDATE_FUNCTION) != 0) {
+                printk(", function 0x%x\n", header->update_ref.function);
+            } else if (header->update_ref.absolute_ptr != NULL) {
+                printk(", 0x%x\n", header->update_ref.absolute_ptr);
+            } else {
+                printk(", no updates\n");
+            }
         }
     }
 }
@@ -3,51 +3,142 @@
 #include <stddef.h>
 #include <stdint.h>
 #include <stdbool.h>
+#include "sys/kernel.h"
+
+/// the maximum number of separate contiguous regions of memory that a heap can be made up of
+#define HEAP_MAX_REGIONS 4
+
+/// the maximum number of object caches that a heap can have
+#define HEAP_MAX_CACHES 8
+
+/// the maximum number of free blocks that can be held in an object cache at once
+#define HEAP_CACHE_DEPTH 16
+
+/// \brief how many bytes of a block are copied at a time with interrupts enabled when it's moved
+///
+/// only the last chunk of a block and the updates to any references to it are done with interrupts disabled,
+/// so this bounds how long moving a block can keep interrupts disabled for. interrupt handlers never lock or modify blocks in the heap,
+/// and system calls can't be made while the kernel is moving a block, so nothing can see a block partway through being copied
+#define HEAP_MOVE_CHUNK_SIZE 256
+
+/// \brief the largest block that `heap_compact_step` will move
+///
+/// each compaction step moves at most one block, so this bounds how long a step can keep the kernel busy for.
+/// larger blocks are left where they are until an allocation needs the space around them
+#define HEAP_COMPACT_MAX_MOVE (8 * HEAP_MOVE_CHUNK_SIZE)
+
+/// \brief a cache of free blocks of a single size, used to speed up allocations of commonly used kernel objects
+///
+/// blocks in an object cache stay in place when freed instead of being merged with the blocks around them,
+/// so that an allocation of the same size can reuse one without having to search for or split a block
+struct heap_cache {
+    /// the size of the blocks in this cache, including their headers
+    size_t block_size;
+    /// how many blocks are in this cache
+    size_t count;
+    /// the first block in this cache's list of free blocks
+    struct heap_header *blocks;
+};
+
+/// \brief a contiguous region of memory that's part of a heap
+///
+/// each region has its own chain of blocks, since the location of each block is determined by the size of the one before it
+struct heap_region {
+    /// the start of this region of memory
+    void *start;
+    /// the address directly after the end of the last block in this region
+    void *end;
+    /// the header of the first block in this region
+    struct heap_header *base;
+};
+
+/// \brief a threshold for how little available memory a heap can have before something is notified about it
+///
+/// this allows for anything that's holding on to memory it doesn't need to give it back before allocations start failing or having to move things around
+struct heap_watermark {
+    /// if the amount of available memory in the heap drops below this many bytes, the watermark is crossed
+    size_t free_memory;
+    /// if the size of the largest allocation that can be made without moving anything drops below this many bytes, the watermark is crossed
+    size_t largest_free_block;
+    /// called once the watermark has been crossed, or NULL if no watermark is set
+    void (*notify)(void *data);
+    /// the argument passed to `notify`
+    void *data;
+    /// whether the watermark has been crossed and `notify` is waiting to be called by `heap_deliver_watermark`
+    bool pending;
+};
 
 struct heap {
-    /// the header at the very start of this heap
-    struct heap_header *heap_base;
+    /// the contiguous regions of memory that make up this heap
+    struct heap_region regions[HEAP_MAX_REGIONS];
+    /// how many of the regions in `regions` are in use
+    size_t num_regions;
     /// how much total memory is contained in this heap, in bytes
     size_t total_memory;
     /// how much memory has been used in this heap, in bytes
     size_t used_memory;
+    /// \brief segregated lists of all the available blocks in this heap, indexed by size class
+    ///
+    /// the size class of a block is the index of the highest set bit in its size,
+    /// so every block in `free_lists[n]` is at least `1 << n` bytes and smaller than `2 << n` bytes
+    struct heap_header *free_lists[HEAP_SIZE_CLASSES];
+    /// bitmap of which entries in `free_lists` are non-empty, used to quickly find a big enough block
+    size_t free_list_bitmap;
+    /// this heap's object caches
+    struct heap_cache caches[HEAP_MAX_CACHES];
+    /// how many of the object caches in `caches` are in use
+    size_t num_caches;
+    /// \brief the block that the next call to `heap_compact_step` starts searching from, or NULL to start from the beginning of the heap
+    ///
+    /// this always points to a valid block header, so whenever the block it points to is merged into another one or moved it's changed to point to a block that still exists
+    struct heap_header *compact_cursor;
+    /// the low watermark for available memory in this heap, set with `heap_set_watermark`
+    struct heap_watermark watermark;
+    /// \brief statistics about how this heap has been used
+    ///
+    /// the counters and free block histogram are kept up to date as the heap is used, and the remaining fields are filled in by `heap_get_stats`
+    struct heap_stats stats;
 };
 
 #include "capabilities.h"
 
-/// the internal header for each memory region in the heap
+/// \brief the internal header for each memory region in the heap
+///
+/// this is kept as small as possible since every allocation pays for it. the next header in the heap is found by adding `size` to the address of this one,
+/// free list links are stored in the contents of available blocks, and capability-backed blocks only refer to the capability slot that owns them,
+/// since that slot already holds the capability's address. on the 68000 this is 14 bytes instead of the 26 bytes it used to be,
+/// so an 8 byte untyped object now takes up a 24 byte block instead of a 36 byte one
 struct heap_header {
     /// the size of the memory block this header is for, including the size of the header
     size_t size;
     /// flags describing what kind of header this is, among other things
     uint8_t flags;
-    /// padding value to ensure contents of memory regions are aligned to 16 bits
-    uint8_t padding;
-    /// the address or handle that should be updated if the region this header controls is moved
+    /// \brief how many times this block has been locked without being unlocked again
+    ///
+    /// the block becomes movable once this drops to zero. immovable blocks that have no pins are regions of memory locked with `heap_lock_existing_region`, which are never unlocked.
+    /// this also keeps the contents of the block aligned to 16 bits
+    uint8_t pins;
+    /// the address, function, or capability that should be updated if the region this header controls is moved
     union {
         void **absolute_ptr;
         void (*function)(void *);
-        struct absolute_capability_address capability;
+        /// the capability slot at the start of the resource list of the capabilities referring to this region
+        struct capability *capability;
     } update_ref;
-
-    /// the next header in the list (TODO: combine this with `size`)
-    struct heap_header *next;
-    /// the previous header in the list
+    /// the previous header in the heap
     struct heap_header *prev;
 };
 
 #define KIND_AVAILABLE 0
 #define KIND_IMMOVABLE 1
 #define KIND_MOVABLE 2
-// old kind goes here (bits 3 and 4, flag values 4 and 8)
 #define FLAG_CAPABILITY_RESOURCE 16
 #define FLAG_UPDATE_FUNCTION 32
+#define FLAG_CACHED 64
 
 #define KIND_MASK 3
 #define GET_KIND(header) (header->flags & (uint8_t) KIND_MASK)
 #define SET_KIND(header, kind) { header->flags = (header->flags & (uint8_t) ~KIND_MASK) | kind; }
-#define GET_OLD_KIND(header) ((header->flags >> 2) & (uint8_t) KIND_MASK)
-#define SET_OLD_KIND(header, kind) { header->flags = (header->flags & (uint8_t) ~(KIND_MASK << 2)) | (kind << 2); }
 
 /// \brief describes part of the system's memory map for heap initialization
 ///
@@ -71,42 +162,127 @@ struct init_block {
 /// and further regions of memory can be added with `heap_add_memory_block`
 void heap_init(struct heap *heap, struct init_block *init_block);
 
-/// adds a contiguous block of usable memory to the heap
+/// \brief adds a contiguous block of usable memory to the heap
+///
+/// if the block is directly next to a region that's already part of the heap, that region is extended to include it.
+/// otherwise it's added as a new region, and the heap can hold up to `HEAP_MAX_REGIONS` separate regions
 void heap_add_memory_block(struct heap *heap, void *start, void *end);
 
+/// \brief adds an object cache for allocations of the given size to the heap
+///
+/// blocks of this size that are freed will be kept aside to quickly satisfy future allocations of the same size.
+/// if there's no room left for another object cache, false is returned
+bool heap_add_cache(struct heap *heap, size_t object_size);
+
 /// locks an existing region of memory in the heap so that it won't be used for allocations
 void heap_lock_existing_region(struct heap *heap, void *start, void *end);
 
-/// allocates a region of memory, returning a pointer to it. the newly allocated region of memory is set as locked (immovable)
+/// allocates a region of memory, returning a pointer to it. the newly allocated region of memory is locked once, as if by `heap_lock`
 void *heap_alloc(struct heap *heap, size_t actual_size);
 
-// TODO: add heap_realloc so things like capability nodes can have their slots allocated on-demand (which will drastically reduce memory usage and increase performance)
-// for best performance, realloc should ideally make a new allocation if the cost of copying any overlapping allocations is greater than the cost of copying the existing data (when allocation is optimized that is)
+/// \brief allocates a region of memory that's expected to stay locked for its entire lifetime, returning a pointer to it
+///
+/// these regions are placed as high up in memory as possible so that they don't split up the space used by movable regions,
+/// which are placed starting from the bottom of memory. the newly allocated region of memory is locked once, as if by `heap_lock`
+void *heap_alloc_pinned(struct heap *heap, size_t actual_size);
+
+/// \brief resizes a locked region of memory, returning a pointer to its new location
+///
+/// the region is shrunk in place, and is grown in place if the blocks after it are available or movable.
+/// if growing in place would require copying more data than is contained in the region, it's moved to a new allocation instead.
+/// if the region is moved, any references to it are updated as if it had been moved by the heap, and it keeps all of its locks.
+/// if the region couldn't be resized, NULL is returned and the original region is left untouched
+void *heap_realloc(struct heap *heap, void *ptr, size_t actual_size);
 
 /// \brief locks an allocated region of memory in place, allowing for any pointers to it to remain valid
 ///
-/// if the returned value is true, this region of memory wasn't locked beforehand.
-/// if the returned value is false, this region of memory was locked
-/// TODO: will any memory regions end up being locked multiple times in practice? is this worth the extra few cycles?
+/// locks are counted, so the region stays locked until `heap_unlock` has been called once for every successful call to this function.
+/// if the returned value is true, the region was locked and must be unlocked later.
+/// if the returned value is false, the region is permanently locked or has been locked too many times at once, and must not be unlocked
 static inline bool heap_lock(void *ptr) {
     struct heap_header *header = (struct heap_header *) ((uint8_t *) ptr - sizeof(struct heap_header));
     if (GET_KIND(header) == KIND_MOVABLE) {
         SET_KIND(header, KIND_IMMOVABLE);
+        header->pins = 1;
         return true;
-    } else {
+    } else if (header->pins == 0 || header->pins == UINT8_MAX) {
         return false;
+    } else {
+        header->pins ++;
+        return true;
     }
 }
 
-/// unlocks an allocated region of memory, invalidating any existing pointers to it and allowing it to be moved anywhere else in memory if required
+/// \brief unlocks an allocated region of memory, undoing one call to `heap_lock`
+///
+/// once every lock on the region has been undone, any existing pointers to it are invalidated and it can be moved anywhere else in memory if required
 static inline void heap_unlock(void *ptr) {
     struct heap_header *header = (struct heap_header *) ((uint8_t *) ptr - sizeof(struct heap_header));
-    SET_KIND(header, KIND_MOVABLE);
+    if (header->pins == 0) {
+        return;
+    }
+
+    header->pins --;
+
+    if (header->pins == 0) {
+        SET_KIND(header, KIND_MOVABLE);
+    }
+}
+
+/// gets how many times an allocated region of memory is currently locked. regions that are permanently locked count as being locked as many times as possible
+static inline uint8_t heap_pins(void *ptr) {
+    struct heap_header *header = (struct heap_header *) ((uint8_t *) ptr - sizeof(struct heap_header));
+    if (GET_KIND(header) == KIND_MOVABLE) {
+        return 0;
+    } else if (header->pins == 0) {
+        return UINT8_MAX;
+    } else {
+        return header->pins;
+    }
+}
+
+/// checks whether the given address is within one of the regions of memory that make up the given heap
+static inline bool heap_contains(const struct heap *heap, const void *ptr) {
+    for (size_t i = 0; i < heap->num_regions; i ++) {
+        if ((const uint8_t *) ptr >= (const uint8_t *) heap->regions[i].start && (const uint8_t *) ptr < (const uint8_t *) heap->regions[i].end) {
+            return true;
+        }
+    }
+
+    return false;
 }
 
 /// frees a region of memory, allowing it to be reused for other things
 void heap_free(struct heap *heap, void *ptr);
 
+/// \brief sets a low watermark for the amount of available memory in the heap, replacing any watermark that was set before
+///
+/// once there's less than `free_memory` bytes available in the heap or the largest allocation that can be made without moving anything
+/// is smaller than `largest_free_block` bytes, or if an allocation fails, the watermark is marked as crossed.
+/// `notify` isn't called from inside the allocation that crossed it, since that could be partway through changing something,
+/// so it's called with `data` as its argument by the next call to `heap_deliver_watermark` instead.
+/// the watermark is then cleared, so that `notify` is only called once until the watermark is set again.
+/// if the heap is already below the watermark, it's marked as crossed right away. passing NULL for `notify` clears the watermark
+void heap_set_watermark(struct heap *heap, size_t free_memory, size_t largest_free_block, void (*notify)(void *), void *data);
+
+/// \brief calls the `notify` function of the heap's watermark if the watermark has been crossed since it was set, then clears it
+///
+/// this should be called once whatever operation was being done on the heap has finished, such as on the way out of a system call
+void heap_deliver_watermark(struct heap *heap);
+
+/// gets statistics about the given heap's usage and fragmentation
+void heap_get_stats(struct heap *heap, struct heap_stats *stats);
+
+/// \brief performs a single step of heap compaction, moving free space towards the end of the heap
+///
+/// the next movable block in the heap that directly follows an available block is moved down into the space taken up by that available block,
+/// and any references to it are updated. only one block is moved per call and blocks bigger than `HEAP_COMPACT_MAX_MOVE` are skipped,
+/// so that this can be done in small steps whenever the system is idle.
+/// each call carries on searching from where the last one left off, wrapping around to the start of the heap once it reaches the end.
+/// blocks in object caches are only taken out of their caches if they're the available block that's being filled in.
+/// if a block was moved, true is returned. if there's nothing left to compact, false is returned
+bool heap_compact_step(struct heap *heap);
+
 /// \brief gets the size of the object at the given address
 ///
 /// if the address doesn't correspond to a valid object allocated on a heap, the returned value is undefined
@@ -143,13 +319,14 @@ static inline void heap_set_update_function(void *ptr, void (*function)(void *))
 
 #include "capabilities.h"
 
-/// sets the address in capability space of the capability that should be updated if the given memory region is moved.
-/// this capability address will replace any absolute addresses, capability addresses, or functions set previously
-static inline void heap_set_update_capability(void *ptr, const struct absolute_capability_address *address) {
+/// sets the capability that should be updated if the given memory region is moved, along with every capability in its resource list.
+/// this must be called again whenever that capability is moved to another slot, or when another capability takes its place at the start of its resource list.
+/// this capability will replace any absolute addresses, capabilities, or functions set previously
+static inline void heap_set_update_capability(void *ptr, struct capability *capability) {
     struct heap_header *header = (struct heap_header *) ((uint8_t *) ptr - sizeof(struct heap_header));
 
     // TODO: this section is probably critical, should interrupts be disabled?
     header->flags &= (uint8_t) ~FLAG_UPDATE_FUNCTION;
     header->flags |= (uint8_t) FLAG_CAPABILITY_RESOURCE;
-    header->update_ref.capability = *address;
+    header->update_ref.capability = capability;
 }
@@ -0,0 +1 @@
+../common/id_alloc.c
\ No newline at end of file
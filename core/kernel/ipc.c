@@ -39,7 +39,7 @@ static void transfer_capabilities(
 
         bool should_copy = (sent_message->to_copy & (1 << i)) > 0;
 
-        if (source_result.slot->handlers == NULL || (should_copy && source_result.slot->handlers == &node_handlers)) {
+        if (source_result.slot->type == CAP_TYPE_NONE || (should_copy && source_result.slot->type == CAP_TYPE_NODE)) {
             printk("transfer_capabilities: capability slot for index %d's source isn't valid\n", i);
             unlock_looked_up_capability(&source_result);
             continue;
@@ -59,20 +59,46 @@ static void transfer_capabilities(
             continue;
         }
 
-        if (dest_result.slot->handlers != NULL) {
+        if (dest_result.slot->type != CAP_TYPE_NONE) {
             printk("transfer_capabilities: capability slot for index %d's destination isn't valid\n", i);
             unlock_looked_up_capability(&source_result);
             unlock_looked_up_capability(&dest_result);
             continue;
         }
 
+        if (check_node_placement(source_result.slot, dest_result.node) != 0) {
+            printk("transfer_capabilities: capability for index %d can't be placed in its destination\n", i);
+            unlock_looked_up_capability(&source_result);
+            unlock_looked_up_capability(&dest_result);
+            continue;
+        }
+
+        // the source slot is locked by its lookup, however the threads have to be locked too in case the destination slot has to be allocated
+        bool should_unlock_sending = heap_lock((void *) sending);
+        bool should_unlock_receiving = heap_lock((void *) receiving);
+        bool is_allocated = allocate_looked_up_slot(&dest_result);
+
+        if (should_unlock_sending) {
+            heap_unlock((void *) sending);
+        }
+
+        if (should_unlock_receiving) {
+            heap_unlock((void *) receiving);
+        }
+
+        if (!is_allocated) {
+            printk("transfer_capabilities: couldn't allocate capability slot for index %d's destination\n", i);
+            unlock_looked_up_capability(&source_result);
+            continue;
+        }
+
         if (should_copy) {
-            copy_capability(source_result.slot, dest_result.slot, dest_address.address, dest_address.depth);
+            copy_capability(source_result.slot, dest_result.slot);
         } else {
             move_capability(source_result.slot, dest_result.slot);
         }
 
-        update_capability_addresses(dest_result.slot, &dest_address, 0);
+        set_node_container(dest_result.slot, dest_result.node);
         recv_buffer->transferred_capabilities |= 1 << i;
 
         unlock_looked_up_capability(&source_result);
@@ -134,7 +160,17 @@ static size_t endpoint_receive(size_t address, size_t depth, struct capability *
     struct ipc_message *message = (struct ipc_message *) argument;
     struct endpoint_capability *endpoint = (struct endpoint_capability *) slot->resource;
 
-    if (LIST_CAN_POP(endpoint->blocked_sending)) {
+    // anything leased while handling the previous message isn't needed anymore
+    release_leases(scheduler_state.current_thread);
+
+    if (endpoint->has_notification) {
+        // notifications from the kernel are received before any messages from other threads
+        endpoint->has_notification = false;
+
+        memset(&message->buffer, 0, IPC_BUFFER_SIZE);
+        message->badge = endpoint->notification_badge;
+        message->transferred_capabilities = 0;
+    } else if (LIST_CAN_POP(endpoint->blocked_sending)) {
         // there's already a thread waiting to send a message
         struct thread_capability *sending;
         LIST_POP_FROM_START(endpoint->blocked_sending, blocked_queue, sending);
@@ -174,6 +210,35 @@ static size_t endpoint_receive(size_t address, size_t depth, struct capability *
     return 0;
 }
 
+void endpoint_notify(struct capability *slot) {
+    struct endpoint_capability *endpoint = (struct endpoint_capability *) slot->resource;
+
+    if (LIST_CAN_POP(endpoint->blocked_receiving)) {
+        struct thread_capability *receiving;
+        LIST_POP_FROM_START(endpoint->blocked_receiving, blocked_queue, receiving);
+
+#ifdef DEBUG_IPC
+        printk("endpoint_notify: unblocking thread 0x%x to receive notification\n", receiving->thread_id);
+#endif
+
+        receiving->flags &= (uint8_t) ~THREAD_BLOCKED_ON_RECEIVE;
+        receiving->blocked_on = NULL;
+
+        memset(&receiving->message_buffer->buffer, 0, IPC_BUFFER_SIZE);
+        receiving->message_buffer->badge = slot->badge;
+        receiving->message_buffer->transferred_capabilities = 0;
+
+        resume_thread(receiving, EXEC_MODE_BLOCKED);
+    } else {
+#ifdef DEBUG_IPC
+        printk("endpoint_notify: no threads are waiting, keeping notification for later\n");
+#endif
+
+        endpoint->has_notification = true;
+        endpoint->notification_badge = slot->badge;
+    }
+}
+
 static void on_endpoint_moved(void *resource) {
     struct endpoint_capability *endpoint = (struct endpoint_capability *) resource;
 
@@ -218,6 +283,7 @@ struct endpoint_capability *alloc_endpoint(struct heap *heap) {
 
     LIST_INIT(endpoint->blocked_sending);
     LIST_INIT(endpoint->blocked_receiving);
+    endpoint->has_notification = false;
 
     return endpoint;
 }
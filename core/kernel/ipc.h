@@ -9,6 +9,10 @@ struct endpoint_capability {
     LIST_CONTAINER(struct thread_capability) blocked_sending;
     /// a queue of threads that are blocked trying to receive from this endpoint
     LIST_CONTAINER(struct thread_capability) blocked_receiving;
+    /// whether a notification sent by the kernel is waiting to be received, since no threads were waiting to receive it when it was sent
+    bool has_notification;
+    /// the badge of the notification that's waiting to be received
+    size_t notification_badge;
 };
 
 /// invocation handlers for endpoints
@@ -16,3 +20,9 @@ extern struct invocation_handlers endpoint_handlers;
 
 /// allocates a new endpoint on the given heap and returns a pointer to it
 struct endpoint_capability *alloc_endpoint(struct heap *heap);
+
+/// \brief sends a message with no contents to the given endpoint from the kernel, without blocking
+///
+/// the message's badge is the badge of the given capability. if no threads are waiting to receive from the endpoint,
+/// the message is kept until one does, replacing any other notification that hasn't been received yet
+void endpoint_notify(struct capability *slot);
@@ -84,107 +84,93 @@ do { \
 #define LIST_ITER(type, container, field, variable) \
 for (type *variable = (container).start; variable != NULL; variable = variable->field.next)
 
-/* ==== linked lists with the container in all the elements ==== */
+/* ==== circular linked lists with no container ==== */
 
+/// \brief a link in a circular linked list with no container
+///
+/// every item in the list is linked to the items before and after it, and the first and last items are linked to each other, so there's no start or end that has to be kept track of.
+/// an item that's the only one in its list has NULL for both of its links instead of linking to itself, so that moving it doesn't leave it linked to where it used to be
 #define LIST_NO_CONTAINER(type) \
 struct { \
-    type *start; \
-    type *end; \
     type *prev; \
     type *next; \
 }
 
-#define LIST_INIT_NO_CONTAINER(container, field) \
+/// initializes an item as the only one in its linked list with no container
+#define LIST_INIT_NO_CONTAINER(item, field) \
 do { \
-    (container)->field.start = (container); \
-    (container)->field.end = (container); \
-    (container)->field.prev = NULL; \
-    (container)->field.next = NULL; \
+    (item)->field.prev = NULL; \
+    (item)->field.next = NULL; \
 } while (0)
 
-/// \brief appends an item to the end of a linked list with no container
-///
-/// this operation is O(n) because it has to update every link in the list, and should therefore be avoided if possible
-#define LIST_APPEND_NO_CONTAINER(type, container, field, item) \
+/// checks whether an item is the only one in its linked list with no container
+#define LIST_IS_ALONE_NO_CONTAINER(item, field) ((item)->field.next == NULL)
+
+/// inserts an item into a linked list with no container directly after the given item that's already in the list
+#define LIST_INSERT_NO_CONTAINER(container, field, item) \
 do { \
-    (container)->field.end->field.next = (item); \
-    (item)->field.prev = (container)->field.end; \
-    (item)->field.next = NULL; \
-    (item)->field.start = (container)->field.start; \
-    LIST_ITER_NO_CONTAINER(type, field, container, link) { \
-        link->field.end = (item); \
+    if ((container)->field.next == NULL) { \
+        /* there's only one item in the list, link the two items to each other */ \
+        (container)->field.prev = (item); \
+        (container)->field.next = (item); \
+        (item)->field.prev = (container); \
+        (item)->field.next = (container); \
+    } else { \
+        (item)->field.prev = (container); \
+        (item)->field.next = (container)->field.next; \
+        (container)->field.next->field.prev = (item); \
+        (container)->field.next = (item); \
     } \
 } while (0)
 
-/// \brief inserts an item to an arbitrary position in a linked list with no container
+/// \brief joins two separate linked lists with no container into one
 ///
-/// if the list contains a single item, the item will be inserted at the end of the list.
-/// if the list contains more than one item, the item will be inserted between the second-to-last and last items in the list
-#define LIST_INSERT_NO_CONTAINER(type, container, field, item) \
-if ((container)->field.start == (container)->field.end) { \
-    /* there's only one item in the list, add to the end */ \
-    (container)->field.end = (item); \
-    (item)->field.start = (container); \
-    (item)->field.end = (item); \
-    (container)->field.next = (item); \
-    (item)->field.prev = (container); \
-    (item)->field.next = NULL; \
-} else { \
-    /* there's more than one item in the list, insert between the end link and the link before that one */ \
-    (item)->field.start = (container)->field.start; \
-    (item)->field.end = (container)->field.end; \
-    type *prev = (container)->field.end->field.prev; \
-    prev->field.next = (item); \
-    (item)->field.prev = (prev); \
-    (item)->field.next = (container)->field.end; \
-}
+/// the items in the list containing `other` are inserted after `item`, in the same order they were in before
+#define LIST_SPLICE_NO_CONTAINER(type, item, field, other) \
+do { \
+    /* items that are alone are linked to themselves so that the two lists can be joined the same way regardless of their lengths */ \
+    if ((item)->field.next == NULL) { \
+        (item)->field.prev = (item); \
+        (item)->field.next = (item); \
+    } \
+    if ((other)->field.next == NULL) { \
+        (other)->field.prev = (other); \
+        (other)->field.next = (other); \
+    } \
+    type *_after = (item)->field.next; \
+    type *_last = (other)->field.prev; \
+    (item)->field.next = (other); \
+    (other)->field.prev = (item); \
+    _last->field.next = _after; \
+    _after->field.prev = _last; \
+} while (0)
 
 /// updates the address of an item in a linked list with no container
-#define LIST_UPDATE_ADDRESS_NO_CONTAINER(type, field, item) \
+#define LIST_UPDATE_ADDRESS_NO_CONTAINER(field, item) \
 do { \
-    if ((item)->field.prev != NULL) { \
-        (item)->field.prev->field.next = (item); \
-    } \
     if ((item)->field.next != NULL) { \
+        (item)->field.prev->field.next = (item); \
         (item)->field.next->field.prev = (item); \
     } \
-    /* these are afterwards so that any references to this link in the list are valid */ \
-    if ((item)->field.prev == NULL) { \
-        for (type *link = (item); link != NULL; link = link->field.next) { \
-            link->field.start = (item); \
-        } \
-    } \
-    if ((item)->field.next == NULL) { \
-        for (type *link = (item); link != NULL; link = link->field.prev) { \
-            link->field.end = (item); \
-        } \
-    } \
 } while (0)
 
-/// iterates over a linked list with no container
+/// \brief iterates over every item in a linked list with no container, starting at the given item
+///
+/// the item after the current one is found after the body of the loop has run, so the current item mustn't be removed from the list while iterating
 #define LIST_ITER_NO_CONTAINER(type, field, item, variable) \
-for (type *variable = (item)->field.start; variable != NULL; variable = variable->field.next)
+for (type *variable = (item), *variable##_first = (item); variable != NULL; variable = variable->field.next == variable##_first ? NULL : variable->field.next)
 
 /// deletes an item from a linked list with no container
-#define LIST_DELETE_NO_CONTAINER(type, field, item) \
-if ((item)->field.prev != NULL && (item)->field.next != NULL) { \
-    /* this link is in the middle of its list, so nothing special needs to happen, just connect the previous and next links */ \
-    (item)->field.prev->field.next = (item)->field.next; \
-    (item)->field.next->field.prev = (item)->field.prev; \
-} else { \
-    /* this is either the start or end of the list, so all the links in the list need to be updated */ \
-    if ((item)->field.prev == NULL && (item)->field.next != NULL) { \
-        type *start = (item)->field.next; \
-        start->field.prev = NULL; \
-        for (type *link = start; link != NULL; link = link->field.next) { \
-            link->field.start = start; \
-        } \
-    } \
-    if ((item)->field.next == NULL && (item)->field.prev != NULL) { \
-        type *end = (item)->field.prev; \
-        end->field.next = NULL; \
-        for (type *link = end; link != NULL; link = link->field.prev) { \
-            link->field.end = end; \
-        } \
+#define LIST_DELETE_NO_CONTAINER(field, item) \
+do { \
+    if ((item)->field.next == (item)->field.prev && (item)->field.next != NULL) { \
+        /* there's only one other item in the list, which is now alone */ \
+        (item)->field.next->field.prev = NULL; \
+        (item)->field.next->field.next = NULL; \
+    } else if ((item)->field.next != NULL) { \
+        (item)->field.prev->field.next = (item)->field.next; \
+        (item)->field.next->field.prev = (item)->field.prev; \
     } \
-}
+    (item)->field.prev = NULL; \
+    (item)->field.next = NULL; \
+} while (0)
@@ -3,6 +3,7 @@
 #include "capabilities.h"
 #include "debug.h"
 #include "heap.h"
+#include "ipc.h"
 #include "scheduler.h"
 #include <stddef.h>
 #include <stdint.h>
@@ -22,7 +23,15 @@ void main_init(struct heap *heap) {
     printk("sizeof(struct heap_header) is %d\n", sizeof(struct heap_header));*/
 
     init_threads();
-    init_scheduler();
+    init_scheduler(heap);
+
+    // set up object caches for the kernel objects that are most frequently created and destroyed
+    heap_add_cache(heap, sizeof(struct thread_capability));
+    heap_add_cache(heap, sizeof(struct endpoint_capability));
+
+    for (size_t size = SMALL_UNTYPED_MIN_SIZE; size <= SMALL_UNTYPED_MAX_SIZE; size <<= 1) {
+        heap_add_cache(heap, size);
+    }
 
     struct thread_registers registers;
 
@@ -39,7 +48,7 @@ void main_init(struct heap *heap) {
     size_t allocation_size = bflt_allocation_size(header);
     printk("allocation size for process server is %d\n", allocation_size);
 
-    void *allocation = heap_alloc(heap, allocation_size);
+    void *allocation = heap_alloc_pinned(heap, allocation_size);
 
     if (allocation == NULL) {
         printk("couldn't allocate memory for process server's data and/or code\n");
@@ -68,7 +77,7 @@ void main_init(struct heap *heap) {
     memset(&thread->root_capability, 0, sizeof(struct capability));
 
     // allocate the root node resource
-    thread->root_capability.handlers = &node_handlers;
+    thread->root_capability.type = CAP_TYPE_NODE;
     thread->root_capability.resource = alloc_node(heap, ROOT_CAP_SLOT_BITS);
 
     if (thread->root_capability.resource == NULL) {
@@ -76,19 +85,15 @@ void main_init(struct heap *heap) {
         return;
     }
 
-    thread->root_capability.flags = CAP_FLAG_IS_HEAP_MANAGED | CAP_FLAG_ORIGINAL;
+    thread->root_capability.flags = CAP_FLAG_IS_HEAP_MANAGED | CAP_FLAG_ORIGINAL | CAP_FLAG_HEAP_REFERENCE;
 
     thread->root_capability.access_rights = UINT8_MAX; // all rights given
 
     LIST_INIT_NO_CONTAINER(&thread->root_capability, resource_list);
 
-    thread->root_capability.heap = heap;
-
-    thread->root_capability.address.thread_id = thread->thread_id;
-    thread->root_capability.address.bucket_number = thread->bucket_number;
     // everything else here assumes NULL is 0
 
-    heap_set_update_capability(thread->root_capability.resource, &thread->root_capability.address);
+    heap_set_update_capability(thread->root_capability.resource, &thread->root_capability);
     heap_unlock(thread->root_capability.resource);
 
     // set the current thread so that capability lookups work properly while the init thread's capability space is being set up
@@ -97,16 +102,20 @@ void main_init(struct heap *heap) {
 
     heap_unlock(thread);
 
+    // capabilities find the heap that their resources were allocated in through the address spaces registered here
+    register_address_space(heap);
+
     struct address_space_capability *address_space_resource = heap_alloc(heap, sizeof(struct address_space_capability));
     address_space_resource->heap_pointer = heap;
-    populate_capability_slot(heap, 0, ROOT_CAP_SLOT_BITS, address_space_resource, &address_space_handlers, CAP_FLAG_IS_HEAP_MANAGED);
+    address_space_resource->watermark_endpoint = NULL;
+    populate_capability_slot(heap, 0, ROOT_CAP_SLOT_BITS, address_space_resource, CAP_TYPE_ADDRESS_SPACE, CAP_FLAG_IS_HEAP_MANAGED);
 
     // add debug capability to thread's root node
-    populate_capability_slot(heap, 1, ROOT_CAP_SLOT_BITS, NULL, &debug_handlers, 0);
+    populate_capability_slot(heap, 1, ROOT_CAP_SLOT_BITS, NULL, CAP_TYPE_DEBUG, 0);
 
     /*struct look_up_result result;
     look_up_capability_relative(2, ROOT_CAP_SLOT_BITS, &result);
-    copy_capability(&scheduler_state.current_thread->root_capability, result.slot, 2, ROOT_CAP_SLOT_BITS);
+    copy_capability(&scheduler_state.current_thread->root_capability, result.slot);
     unlock_looked_up_capability(&result);*/
 
     // reset the current thread to NULL since it's not running yet
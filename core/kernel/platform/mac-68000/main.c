@@ -24,7 +24,7 @@
 
 #define TOOL_DISP_TABLE ((uint32_t *) 0x0c00)
 
-struct heap the_heap = {NULL, 0, 0};
+struct heap the_heap;
 
 extern char _end;
 
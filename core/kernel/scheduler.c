@@ -5,12 +5,13 @@
 #include "debug.h"
 #include "heap.h"
 #include "linked_list.h"
+#include "sys/kernel.h"
 
 #undef DEBUG_SCHEDULER
 
 struct scheduler_state scheduler_state;
 
-void init_scheduler(void) {
+void init_scheduler(struct heap *heap) {
     scheduler_state.current_thread = NULL;
     for (int i = 0; i < NUM_PRIORITIES; i ++) {
         LIST_INIT(scheduler_state.priority_queues[i]);
@@ -18,6 +19,7 @@ void init_scheduler(void) {
     LIST_INIT(scheduler_state.needs_cpu_time_update);
     scheduler_state.timer_hz = 0;
     scheduler_state.ticks_until_cpu_time_update = 0;
+    scheduler_state.heap = heap;
 }
 
 void queue_thread(struct thread_capability *thread) {
@@ -76,6 +78,18 @@ static void idle_thread(void) {
     while (1);
 }
 
+// code that runs when no other process is running but the heap can still be compacted.
+// this repeatedly traps back into the kernel so that compaction is done in small steps, and stops as soon as there's a thread to switch to.
+// compacting in a loop inside the kernel would save the register save/restore done by each trap, but the kernel can't be preempted,
+// so anything that makes a thread runnable in the meantime would have to wait for the loop to check for it. coming back out to user mode
+// after every step means that the kernel is never busy for longer than one step (which `HEAP_COMPACT_MAX_MOVE` bounds), and the cost
+// of a trap is small next to the cost of searching the heap and moving a block
+static void idle_compact_thread(void) {
+    while (1) {
+        syscall_yield();
+    }
+}
+
 void try_context_switch(struct thread_registers *registers) {
     if (!scheduler_state.pending_context_switch) {
         return;
@@ -147,7 +161,12 @@ found_thread:
 #ifdef DEBUG_SCHEDULER
         printk("scheduler: entering idle thread\n");
 #endif
-        // enter the idle thread since there's nothing to do
-        set_program_counter(registers, (size_t) &idle_thread);
+        // since there's nothing to do, use this time to compact the heap a bit so that later allocations are less likely to have to move anything.
+        // the idle thread that's entered afterwards depends on whether there's any compaction left to do
+        if (heap_compact_step(scheduler_state.heap)) {
+            set_program_counter(registers, (size_t) &idle_compact_thread);
+        } else {
+            set_program_counter(registers, (size_t) &idle_thread);
+        }
     }
 }
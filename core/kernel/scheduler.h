@@ -21,12 +21,14 @@ struct scheduler_state {
     uint8_t ticks_until_cpu_time_update;
     /// whether there's a pending context switch
     bool pending_context_switch;
+    /// the heap that should be compacted while there's nothing else to do
+    struct heap *heap;
 };
 
 extern struct scheduler_state scheduler_state;
 
-/// initializes the scheduler
-void init_scheduler(void);
+/// initializes the scheduler, using the given heap for compaction while idle
+void init_scheduler(struct heap *heap);
 
 /// \brief resumes a thread, allowing it to resume execution, if the given execution mode matches its current execution mode
 ///
@@ -5,6 +5,7 @@
 #include "arch.h"
 #include "capabilities.h"
 #include "heap.h"
+#include "id_alloc.h"
 #include "string.h"
 #include "scheduler.h"
 #include "sys/kernel.h"
@@ -18,9 +19,12 @@ static LIST_CONTAINER(struct thread_capability) thread_hash_table[NUM_BUCKETS];
 
 #define MAX_THREADS 1024
 
-#define PTR_BITS (sizeof(size_t) * 8)
-#define USED_THREAD_IDS_SIZE (MAX_THREADS / PTR_BITS)
-static size_t used_thread_ids[USED_THREAD_IDS_SIZE];
+/// the memory that the thread id allocator is kept in, which is big enough for its bitset to hold `MAX_THREADS` ids
+static union {
+    struct id_allocator allocator;
+    size_t words[ID_ALLOCATOR_SIZE(MAX_THREADS, MAX_THREADS) / sizeof(size_t)];
+} used_thread_ids_storage;
+static struct id_allocator *const used_thread_ids = &used_thread_ids_storage.allocator;
 
 // 32-bit fnv-1a hash, as described in http://isthe.com/chongo/tech/comp/fnv/
 static uint32_t hash(uint16_t value) {
@@ -38,10 +42,8 @@ void init_threads(void) {
         LIST_INIT(thread_hash_table[i]);
     }
 
-    for (unsigned int i = 0; i < USED_THREAD_IDS_SIZE; i ++) {
-        used_thread_ids[i] = 0;
-    }
-    used_thread_ids[0] = 1; // id 0 is reserved for kernel resources
+    id_alloc_init(used_thread_ids, MAX_THREADS, MAX_THREADS);
+    id_alloc_mark_used(used_thread_ids, 0); // id 0 is reserved for kernel resources
 }
 
 static size_t read_registers(size_t address, size_t depth, struct capability *slot, size_t argument) {
@@ -135,16 +137,12 @@ static size_t set_root_node(size_t address, size_t depth, struct capability *slo
 
     size_t return_value = ECAPINVAL;
 
-    if (result.slot->handlers == &node_handlers && get_nested_nodes_depth(result.slot) < MAX_NESTED_NODES) {
+    if (result.slot->type == CAP_TYPE_NODE && check_node_placement(result.slot, NULL) == 0) {
         return_value = 0;
 
         struct capability *root_slot = &thread->root_capability;
         move_capability(result.slot, root_slot);
-
-        struct absolute_capability_address new_address = {0, 0, 0, 0};
-        new_address.thread_id = thread->thread_id;
-        new_address.bucket_number = thread->bucket_number;
-        update_capability_addresses(root_slot, &new_address, 0);
+        set_node_container(root_slot, NULL);
     }
 
     unlock_looked_up_capability(&result);
@@ -159,6 +157,9 @@ static size_t set_root_node(size_t address, size_t depth, struct capability *slo
 static void thread_destructor(struct capability *slot) {
     struct thread_capability *thread = (struct thread_capability *) slot->resource;
 
+    // unlock everything this thread has leased before its capabilities are deleted, so that objects it was the last one referring to don't have to have their leases searched for
+    release_leases(thread);
+
     delete_capability(&thread->root_capability);
 
     if (thread->runqueue != NULL) {
@@ -179,7 +180,31 @@ static void thread_destructor(struct capability *slot) {
         }
     }
 
-    used_thread_ids[thread->thread_id / PTR_BITS] &= ~((size_t) 1 << (thread->thread_id % PTR_BITS)); // release thread id
+    id_free(used_thread_ids, thread->thread_id); // release thread id
+}
+
+static bool thread_empty(struct capability *slot, size_t *remaining) {
+    struct thread_capability *thread = (struct thread_capability *) slot->resource;
+
+    if (thread->root_capability.type == CAP_TYPE_NONE || thread == scheduler_state.current_thread) {
+        // a thread deleting the last capability referring to itself can't be stopped while its capabilities are deleted and then pick up where it left off,
+        // so its root node is left for the destructor to empty out in one go
+        return true;
+    }
+
+    // the thread would otherwise be able to run with only some of its capabilities left in between steps, so it's stopped for good
+    // before its root node starts being emptied out
+    suspend_thread(thread, EXEC_MODE_EXITED);
+
+    return empty_capability(&thread->root_capability, remaining);
+}
+
+void drop_leases_on(void *resource) {
+    for (int i = 0; i < NUM_BUCKETS; i ++) {
+        LIST_ITER(struct thread_capability, thread_hash_table[i], table_entry, thread) {
+            drop_lease(thread, resource);
+        }
+    }
 }
 
 void on_thread_moved(void *resource) {
@@ -211,7 +236,7 @@ void on_thread_moved(void *resource) {
         scheduler_state.current_thread = thread;
     }
 
-    if (thread->root_capability.handlers != NULL) {
+    if (thread->root_capability.type != CAP_TYPE_NONE) {
         update_capability_references(&thread->root_capability);
     }
 }
@@ -220,37 +245,24 @@ struct invocation_handlers thread_handlers = {
     .num_handlers = 5,
     .handlers = {read_registers, write_registers, resume, suspend, set_root_node},
     .on_moved = on_thread_moved,
-    .destructor = thread_destructor
+    .destructor = thread_destructor,
+    .empty = thread_empty
 };
 
 struct thread_capability *alloc_thread(struct heap *heap) {
-    uint16_t thread_id = 0;
-    bool has_thread_id = false;
-
     // allocate a new thread id for this thread
-    for (unsigned int i = 0; i < USED_THREAD_IDS_SIZE; i ++) {
-        if (used_thread_ids[i] == SIZE_MAX) {
-            continue;
-        }
-
-        unsigned int bit;
-        for (bit = 0; bit < PTR_BITS && (used_thread_ids[i] & ((size_t) 1 << bit)) != 0; bit ++);
-
-        used_thread_ids[i] |= ((size_t) 1 << bit);
-
-        thread_id = i * PTR_BITS + bit;
-        has_thread_id = true;
-        break;
-    }
+    size_t id = id_alloc(used_thread_ids);
 
     // if a thread id couldn't be found, give up
-    if (!has_thread_id) {
+    if (id == SIZE_MAX) {
 #ifdef DEBUG_THREADS
         printk("alloc_thread: couldn't allocate id for new thread!\n");
 #endif
         return NULL;
     }
 
+    uint16_t thread_id = (uint16_t) id;
+
 #ifdef DEBUG_THREADS
     printk("alloc_thread: allocated id %d for new thread\n", thread_id);
 #endif
@@ -261,7 +273,7 @@ struct thread_capability *alloc_thread(struct heap *heap) {
 #ifdef DEBUG_THREADS
         printk("alloc_thread: heap_alloc for new thread failed!\n");
 #endif
-        used_thread_ids[thread_id / PTR_BITS] &= ~((size_t) 1 << (thread_id % PTR_BITS)); // release thread id
+        id_free(used_thread_ids, thread_id); // release thread id
         return NULL;
     }
 
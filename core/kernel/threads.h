@@ -50,12 +50,21 @@ struct thread_capability {
     struct ipc_message *message_buffer;
     /// if this thread is sending a message, this contains the badge of the endpoint that was used to send it
     size_t sending_badge;
+    /// caches the results of recent capability lookups in this thread's capability space
+    struct lookup_cache_entry lookup_cache[LOOKUP_CACHE_SIZE];
+    /// the untyped objects that this thread has leased with `untyped_lease`
+    void *leases[MAX_LEASES];
+    /// how many entries in `leases` are in use
+    uint8_t num_leases;
 };
 
 extern struct invocation_handlers thread_handlers;
 
 void init_threads(void);
 void on_thread_moved(void *resource);
+
+/// drops every thread's lease on an untyped object that's about to be freed, without unlocking it
+void drop_leases_on(void *resource);
 bool look_up_thread_by_id(uint16_t thread_id, uint8_t bucket_number, struct thread_capability **thread);
 
 #include "heap.h"
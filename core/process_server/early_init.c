@@ -41,27 +41,21 @@ static void start_process(
         .address = ROOT_NODE_ADDRESS,
         .depth = INIT_NODE_DEPTH
     };
-    assert(syscall_invoke(0, SIZE_MAX, ADDRESS_SPACE_ALLOC, (size_t) &root_alloc_args) == 0);
 
-    struct node_copy_args alloc_copy_args = {
+    // the address space and debug capabilities in slots 0 and 1 are copied into the same slots in the new root node
+    struct node_range_args copy_args = {
         .source_address = 0,
         .source_depth = SIZE_MAX,
         .dest_slot = 0,
-        .access_rights = UINT8_MAX,
-        .badge = 0,
-        .should_set_badge = 0
+        .slots = 0b11
     };
-    assert(syscall_invoke(root_alloc_args.address, root_alloc_args.depth, NODE_COPY, (size_t) &alloc_copy_args) == 0);
 
-    struct node_copy_args debug_copy_args = {
-        .source_address = 1,
-        .source_depth = SIZE_MAX,
-        .dest_slot = 1,
-        .access_rights = UINT8_MAX,
-        .badge = 0,
-        .should_set_badge = 0
+    struct invocation invocations[] = {
+        {0, SIZE_MAX, ADDRESS_SPACE_ALLOC, (size_t) &root_alloc_args, 0},
+        {root_alloc_args.address, root_alloc_args.depth, NODE_COPY_RANGE, (size_t) &copy_args, 0}
     };
-    assert(syscall_invoke(root_alloc_args.address, root_alloc_args.depth, NODE_COPY, (size_t) &debug_copy_args) == 0);
+    const size_t num_invocations = sizeof(invocations) / sizeof(invocations[0]);
+    assert(syscall_invoke_batch(invocations, num_invocations, BATCH_STOP_ON_ERROR) == num_invocations && invocations[num_invocations - 1].result == 0);
 
     // callback is called here to run any additional preparation steps before the process is started
     setup_callback(pid, setup_callback_data);
@@ -1,6 +1,7 @@
 #include "bflt.h"
 #include "core_io.h"
 #include "errno.h"
+#include "id_alloc.h"
 #include "jax.h"
 #include "processes.h"
 #include <stddef.h>
@@ -17,20 +18,25 @@
 #define PID_DATA_NODE_SLOT 5
 #define VFS_ENDPOINT_SLOT 8
 
+/// how many pids the set of used pids starts out with room for. it's grown as more pids are allocated until it can fit `PID_MAX` of them
+#define PID_SET_INITIAL_IDS 64
+
 void init_process_table(void) {
     struct alloc_args set_alloc_args = {
         .type = TYPE_UNTYPED,
-        .size = PID_MAX / 8,
+        .size = ID_ALLOCATOR_SIZE(PID_MAX, PID_SET_INITIAL_IDS),
         .address = PID_SET_SLOT,
         .depth = SIZE_MAX
     };
     syscall_invoke(0, SIZE_MAX, ADDRESS_SPACE_ALLOC, (size_t) &set_alloc_args);
 
-    // TODO: use system pointer width for this
-    uint32_t *pointer = (uint32_t *) syscall_invoke(PID_SET_SLOT, SIZE_MAX, UNTYPED_LOCK, 0);
+    struct id_allocator *pid_set = (struct id_allocator *) syscall_invoke(PID_SET_SLOT, SIZE_MAX, UNTYPED_LOCK, 0);
+
+    id_alloc_init(pid_set, PID_MAX, PID_SET_INITIAL_IDS);
 
-    memset(pointer, 0, PID_MAX / 8);
-    *pointer = 3; // pids 0 and 1 are reserved
+    // pids 0 and 1 are reserved
+    id_alloc_mark_used(pid_set, 0);
+    id_alloc_mark_used(pid_set, 1);
 
     syscall_invoke(PID_SET_SLOT, SIZE_MAX, UNTYPED_UNLOCK, 0);
 
@@ -60,39 +66,48 @@ void init_process_table(void) {
 }
 
 pid_t allocate_pid(void) {
-    uint32_t *pointer = (uint32_t *) syscall_invoke(PID_SET_SLOT, SIZE_MAX, UNTYPED_LOCK, 0);
+    struct id_allocator *pid_set = (struct id_allocator *) syscall_invoke(PID_SET_SLOT, SIZE_MAX, UNTYPED_LOCK, 0);
 
-    if (pointer == NULL) {
+    if (pid_set == NULL) {
         return 0;
     }
 
-    pid_t pid = 0;
+    size_t pid = id_alloc(pid_set);
+    size_t capacity = pid_set->capacity;
 
-    for (int i = 0; i < PID_MAX / 32; i ++, pointer ++) {
-        uint32_t value = *pointer; // TODO: should this be a size_t?
+    syscall_invoke(PID_SET_SLOT, SIZE_MAX, UNTYPED_UNLOCK, 0);
 
-        if (value == 0xffffffff) {
-            continue;
-        }
+    if (pid != SIZE_MAX) {
+        return (pid_t) pid;
+    } else if (capacity >= PID_MAX) {
+        return 0;
+    }
 
-        int bit_index;
-        for (bit_index = 0; bit_index < 32 && (value & ((uint32_t) 1 << bit_index)) != 0; bit_index ++);
+    // every pid in the set is in use, so it's grown to make room for more. this has to be done while it's unlocked since it may be moved
+    size_t new_capacity = capacity * 2 < PID_MAX ? capacity * 2 : PID_MAX;
 
-        *pointer |= ((uint32_t) 1 << bit_index);
+    if (syscall_invoke(PID_SET_SLOT, SIZE_MAX, UNTYPED_RESIZE, ID_ALLOCATOR_SIZE(PID_MAX, new_capacity)) != 0) {
+        return 0;
+    }
 
-        pid = i * 32 + bit_index;
-        break;
+    pid_set = (struct id_allocator *) syscall_invoke(PID_SET_SLOT, SIZE_MAX, UNTYPED_LOCK, 0);
+
+    if (pid_set == NULL) {
+        return 0;
     }
 
+    id_alloc_grow(pid_set, new_capacity);
+    pid = id_alloc(pid_set);
+
     syscall_invoke(PID_SET_SLOT, SIZE_MAX, UNTYPED_UNLOCK, 0);
 
-    return pid;
+    return pid != SIZE_MAX ? (pid_t) pid : 0;
 }
 
 void release_pid(pid_t pid) {
-    uint32_t *pointer = (uint32_t *) syscall_invoke(PID_SET_SLOT, SIZE_MAX, UNTYPED_LOCK, 0);
+    struct id_allocator *pid_set = (struct id_allocator *) syscall_invoke(PID_SET_SLOT, SIZE_MAX, UNTYPED_LOCK, 0);
 
-    pointer[pid / 32] &= ~((uint32_t) 1 << (pid % 32));
+    id_free(pid_set, (size_t) pid);
 
     syscall_invoke(PID_SET_SLOT, SIZE_MAX, UNTYPED_UNLOCK, 0);
 }
@@ -127,7 +142,8 @@ size_t exec_from_initrd(
         .type = TYPE_UNTYPED,
         .size = allocation_size,
         .address = (pid << INIT_NODE_DEPTH) | PID_DATA_NODE_SLOT,
-        .depth = SIZE_MAX
+        .depth = SIZE_MAX,
+        .flags = ALLOC_FLAG_PINNED // program code and data stay locked for as long as the process exists
     };
 
     if (syscall_invoke(0, SIZE_MAX, ADDRESS_SPACE_ALLOC, (size_t) &data_alloc_args) != 0) {
@@ -176,12 +192,14 @@ size_t exec_from_initrd(
         .address = &registers,
         .size = sizeof(struct thread_registers)
     };
-    syscall_invoke(thread_alloc_args.address, SIZE_MAX, THREAD_WRITE_REGISTERS, (size_t) &register_write_args);
-
     struct set_root_node_args set_root_node_args = {root_node_address, root_node_depth};
-    syscall_invoke(thread_alloc_args.address, SIZE_MAX, THREAD_SET_ROOT_NODE, (size_t) &set_root_node_args);
 
-    syscall_invoke(thread_alloc_args.address, SIZE_MAX, THREAD_RESUME, 0);
+    struct invocation invocations[] = {
+        {thread_alloc_args.address, SIZE_MAX, THREAD_WRITE_REGISTERS, (size_t) &register_write_args, 0},
+        {thread_alloc_args.address, SIZE_MAX, THREAD_SET_ROOT_NODE, (size_t) &set_root_node_args, 0},
+        {thread_alloc_args.address, SIZE_MAX, THREAD_RESUME, 0, 0}
+    };
+    syscall_invoke_batch(invocations, sizeof(invocations) / sizeof(invocations[0]), 0);
 
     return 0;
 }
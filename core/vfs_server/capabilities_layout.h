@@ -34,6 +34,9 @@
 #define DIRECTORY_BITS 8
 #define MAX_OPEN_DIRECTORIES 256
 
+/// how many ids the id allocators used to allocate structures start out with room for. they're grown as needed until they can fit the maximum number of ids
+#define USED_SLOTS_INITIAL_IDS 64
+
 // should this be defined here?
 #define THREAD_STORAGE_BITS 3 // number of bits required to store IPC_CAPABILITY_SLOTS slots + 1
 #define MAX_WORKER_THREADS 8
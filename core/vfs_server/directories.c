@@ -139,11 +139,16 @@ size_t open_file(const struct state *state, size_t fd_endpoint, struct directory
 
     if (result != 0) {
 idk_just_fucking_return:
-        free_structure(USED_DIRECTORY_IDS_SLOT, DIRECTORY_NODE_SLOT, MAX_OPEN_DIRECTORIES, opened_file_address);
+        free_structure(USED_DIRECTORY_IDS_SLOT, DIRECTORY_NODE_SLOT, opened_file_address);
         return result;
     }
 
-    size_t mount_point_address = find_mount_point(info->namespace_id, stat.st_ino, info->enclosing_filesystem);
+    size_t mount_point_address;
+    result = find_mount_point(info->namespace_id, stat.st_ino, info->enclosing_filesystem, &mount_point_address);
+
+    if (result != 0) {
+        goto idk_just_fucking_return;
+    }
 
     if (mount_point_address != SIZE_MAX) {
         // this directory is a mount point, so it needs to be handled accordingly
@@ -248,6 +253,7 @@ void handle_directory_message(const struct state *state, struct ipc_message *mes
 
             struct ipc_message reply = {.capabilities = {}};
             FD_RETURN_VALUE(reply) = mount(info, FD_MOUNT_FILE_DESCRIPTOR(*message).address, FD_MOUNT_FLAGS(*message));
+            syscall_invoke(directory_id, SIZE_MAX, UNTYPED_UNLOCK, 0);
             syscall_invoke(FD_REPLY_ENDPOINT(*message).address, SIZE_MAX, ENDPOINT_SEND, (size_t) &reply);
         }
         break;
@@ -265,10 +271,11 @@ size_t open_root(const struct state *state, struct ipc_message *message, size_t
 
     // get the namespace object from the namespace id
     size_t namespace_address = (namespace_id << INIT_NODE_DEPTH) | NAMESPACE_NODE_SLOT;
-    struct fs_namespace *namespace = (struct fs_namespace *) syscall_invoke(namespace_address, SIZE_MAX, UNTYPED_LOCK, 0);
+    struct fs_namespace *namespace;
+    size_t result = lease_structures(&namespace_address, (void **) &namespace, 1);
 
-    if (namespace == NULL) {
-        return ENOMEM;
+    if (result != 0) {
+        return result;
     }
 
     // allocate a structure to store the namespace id and root mount point address
@@ -278,11 +285,12 @@ size_t open_root(const struct state *state, struct ipc_message *message, size_t
         return ENOMEM;
     }
 
-    struct directory_info *info = (struct directory_info *) syscall_invoke(info_address, SIZE_MAX, UNTYPED_LOCK, 0);
+    struct directory_info *info;
+    result = lease_structures(&info_address, (void **) &info, 1);
 
-    if (info == NULL) {
-        free_structure(USED_DIRECTORY_IDS_SLOT, DIRECTORY_INFO_SLOT, MAX_OPEN_DIRECTORIES, info_address);
-        return ENOMEM;
+    if (result != 0) {
+        free_structure(USED_DIRECTORY_IDS_SLOT, DIRECTORY_INFO_SLOT, info_address);
+        return result;
     }
 
     info->namespace_id = namespace_id;
@@ -290,17 +298,13 @@ size_t open_root(const struct state *state, struct ipc_message *message, size_t
     info->inode = 0;
     info->mount_point_address = namespace->root_address;
 
-    syscall_invoke(info_address, SIZE_MAX, UNTYPED_UNLOCK, 0);
-
     // badge the vfs endpoint with the address of the directory info structure and send it back to the caller
-    size_t result = badge_and_send(state, IPC_BADGE(info_address, IPC_FLAG_IS_MOUNT_POINT), reply_capability);
+    result = badge_and_send(state, IPC_BADGE(info_address, IPC_FLAG_IS_MOUNT_POINT), reply_capability);
 
     if (result != 0) {
-        free_structure(USED_DIRECTORY_IDS_SLOT, DIRECTORY_INFO_SLOT, MAX_OPEN_DIRECTORIES, info_address);
-        return result;
+        free_structure(USED_DIRECTORY_IDS_SLOT, DIRECTORY_INFO_SLOT, info_address);
     }
 
-    syscall_invoke(namespace_address, SIZE_MAX, UNTYPED_UNLOCK, 0); // lock is held throughout, not sure if this is the right call (a race condition here would be fine tbh) but it is what it is
-
+    // the namespace and directory info are leased, so they stay locked until the next message is received
     return result;
 }
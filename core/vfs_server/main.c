@@ -93,10 +93,9 @@ STATIC_TESTABLE void main_loop(const struct state *state) {
         }
 
         // delete any leftover capabilities that were transferred
-        for (size_t i = 0; i < IPC_CAPABILITY_SLOTS; i ++) {
-            if ((received.transferred_capabilities & (1 << i)) != 0) {
-                syscall_invoke(THREAD_STORAGE_ADDRESS(state->thread_id), THREAD_STORAGE_DEPTH, NODE_DELETE, i);
-            }
+        if (received.transferred_capabilities != 0) {
+            const struct node_delete_range_args delete_args = {0, received.transferred_capabilities};
+            syscall_invoke(THREAD_STORAGE_ADDRESS(state->thread_id), THREAD_STORAGE_DEPTH, NODE_DELETE_RANGE, (size_t) &delete_args);
         }
     }
 }
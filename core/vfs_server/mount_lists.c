@@ -1,5 +1,6 @@
 #include "capabilities_layout.h"
 #include "errno.h"
+#include "id_alloc.h"
 #include "mount_lists.h"
 #include "structures.h"
 #include <stdint.h>
@@ -16,7 +17,7 @@ size_t create_mounted_list_entry() {
     struct mounted_list_info *info = (struct mounted_list_info *) syscall_invoke(info_address, SIZE_MAX, UNTYPED_LOCK, 0);
 
     if (info == NULL) {
-        free_structure(USED_MOUNTED_LISTS_SLOT, MOUNTED_LIST_INFO_SLOT, MAX_MOUNTED_FS, info_address);
+        free_structure(USED_MOUNTED_LISTS_SLOT, MOUNTED_LIST_INFO_SLOT, info_address);
         return SIZE_MAX;
     }
 
@@ -36,7 +37,7 @@ size_t create_mounted_list_entry() {
     };
 
     if (syscall_invoke(0, SIZE_MAX, ADDRESS_SPACE_ALLOC, (size_t) &alloc_args) != 0) {
-        free_structure(USED_MOUNTED_LISTS_SLOT, MOUNTED_LIST_INFO_SLOT, MAX_MOUNTED_FS, info_address);
+        free_structure(USED_MOUNTED_LISTS_SLOT, MOUNTED_LIST_INFO_SLOT, info_address);
         return SIZE_MAX;
     }
 
@@ -65,8 +66,7 @@ size_t mounted_list_insert(size_t index, size_t directory_fd, uint8_t mount_flag
             next_index = SIZE_MAX; // this is set to automatically break out of the loop since there's room in this node
             result = 0;
 
-            unsigned int slot_index;
-            for (slot_index = 0; slot_index < sizeof(size_t) * 8 && (info->used_slots & ((size_t) 1 << slot_index)) != 0; slot_index ++);
+            unsigned int slot_index = id_lowest_clear_bit(info->used_slots);
 
             const struct node_move_args move_args = {
                 .source_address = directory_fd,
@@ -24,7 +24,7 @@ static size_t alloc_namespace(void) {
     struct fs_namespace *namespace = (struct fs_namespace *) syscall_invoke(address, SIZE_MAX, UNTYPED_LOCK, 0);
 
     if (namespace == NULL) {
-        free_structure(USED_NAMESPACES_SLOT, NAMESPACE_NODE_SLOT, MAX_NAMESPACES, address);
+        free_structure(USED_NAMESPACES_SLOT, NAMESPACE_NODE_SLOT, address);
         return SIZE_MAX;
     }
 
@@ -61,7 +61,7 @@ static void free_namespace(size_t namespace_id) {
     syscall_invoke(address, SIZE_MAX, UNTYPED_UNLOCK, 0);
 
     if (should_free) {
-        free_structure(USED_NAMESPACES_SLOT, NAMESPACE_NODE_SLOT, MAX_NAMESPACES, address);
+        free_structure(USED_NAMESPACES_SLOT, NAMESPACE_NODE_SLOT, address);
     }
 }
 
@@ -190,85 +190,91 @@ size_t add_mount_point_to_namespace(struct fs_namespace *namespace, struct mount
         return ENOMEM;
     }
 
-    struct mount_point *new_mount_point = (struct mount_point *) syscall_invoke(mount_point_address, SIZE_MAX, UNTYPED_LOCK, 0);
+    // TODO: should the hash value take something else into account as well (maybe the containing filesystem?) in order to reduce
+    // collisions between, for example, sequentially assigned inodes in multiple basic filesystem implementations?
+    // or should that be left up to the filesystem drivers themselves
+    uint8_t bucket = hash(mount_point->inode) % NUM_BUCKETS;
+    size_t *bucket_value = &namespace->mount_point_addresses[bucket];
+    bool is_root = namespace->root_address == SIZE_MAX;
+    bool is_chained = !is_root && *bucket_value != SIZE_MAX;
 
-    if (new_mount_point == NULL) {
-        free_structure(USED_MOUNT_POINT_IDS_SLOT, MOUNT_POINTS_NODE_SLOT, MAX_MOUNT_POINTS, mount_point_address);
-        return ENOMEM;
+    // mount points are leased rather than locked here, since they're only needed until the next message is received.
+    // if the new mount point is going at the start of a hash chain, the mount point that's currently there is leased along with it
+    const size_t addresses[2] = {mount_point_address, *bucket_value};
+    struct mount_point *mount_points[2];
+    size_t result = lease_structures(addresses, (void **) mount_points, is_chained ? 2 : 1);
+
+    if (result != 0) {
+        free_structure(USED_MOUNT_POINT_IDS_SLOT, MOUNT_POINTS_NODE_SLOT, mount_point_address);
+        return result;
     }
 
+    struct mount_point *new_mount_point = mount_points[0];
     memcpy(new_mount_point, mount_point, sizeof(struct mount_point));
 
-    if (namespace->root_address == SIZE_MAX) {
+    if (is_root) {
         // if the root address of this namespace hasn't been set yet, there's no way for this mount call to be mounting anything but the root filesystem.
         // any existing file descriptors for the previously unset root directory will be automatically updated to the new value when operations are performed on them
         namespace->root_address = mount_point_address;
     } else {
-        // TODO: should the hash value take something else into account as well (maybe the containing filesystem?) in order to reduce
-        // collisions between, for example, sequentially assigned inodes in multiple basic filesystem implementations?
-        // or should that be left up to the filesystem drivers themselves
-        uint8_t bucket = hash(new_mount_point->inode) % NUM_BUCKETS;
-        size_t *bucket_value = &namespace->mount_point_addresses[bucket];
-
-        if (*bucket_value == SIZE_MAX) {
-            *bucket_value = mount_point_address;
-        } else {
-            struct mount_point *other_mount_point = (struct mount_point *) syscall_invoke(*bucket_value, SIZE_MAX, UNTYPED_LOCK, 0);
-
-            if (other_mount_point == NULL) {
-                free_structure(USED_MOUNT_POINT_IDS_SLOT, MOUNT_POINTS_NODE_SLOT, MAX_MOUNT_POINTS, mount_point_address);
-                return ENOMEM;
-            }
-
-            other_mount_point->previous = mount_point_address;
-
-            syscall_invoke(*bucket_value, SIZE_MAX, UNTYPED_UNLOCK, 0); // TODO: is unlocking it here ok? could this cause problems?
-
+        if (is_chained) {
+            mount_points[1]->previous = mount_point_address;
             new_mount_point->next = *bucket_value;
-            *bucket_value = mount_point_address;
         }
-    }
 
-    syscall_invoke(mount_point_address, SIZE_MAX, UNTYPED_UNLOCK, 0);
+        *bucket_value = mount_point_address;
+    }
 
     return 0;
 }
 
-size_t find_mount_point(size_t namespace_id, ino_t inode, size_t enclosing_filesystem) {
+size_t find_mount_point(size_t namespace_id, ino_t inode, size_t enclosing_filesystem, size_t *mount_point_address) {
+    *mount_point_address = SIZE_MAX;
+
+    // the namespace and the mount points in its hash chain are leased, so that checking each of them only takes one system call
     size_t namespace_address = (namespace_id << INIT_NODE_DEPTH) | NAMESPACE_NODE_SLOT;
-    struct fs_namespace *namespace = (struct fs_namespace *) syscall_invoke(namespace_address, SIZE_MAX, UNTYPED_LOCK, 0);
+    struct fs_namespace *namespace;
+    size_t result = lease_structures(&namespace_address, (void **) &namespace, 1);
 
-    if (namespace == NULL) {
-        return SIZE_MAX;
+    if (result != 0) {
+        return result;
     }
 
     uint8_t bucket = hash(inode) % NUM_BUCKETS;
-    size_t *bucket_value = &namespace->mount_point_addresses[bucket];
 
-    if (*bucket_value == SIZE_MAX) {
-        syscall_invoke(namespace_address, SIZE_MAX, UNTYPED_UNLOCK, 0);
-        return SIZE_MAX;
-    }
+    for (size_t address = namespace->mount_point_addresses[bucket]; address != SIZE_MAX;) {
+        struct mount_point *mount_point;
+        bool is_locked = false;
+
+        result = lease_structures(&address, (void **) &mount_point, 1);
 
-    for (size_t address = *bucket_value; address != SIZE_MAX;) {
-        struct mount_point *mount_point = (struct mount_point *) syscall_invoke(address, SIZE_MAX, UNTYPED_LOCK, 0);
+        if (result == ETOOMANYLEASES) {
+            // this thread can't lease anything else until the next message is received, so the rest of the chain has to be locked and unlocked instead
+            mount_point = (struct mount_point *) syscall_invoke(address, SIZE_MAX, UNTYPED_LOCK, 0);
 
-        if (mount_point == NULL) {
-            syscall_invoke(namespace_address, SIZE_MAX, UNTYPED_UNLOCK, 0);
-            return SIZE_MAX;
+            if (mount_point == NULL) {
+                return EBUSY;
+            }
+
+            is_locked = true;
+        } else if (result != 0) {
+            return result;
         }
 
-        if (mount_point->inode == inode && mount_point->enclosing_filesystem == enclosing_filesystem) {
+        bool matches = mount_point->inode == inode && mount_point->enclosing_filesystem == enclosing_filesystem;
+        size_t next_address = mount_point->next;
+
+        if (is_locked) {
             syscall_invoke(address, SIZE_MAX, UNTYPED_UNLOCK, 0);
-            syscall_invoke(namespace_address, SIZE_MAX, UNTYPED_UNLOCK, 0);
-            return address;
         }
 
-        size_t next_address = mount_point->next;
-        syscall_invoke(address, SIZE_MAX, UNTYPED_UNLOCK, 0);
+        if (matches) {
+            *mount_point_address = address;
+            return 0;
+        }
+
         address = next_address;
     }
 
-    syscall_invoke(namespace_address, SIZE_MAX, UNTYPED_UNLOCK, 0);
-    return SIZE_MAX;
+    return 0;
 }
@@ -27,5 +27,6 @@ size_t add_mount_point_to_namespace(struct fs_namespace *namespace, struct mount
 
 /// \brief finds the mount point that matches the given inode and enclosing filesystem.
 ///
-/// upon success, the address in capability space of the mount point will be returned. on failure, -1 will be returned
-size_t find_mount_point(size_t namespace_id, ino_t inode, size_t enclosing_filesystem);
+/// if a matching mount point is found, its address in capability space is stored in `mount_point_address`, otherwise -1 is stored there.
+/// 0 is returned whether or not a mount point was found, otherwise the error from leasing or locking the namespace or a mount point is returned
+size_t find_mount_point(size_t namespace_id, ino_t inode, size_t enclosing_filesystem, size_t *mount_point_address);
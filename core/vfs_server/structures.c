@@ -1,6 +1,7 @@
 #include "assert.h"
 #include "capabilities_layout.h"
 #include "errno.h"
+#include "id_alloc.h"
 #include <stdbool.h>
 #include <stddef.h>
 #include <stdint.h>
@@ -9,14 +10,20 @@
 #include "sys/kernel.h"
 #include "sys/limits.h"
 
-// fills an allocated region of memory with all zeroes
-static void clear_allocation(size_t address) {
-    size_t size = syscall_invoke(address, SIZE_MAX, UNTYPED_SIZEOF, 0);
+// allocates an id allocator for up to `max_items` ids at the given address
+static void alloc_used_slots(size_t address, size_t max_items) {
+    const struct alloc_args alloc_args = {
+        .type = TYPE_UNTYPED,
+        .size = ID_ALLOCATOR_SIZE(max_items, USED_SLOTS_INITIAL_IDS),
+        .address = address,
+        .depth = SIZE_MAX
+    };
+    assert(syscall_invoke(0, SIZE_MAX, ADDRESS_SPACE_ALLOC, (size_t) &alloc_args) == 0);
 
-    uint8_t *pointer = (uint8_t *) syscall_invoke(address, SIZE_MAX, UNTYPED_LOCK, 0);
-    assert(pointer != NULL);
+    struct id_allocator *allocator = (struct id_allocator *) syscall_invoke(address, SIZE_MAX, UNTYPED_LOCK, 0);
+    assert(allocator != NULL);
 
-    memset(pointer, 0, size);
+    id_alloc_init(allocator, max_items, USED_SLOTS_INITIAL_IDS);
 
     assert(syscall_invoke(address, SIZE_MAX, UNTYPED_UNLOCK, 0) == 0);
 }
@@ -38,14 +45,7 @@ void init_vfs_structures(void) {
     };
     assert(syscall_invoke(0, SIZE_MAX, ADDRESS_SPACE_ALLOC, (size_t) &mount_points_node_alloc_args) == 0);
 
-    const struct alloc_args used_mount_point_ids_alloc_args = {
-        .type = TYPE_UNTYPED,
-        .size = MAX_MOUNT_POINTS / 8,
-        .address = USED_MOUNT_POINT_IDS_SLOT,
-        .depth = SIZE_MAX
-    };
-    assert(syscall_invoke(0, SIZE_MAX, ADDRESS_SPACE_ALLOC, (size_t) &used_mount_point_ids_alloc_args) == 0);
-    clear_allocation(used_mount_point_ids_alloc_args.address);
+    alloc_used_slots(USED_MOUNT_POINT_IDS_SLOT, MAX_MOUNT_POINTS);
 
     const struct alloc_args mounted_list_info_alloc_args = {
         .type = TYPE_NODE,
@@ -63,14 +63,7 @@ void init_vfs_structures(void) {
     };
     assert(syscall_invoke(0, SIZE_MAX, ADDRESS_SPACE_ALLOC, (size_t) &mounted_list_node_alloc_args) == 0);
 
-    const struct alloc_args used_mounted_lists_alloc_args = {
-        .type = TYPE_UNTYPED,
-        .size = MAX_MOUNTED_FS / 8,
-        .address = USED_MOUNTED_LISTS_SLOT,
-        .depth = SIZE_MAX
-    };
-    assert(syscall_invoke(0, SIZE_MAX, ADDRESS_SPACE_ALLOC, (size_t) &used_mounted_lists_alloc_args) == 0);
-    clear_allocation(used_mounted_lists_alloc_args.address);
+    alloc_used_slots(USED_MOUNTED_LISTS_SLOT, MAX_MOUNTED_FS);
 
     const struct alloc_args namespaces_node_alloc_args = {
         .type = TYPE_NODE,
@@ -80,14 +73,7 @@ void init_vfs_structures(void) {
     };
     assert(syscall_invoke(0, SIZE_MAX, ADDRESS_SPACE_ALLOC, (size_t) &namespaces_node_alloc_args) == 0);
 
-    const struct alloc_args used_namespaces_alloc_args = {
-        .type = TYPE_UNTYPED,
-        .size = MAX_NAMESPACES / 8,
-        .address = USED_NAMESPACES_SLOT,
-        .depth = SIZE_MAX
-    };
-    assert(syscall_invoke(0, SIZE_MAX, ADDRESS_SPACE_ALLOC, (size_t) &used_namespaces_alloc_args) == 0);
-    clear_allocation(used_namespaces_alloc_args.address);
+    alloc_used_slots(USED_NAMESPACES_SLOT, MAX_NAMESPACES);
 
     const struct alloc_args directory_node_alloc_args = {
         .type = TYPE_NODE,
@@ -105,14 +91,7 @@ void init_vfs_structures(void) {
     };
     assert(syscall_invoke(0, SIZE_MAX, ADDRESS_SPACE_ALLOC, (size_t) &directory_info_alloc_args) == 0);
 
-    const struct alloc_args used_directories_alloc_args = {
-        .type = TYPE_UNTYPED,
-        .size = MAX_OPEN_DIRECTORIES / 8,
-        .address = USED_DIRECTORY_IDS_SLOT,
-        .depth = SIZE_MAX
-    };
-    assert(syscall_invoke(0, SIZE_MAX, ADDRESS_SPACE_ALLOC, (size_t) &used_directories_alloc_args) == 0);
-    clear_allocation(used_directories_alloc_args.address);
+    alloc_used_slots(USED_DIRECTORY_IDS_SLOT, MAX_OPEN_DIRECTORIES);
 
     const struct alloc_args thread_storage_node_alloc_args = {
         .type = TYPE_NODE,
@@ -142,58 +121,76 @@ void init_vfs_structures(void) {
     }
 }
 
-size_t find_slot_for(size_t used_slots_address, size_t max_items, void *data, size_t (*fn)(void *, size_t)) {
-    size_t *pointer = (size_t *) syscall_invoke(used_slots_address, SIZE_MAX, UNTYPED_LOCK, 0);
+size_t lease_structures(const size_t *addresses, void **pointers, size_t count) {
+    const struct lease_args lease_args = {
+        .addresses = addresses,
+        .depth = SIZE_MAX,
+        .pointers = pointers,
+        .count = count
+    };
 
-    if (pointer == NULL) {
-        return SIZE_MAX;
+    return syscall_invoke(0, SIZE_MAX, ADDRESS_SPACE_LEASE, (size_t) &lease_args);
+}
+
+/// \brief grows an id allocator so that more ids can be allocated from it
+///
+/// if it's already as big as it can be or couldn't be grown, NULL is returned, otherwise a leased pointer to it is returned
+static struct id_allocator *grow_used_slots(size_t used_slots_address, size_t max_items, size_t capacity) {
+    size_t new_capacity = capacity * 2 < max_items ? capacity * 2 : max_items;
+
+    if (new_capacity <= capacity || syscall_invoke(used_slots_address, SIZE_MAX, UNTYPED_RESIZE, ID_ALLOCATOR_SIZE(max_items, new_capacity)) != 0) {
+        return NULL;
     }
 
-    size_t id = 0;
+    // the allocator may have moved, so it has to be leased again to find out where it is now
+    struct id_allocator *allocator;
 
-    for (size_t i = 0; i < max_items / SIZE_BITS; i ++, pointer ++) {
-        size_t value = *pointer;
+    if (lease_structures(&used_slots_address, (void **) &allocator, 1) != 0) {
+        return NULL;
+    }
 
-        if (value == SIZE_MAX) {
-            continue;
-        }
+    id_alloc_grow(allocator, new_capacity);
+    return allocator;
+}
+
+size_t find_slot_for(size_t used_slots_address, size_t max_items, void *data, size_t (*fn)(void *, size_t)) {
+    // the id allocator is leased rather than locked since it's looked at on nearly every request
+    struct id_allocator *allocator;
+
+    if (lease_structures(&used_slots_address, (void **) &allocator, 1) != 0) {
+        return SIZE_MAX;
+    }
 
-        size_t bit_index;
-        for (bit_index = 0; bit_index < sizeof(size_t) * 8 && (value & ((size_t) 1 << bit_index)) != 0; bit_index ++);
+    size_t id = id_alloc(allocator);
 
-        *pointer |= ((size_t) 1 << bit_index);
+    if (id == SIZE_MAX) {
+        // every id is in use, so the allocator has to be grown to fit more
+        allocator = grow_used_slots(used_slots_address, max_items, allocator->capacity);
 
-        id = i * SIZE_BITS + bit_index;
-        break;
+        if (allocator == NULL || (id = id_alloc(allocator)) == SIZE_MAX) {
+            return SIZE_MAX;
+        }
     }
 
     size_t result = fn(data, id);
 
     if (result == SIZE_MAX) {
         // mark the id as free if the function fails
-        pointer[id / SIZE_BITS] &= ~((size_t) 1 << (id % SIZE_BITS));
+        id_free(allocator, id);
     }
 
-    syscall_invoke(used_slots_address, SIZE_MAX, UNTYPED_UNLOCK, 0);
-
     return result;
 }
 
-size_t mark_slot_unused(size_t used_slots_address, size_t max_items, size_t slot_number) {
-    size_t *pointer = (size_t *) syscall_invoke(used_slots_address, SIZE_MAX, UNTYPED_LOCK, 0);
+size_t mark_slot_unused(size_t used_slots_address, size_t slot_number) {
+    struct id_allocator *allocator;
+    size_t result = lease_structures(&used_slots_address, (void **) &allocator, 1);
 
-    if (pointer == NULL) {
-        return ENOMEM;
-    }
-
-    if (slot_number >= max_items) {
-        size_t unlock_result = syscall_invoke(used_slots_address, SIZE_MAX, UNTYPED_UNLOCK, 0);
-        return unlock_result != 0 ? unlock_result : 1;
+    if (result != 0) {
+        return result;
     }
 
-    pointer[slot_number / SIZE_BITS] &= ~((size_t) 1 << (slot_number % SIZE_BITS));
-
-    return syscall_invoke(used_slots_address, SIZE_MAX, UNTYPED_UNLOCK, 0);
+    return id_free(allocator, slot_number) ? 0 : 1;
 }
 
 static size_t alloc_structure_callback(void *data, size_t id) {
@@ -218,7 +215,7 @@ size_t alloc_structure(size_t used_slots_address, size_t node_address, size_t ma
     return find_slot_for(used_slots_address, max_items, &alloc_args, &alloc_structure_callback);
 }
 
-size_t free_structure(size_t used_slots_address, size_t node_address, size_t max_items, size_t structure_address) {
+size_t free_structure(size_t used_slots_address, size_t node_address, size_t structure_address) {
     size_t slot_number = structure_address >> INIT_NODE_DEPTH;
 
     size_t result = syscall_invoke(node_address, INIT_NODE_DEPTH, NODE_DELETE, slot_number);
@@ -227,5 +224,5 @@ size_t free_structure(size_t used_slots_address, size_t node_address, size_t max
         return result;
     }
 
-    return mark_slot_unused(used_slots_address, max_items, slot_number);
+    return mark_slot_unused(used_slots_address, slot_number);
 }
@@ -23,21 +23,28 @@ struct state {
 /// initializes and allocates vfs structures
 void init_vfs_structures(void);
 
-/// \brief finds the index of a cleared bit in a bitset, setting it in the process, and calls the given callback while its lock is held.
+/// \brief leases the untyped objects at the given addresses with a single `address_space_lease` call, writing pointers to them into `pointers`.
 ///
-/// `used_slots_address` denotes the address of the capability containing the bitset, and `max_items` is the maximum number of entries in that bitset.
+/// the objects stay locked until the next message is received. upon success, 0 is returned. if an error is encountered, none of the objects are leased
+/// and the non-zero error value will be returned, which is ETOOMANYLEASES if this thread already has as many objects leased as it can hold.
+size_t lease_structures(const size_t *addresses, void **pointers, size_t count);
+
+/// \brief allocates an id from an id allocator (see id_alloc.h) and calls the given callback with it.
+///
+/// `used_slots_address` denotes the address of the capability containing the id allocator, and `max_items` is the maximum number of ids it can fit.
+/// the allocator is grown with `untyped_resize` whenever it's full until it can fit `max_items` ids.
 ///
 /// the first argument to the callback function is the `data` argument, and the second argument to it is the id of the free bit in the bitset.
 /// if the callback returns -1, the bit at the given index will be cleared before the function returns.
 size_t find_slot_for(size_t used_slots_address, size_t max_items, void *data, size_t (*fn)(void *, size_t));
 
-/// \brief clears a bit in a bitset.
+/// \brief frees an id in an id allocator.
 ///
-/// `used_slots_address` denotes the address of the capability containing the bitset, and `max_items` is the maximum number of entries in that bitset.
-/// `slot_number` is the index of the bit to clear in that bitset, which is bounds checked with `max_items`.
+/// `used_slots_address` denotes the address of the capability containing the id allocator.
+/// `slot_number` is the id to free, which is bounds checked with the current size of the allocator.
 ///
 /// upon success, 0 is returned. if an error is encountered, the non-zero error value will be returned.
-size_t mark_slot_unused(size_t used_slots_address, size_t max_items, size_t slot_number);
+size_t mark_slot_unused(size_t used_slots_address, size_t slot_number);
 
 size_t alloc_structure(size_t used_slots_address, size_t node_address, size_t max_items, size_t structure_size);
-size_t free_structure(size_t used_slots_address, size_t node_address, size_t max_items, size_t structure_address);
+size_t free_structure(size_t used_slots_address, size_t node_address, size_t structure_address);
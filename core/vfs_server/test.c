@@ -2,6 +2,7 @@
 #include "directories.h"
 #include "errno.h"
 #include "fff.h"
+#include "id_alloc.h"
 #include <inttypes.h>
 #include <string.h>
 #include <sys/types.h>
@@ -1060,6 +1061,30 @@ void fd_truncate_should_fail(void) {
     TEST_ASSERT(endpoint_send_fake.call_count == 1);
 }
 
+// structure allocation: the id allocators used to allocate structures start out small and have to be grown until every id can be allocated
+void alloc_structure_grows_used_slots(void) {
+    size_t first = alloc_structure(USED_NAMESPACES_SLOT, NAMESPACE_NODE_SLOT, MAX_NAMESPACES, sizeof(size_t));
+    TEST_ASSERT(first != SIZE_MAX);
+
+    struct id_allocator *allocator = (struct id_allocator *) syscall_invoke(USED_NAMESPACES_SLOT, SIZE_MAX, UNTYPED_LEASE, 0);
+    TEST_ASSERT(allocator->capacity == USED_SLOTS_INITIAL_IDS);
+
+    size_t count = (first >> INIT_NODE_DEPTH) + 1;
+
+    for (size_t address; (address = alloc_structure(USED_NAMESPACES_SLOT, NAMESPACE_NODE_SLOT, MAX_NAMESPACES, sizeof(size_t))) != SIZE_MAX; count ++) {
+        TEST_ASSERT(address >> INIT_NODE_DEPTH == count);
+    }
+
+    TEST_ASSERT(count == MAX_NAMESPACES);
+
+    allocator = (struct id_allocator *) syscall_invoke(USED_NAMESPACES_SLOT, SIZE_MAX, UNTYPED_LEASE, 0);
+    TEST_ASSERT(allocator->capacity == MAX_NAMESPACES);
+
+    // freed ids are reused once every other id is in use
+    TEST_ASSERT(free_structure(USED_NAMESPACES_SLOT, NAMESPACE_NODE_SLOT, first) == 0);
+    TEST_ASSERT(alloc_structure(USED_NAMESPACES_SLOT, NAMESPACE_NODE_SLOT, MAX_NAMESPACES, sizeof(size_t)) == first);
+}
+
 int main(void) {
     UNITY_BEGIN();
 
@@ -1152,6 +1177,10 @@ int main(void) {
     // FD_UNMOUNT
     //  - idk yet
 
+    // structure allocation
+    //  - test that id allocators grow as needed
+    RUN_TEST(alloc_structure_grows_used_slots);
+
     // TODO: test worker thread usage once implemented
 
     return UNITY_END();
@@ -0,0 +1,117 @@
+#include "id_alloc.h"
+#include <string.h>
+#include "unity.h"
+#include "unity_internals.h"
+
+/// the maximum number of ids in the allocators used by the tests
+#define MAX_IDS 1024
+
+/// the memory that the allocator used by the tests is kept in, which is big enough for `MAX_IDS` ids
+static union {
+    struct id_allocator allocator;
+    size_t words[ID_ALLOCATOR_SIZE(MAX_IDS, MAX_IDS) / sizeof(size_t)];
+} storage;
+static struct id_allocator *const allocator = &storage.allocator;
+
+/// checks that every id is allocated exactly once before the allocator runs out
+static void allocates_every_id(void) {
+    static bool seen[MAX_IDS];
+    memset(seen, 0, sizeof(seen));
+
+    id_alloc_init(allocator, MAX_IDS, MAX_IDS);
+
+    for (size_t i = 0; i < MAX_IDS; i ++) {
+        size_t id = id_alloc(allocator);
+        TEST_ASSERT(id < MAX_IDS);
+        TEST_ASSERT_FALSE(seen[id]);
+        seen[id] = true;
+    }
+
+    TEST_ASSERT(id_alloc(allocator) == SIZE_MAX);
+
+    TEST_ASSERT(id_free(allocator, 500));
+    TEST_ASSERT(id_alloc(allocator) == 500);
+    TEST_ASSERT(id_alloc(allocator) == SIZE_MAX);
+
+    TEST_ASSERT_FALSE(id_free(allocator, MAX_IDS));
+    TEST_ASSERT_FALSE(id_alloc_mark_used(allocator, MAX_IDS));
+}
+
+/// checks that freed ids aren't handed out again until the allocator wraps around
+static void allocates_next_fit(void) {
+    id_alloc_init(allocator, MAX_IDS, MAX_IDS);
+    TEST_ASSERT(id_alloc_mark_used(allocator, 0));
+
+    TEST_ASSERT(id_alloc(allocator) == 1);
+    TEST_ASSERT(id_alloc(allocator) == 2);
+    TEST_ASSERT(id_free(allocator, 1));
+    TEST_ASSERT(id_alloc(allocator) == 3);
+
+    // fill up every word after the first one, so that the search has to wrap around to find the freed id
+    for (size_t id = ID_WORD_BITS; id < MAX_IDS; id ++) {
+        TEST_ASSERT(id_alloc_mark_used(allocator, id));
+    }
+
+    for (size_t id = 4; id < ID_WORD_BITS; id ++) {
+        TEST_ASSERT(id_alloc(allocator) == id);
+    }
+
+    TEST_ASSERT(id_alloc(allocator) == 1);
+    TEST_ASSERT(id_alloc(allocator) == SIZE_MAX);
+}
+
+/// checks that ids can be allocated in bulk across word boundaries, and that as many as possible are allocated when there aren't enough
+static void allocates_many(void) {
+    size_t ids[MAX_IDS];
+
+    id_alloc_init(allocator, MAX_IDS, MAX_IDS);
+    TEST_ASSERT(id_alloc_many(allocator, ID_WORD_BITS + 3, ids) == ID_WORD_BITS + 3);
+
+    for (size_t i = 0; i < ID_WORD_BITS + 3; i ++) {
+        TEST_ASSERT(ids[i] == i);
+    }
+
+    TEST_ASSERT(id_alloc_many(allocator, MAX_IDS, ids) == MAX_IDS - ID_WORD_BITS - 3);
+    TEST_ASSERT(ids[0] == ID_WORD_BITS + 3);
+    TEST_ASSERT(id_alloc_many(allocator, 1, ids) == 0);
+}
+
+/// checks that an allocator can be grown once it's full
+static void grows(void) {
+    id_alloc_init(allocator, MAX_IDS, ID_WORD_BITS);
+    TEST_ASSERT(allocator->capacity == ID_WORD_BITS);
+
+    for (size_t i = 0; i < ID_WORD_BITS; i ++) {
+        TEST_ASSERT(id_alloc(allocator) == i);
+    }
+
+    TEST_ASSERT(id_alloc(allocator) == SIZE_MAX);
+
+    // whatever's in memory past the end of the allocator before it's grown shouldn't matter
+    memset(storage.words + ID_ALLOCATOR_SIZE(MAX_IDS, ID_WORD_BITS) / sizeof(size_t), 0xff, ID_WORD_BITS / 8);
+
+    id_alloc_grow(allocator, ID_WORD_BITS * 2);
+    TEST_ASSERT(allocator->capacity == ID_WORD_BITS * 2);
+    TEST_ASSERT(id_alloc(allocator) == ID_WORD_BITS);
+}
+
+/// checks that the lowest clear bit is found in every position
+static void finds_lowest_clear_bit(void) {
+    for (unsigned int bit = 0; bit < ID_WORD_BITS; bit ++) {
+        size_t value = ((size_t) 1 << bit) - 1;
+        TEST_ASSERT(id_lowest_clear_bit(value) == bit);
+        TEST_ASSERT(id_lowest_clear_bit(~((size_t) 1 << bit)) == bit);
+    }
+}
+
+int main(void) {
+    UNITY_BEGIN();
+
+    RUN_TEST(allocates_every_id);
+    RUN_TEST(allocates_next_fit);
+    RUN_TEST(allocates_many);
+    RUN_TEST(grows);
+    RUN_TEST(finds_lowest_clear_bit);
+
+    return UNITY_END();
+}
@@ -0,0 +1,123 @@
+#include "id_alloc.h"
+#include <inttypes.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include "unity.h"
+#include "unity_internals.h"
+
+/// how many ids the allocator used by the benchmark has
+#define BENCHMARK_IDS 4096
+
+/// how many of the benchmark's ids are left free while it's running
+#define BENCHMARK_FREE_IDS (BENCHMARK_IDS / 100)
+
+/// how many ids are allocated and freed again by the benchmark
+#define BENCHMARK_OPERATIONS 100000
+
+/// the memory that the allocator used by the benchmark is kept in, which is big enough for `BENCHMARK_IDS` ids
+static union {
+    struct id_allocator allocator;
+    size_t words[ID_ALLOCATOR_SIZE(BENCHMARK_IDS, BENCHMARK_IDS) / sizeof(size_t)];
+} storage;
+static struct id_allocator *const allocator = &storage.allocator;
+
+static uint64_t now(void) {
+    struct timespec time;
+    clock_gettime(CLOCK_MONOTONIC, &time);
+    return (uint64_t) time.tv_sec * 1000000000 + (uint64_t) time.tv_nsec;
+}
+
+static uint32_t random_state;
+
+static uint32_t next_random(void) {
+    random_state = random_state * 1103515245 + 12345;
+    return random_state >> 8;
+}
+
+/// finds and sets the lowest clear bit in a plain bitset one bit at a time, the way ids used to be allocated before this allocator was added
+static size_t linear_scan_alloc(size_t *bitset, size_t words) {
+    for (size_t i = 0; i < words; i ++) {
+        if (bitset[i] == SIZE_MAX) {
+            continue;
+        }
+
+        size_t bit;
+        for (bit = 0; bit < ID_WORD_BITS && (bitset[i] & ((size_t) 1 << bit)) != 0; bit ++);
+
+        bitset[i] |= (size_t) 1 << bit;
+        return i * ID_WORD_BITS + bit;
+    }
+
+    return SIZE_MAX;
+}
+
+/// measures how long allocating an id takes when nearly every id is in use, compared to scanning a plain bitset
+static void high_occupancy_benchmark(void) {
+    static size_t used[BENCHMARK_IDS];
+    static size_t linear_scan_used[BENCHMARK_IDS];
+    static size_t bitset[BENCHMARK_IDS / ID_WORD_BITS];
+    size_t used_count = BENCHMARK_IDS - BENCHMARK_FREE_IDS;
+
+    // fill both of them up, then free the same random ids in each
+    id_alloc_init(allocator, BENCHMARK_IDS, BENCHMARK_IDS);
+    TEST_ASSERT(id_alloc_many(allocator, BENCHMARK_IDS, used) == BENCHMARK_IDS);
+    memset(bitset, 0xff, sizeof(bitset));
+
+    random_state = 1;
+
+    for (size_t i = BENCHMARK_IDS; i > used_count; i --) {
+        size_t index = next_random() % i;
+        size_t id = used[index];
+        used[index] = used[i - 1];
+
+        TEST_ASSERT(id_free(allocator, id));
+        bitset[id / ID_WORD_BITS] &= ~((size_t) 1 << (id % ID_WORD_BITS));
+    }
+
+    memcpy(linear_scan_used, used, sizeof(used));
+
+    // allocate an id then free a random one, so that occupancy stays the same
+    random_state = 2;
+    uint64_t start = now();
+
+    for (size_t i = 0; i < BENCHMARK_OPERATIONS; i ++) {
+        size_t index = next_random() % used_count;
+        size_t id = id_alloc(allocator);
+        TEST_ASSERT(id_free(allocator, used[index]));
+        used[index] = id;
+    }
+
+    uint64_t allocator_time = now() - start;
+
+    random_state = 2;
+    start = now();
+
+    for (size_t i = 0; i < BENCHMARK_OPERATIONS; i ++) {
+        size_t index = next_random() % used_count;
+        size_t id = linear_scan_alloc(bitset, BENCHMARK_IDS / ID_WORD_BITS);
+        bitset[linear_scan_used[index] / ID_WORD_BITS] &= ~((size_t) 1 << (linear_scan_used[index] % ID_WORD_BITS));
+        linear_scan_used[index] = id;
+    }
+
+    uint64_t linear_scan_time = now() - start;
+
+    printf(
+        "id allocation at %d of %d ids used: %d allocations in %" PRIu64 " us (%" PRIu64 " ns each), linear scan in %" PRIu64 " us (%" PRIu64 " ns each)\n",
+        BENCHMARK_IDS - BENCHMARK_FREE_IDS,
+        BENCHMARK_IDS,
+        BENCHMARK_OPERATIONS,
+        allocator_time / 1000,
+        allocator_time / BENCHMARK_OPERATIONS,
+        linear_scan_time / 1000,
+        linear_scan_time / BENCHMARK_OPERATIONS
+    );
+}
+
+int main(void) {
+    UNITY_BEGIN();
+
+    RUN_TEST(high_occupancy_benchmark);
+
+    return UNITY_END();
+}
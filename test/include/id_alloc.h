@@ -0,0 +1 @@
+../../core/common/id_alloc.h
\ No newline at end of file
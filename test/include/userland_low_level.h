@@ -23,3 +23,9 @@ void custom_teardown(void);
 // utility functions
 
 size_t read_badge(size_t address, size_t depth, size_t *badge);
+
+/// gets how many times the heap object at the given address is currently locked
+uint8_t read_pins(void *pointer);
+
+/// how many times an invocation has been restarted by syscall_invoke() since the last time this was reset
+extern size_t invocation_restarts;
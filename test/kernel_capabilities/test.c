@@ -0,0 +1,451 @@
+#include "capabilities.h"
+#include "errno.h"
+#include "sys/kernel.h"
+#include "unity.h"
+#include "unity_internals.h"
+#include "userland_low_level.h"
+
+/// the slot in the root node that the capability node used by each test is placed in
+#define NODE_SLOT 2
+
+/// how many bits of an address the capability node used by each test takes up
+#define NODE_BITS 13
+
+/// how deep the slots in the capability node used by each test are
+#define SLOT_DEPTH (ROOT_CAP_SLOT_BITS + NODE_BITS)
+
+/// the slot in the capability node that the original capability used by each test is placed in
+#define ORIGINAL 0
+
+/// the size of the untyped object that the original capability refers to
+#define ORIGINAL_SIZE 32
+
+/// gets the address of a slot in the capability node used by each test
+static size_t slot_address(size_t slot) {
+    return NODE_SLOT | (slot << ROOT_CAP_SLOT_BITS);
+}
+
+void custom_setup(void) {
+    struct alloc_args node = {TYPE_NODE, NODE_BITS, NODE_SLOT, ROOT_CAP_SLOT_BITS, 0, 0, 0};
+    TEST_ASSERT(syscall_invoke(0, ROOT_CAP_SLOT_BITS, ADDRESS_SPACE_ALLOC, (size_t) &node) == 0);
+
+    struct alloc_args untyped = {TYPE_UNTYPED, ORIGINAL_SIZE, slot_address(ORIGINAL), SLOT_DEPTH, 0, 0, 0};
+    TEST_ASSERT(syscall_invoke(0, ROOT_CAP_SLOT_BITS, ADDRESS_SPACE_ALLOC, (size_t) &untyped) == 0);
+}
+
+/// copies the capability in one slot of the test node to another, setting its badge if `badge` is non-zero
+static size_t copy(size_t source, size_t dest, size_t badge) {
+    struct node_copy_args args = {slot_address(source), SLOT_DEPTH, dest, UINT8_MAX, badge, badge != 0};
+    return syscall_invoke(NODE_SLOT, ROOT_CAP_SLOT_BITS, NODE_COPY, (size_t) &args);
+}
+
+static size_t move(size_t source, size_t dest) {
+    struct node_move_args args = {slot_address(source), SLOT_DEPTH, dest};
+    return syscall_invoke(NODE_SLOT, ROOT_CAP_SLOT_BITS, NODE_MOVE, (size_t) &args);
+}
+
+static size_t delete(size_t slot) {
+    return syscall_invoke(NODE_SLOT, ROOT_CAP_SLOT_BITS, NODE_DELETE, slot);
+}
+
+static size_t revoke(size_t slot) {
+    return syscall_invoke(NODE_SLOT, ROOT_CAP_SLOT_BITS, NODE_REVOKE, slot);
+}
+
+/// checks whether the given slot of the test node contains a capability referring to the original capability's resource
+static bool is_valid(size_t slot) {
+    return syscall_invoke(slot_address(slot), SLOT_DEPTH, UNTYPED_SIZEOF, 0) == ORIGINAL_SIZE;
+}
+
+/// checks that a resource is kept until every capability referring to it has been deleted, regardless of the order they're deleted in
+static void copies_share_resource(void) {
+    for (size_t i = 1; i <= 8; i ++) {
+        TEST_ASSERT(copy(ORIGINAL, i, 0) == 0);
+    }
+
+    TEST_ASSERT(delete(ORIGINAL) == 0);
+    TEST_ASSERT(delete(8) == 0);
+    TEST_ASSERT(delete(4) == 0);
+    TEST_ASSERT(delete(1) == 0);
+
+    TEST_ASSERT_FALSE(is_valid(ORIGINAL));
+    TEST_ASSERT_FALSE(is_valid(4));
+
+    for (size_t i = 2; i <= 7; i ++) {
+        if (i != 4) {
+            TEST_ASSERT(is_valid(i));
+            TEST_ASSERT(delete(i) == 0);
+        }
+    }
+}
+
+/// checks that revoking a capability deletes every capability derived from it, including those derived from badged copies of it
+static void revoke_removes_derivations(void) {
+    TEST_ASSERT(copy(ORIGINAL, 1, 0) == 0);
+    TEST_ASSERT(copy(ORIGINAL, 2, 0x1234) == 0);
+    TEST_ASSERT(copy(2, 3, 0) == 0);
+    TEST_ASSERT(copy(2, 4, 0) == 0);
+    TEST_ASSERT(copy(1, 5, 0) == 0);
+
+    size_t badge = 0;
+    TEST_ASSERT(read_badge(slot_address(4), SLOT_DEPTH, &badge) == 0);
+    TEST_ASSERT(badge == 0x1234);
+
+    // revoking the badged copy only deletes the capabilities derived from it
+    TEST_ASSERT(revoke(2) == 0);
+    TEST_ASSERT(is_valid(2));
+    TEST_ASSERT_FALSE(is_valid(3));
+    TEST_ASSERT_FALSE(is_valid(4));
+    TEST_ASSERT(is_valid(1));
+    TEST_ASSERT(is_valid(5));
+
+    TEST_ASSERT(copy(2, 3, 0) == 0);
+    TEST_ASSERT(revoke(ORIGINAL) == 0);
+    TEST_ASSERT(is_valid(ORIGINAL));
+
+    for (size_t i = 1; i <= 5; i ++) {
+        TEST_ASSERT_FALSE(is_valid(i));
+    }
+}
+
+/// checks that the capabilities derived from a badged capability can still be revoked through its parent once it's been deleted
+static void delete_merges_derivations(void) {
+    TEST_ASSERT(copy(ORIGINAL, 1, 0) == 0);
+    TEST_ASSERT(copy(ORIGINAL, 2, 0x1234) == 0);
+    TEST_ASSERT(copy(2, 3, 0) == 0);
+    TEST_ASSERT(copy(2, 4, 0) == 0);
+
+    // deleting the first derivation of the original moves the start of its derivation list
+    TEST_ASSERT(delete(1) == 0);
+    TEST_ASSERT(delete(2) == 0);
+    TEST_ASSERT(is_valid(3));
+    TEST_ASSERT(is_valid(4));
+
+    TEST_ASSERT(revoke(ORIGINAL) == 0);
+    TEST_ASSERT(is_valid(ORIGINAL));
+    TEST_ASSERT_FALSE(is_valid(3));
+    TEST_ASSERT_FALSE(is_valid(4));
+}
+
+/// checks that moving capabilities around keeps their derivation and resource lists intact
+static void move_keeps_lists(void) {
+    TEST_ASSERT(copy(ORIGINAL, 1, 0) == 0);
+    TEST_ASSERT(copy(ORIGINAL, 2, 0x1234) == 0);
+    TEST_ASSERT(copy(2, 3, 0) == 0);
+
+    TEST_ASSERT(move(ORIGINAL, 100) == 0);
+    TEST_ASSERT(move(1, 101) == 0);
+    TEST_ASSERT(move(2, 102) == 0);
+    TEST_ASSERT(move(3, 103) == 0);
+
+    TEST_ASSERT(revoke(102) == 0);
+    TEST_ASSERT_FALSE(is_valid(103));
+    TEST_ASSERT(is_valid(101));
+
+    TEST_ASSERT(revoke(100) == 0);
+    TEST_ASSERT_FALSE(is_valid(101));
+    TEST_ASSERT_FALSE(is_valid(102));
+
+    // the only capability left referring to the resource is the original, so deleting it frees the resource
+    TEST_ASSERT(delete(100) == 0);
+}
+
+/// allocates a capability node with 4 slots at the given address
+static size_t new_node(size_t address, size_t depth) {
+    struct alloc_args args = {TYPE_NODE, 2, address, depth, 0, 0, 0};
+    return syscall_invoke(0, ROOT_CAP_SLOT_BITS, ADDRESS_SPACE_ALLOC, (size_t) &args);
+}
+
+/// checks that nodes can't be nested too deeply or placed inside of themselves, no matter how they're moved around
+static void node_nesting(void) {
+    // the root node and the test node take up the first 2 levels, so there's only room for 2 more
+    TEST_ASSERT(new_node(slot_address(1), SLOT_DEPTH) == 0);
+    TEST_ASSERT(new_node(slot_address(1), SLOT_DEPTH + 2) == 0);
+    TEST_ASSERT(new_node(slot_address(1), SLOT_DEPTH + 4) == ETOOMUCHNESTING);
+
+    // moving a node into a node inside of it would make it unreachable
+    struct node_move_args into_itself = {slot_address(1), SLOT_DEPTH, 1};
+    TEST_ASSERT(syscall_invoke(slot_address(1), SLOT_DEPTH + 2, NODE_MOVE, (size_t) &into_itself) == ECAPINVAL);
+    TEST_ASSERT(syscall_invoke(slot_address(1), SLOT_DEPTH, NODE_MOVE, (size_t) &into_itself) == ECAPINVAL);
+
+    // once the inner node is moved out, the outer node can be moved into it, which leaves no room below it
+    struct node_move_args out = {slot_address(1), SLOT_DEPTH + 2, 2};
+    TEST_ASSERT(syscall_invoke(NODE_SLOT, ROOT_CAP_SLOT_BITS, NODE_MOVE, (size_t) &out) == 0);
+
+    struct node_move_args in = {slot_address(1), SLOT_DEPTH, 3};
+    TEST_ASSERT(syscall_invoke(slot_address(2), SLOT_DEPTH, NODE_MOVE, (size_t) &in) == 0);
+    TEST_ASSERT(new_node(slot_address(2) | (3 << SLOT_DEPTH), SLOT_DEPTH + 4) == ETOOMUCHNESTING);
+
+    // a node with another node in it can't be moved any deeper than it is already
+    TEST_ASSERT(new_node(slot_address(4), SLOT_DEPTH) == 0);
+    struct node_move_args deeper = {slot_address(2), SLOT_DEPTH, 0};
+    TEST_ASSERT(syscall_invoke(slot_address(4), SLOT_DEPTH, NODE_MOVE, (size_t) &deeper) == ETOOMUCHNESTING);
+
+    // emptying the node frees up room below it again
+    TEST_ASSERT(syscall_invoke(slot_address(2), SLOT_DEPTH, NODE_DELETE, 3) == 0);
+    TEST_ASSERT(syscall_invoke(slot_address(4), SLOT_DEPTH, NODE_MOVE, (size_t) &deeper) == 0);
+    TEST_ASSERT(new_node(slot_address(4), SLOT_DEPTH + 4) == ETOOMUCHNESTING);
+}
+
+/// checks that revoking lots of capabilities is split up into steps that are each restarted, and that it still deletes all of them
+static void revoke_in_steps(void) {
+    TEST_ASSERT(copy(ORIGINAL, 1, 0x1234) == 0);
+
+    for (size_t i = 2; i <= DELETE_STEP_LIMIT * 4; i ++) {
+        TEST_ASSERT(copy(i % 2 == 0 ? ORIGINAL : 1, i, 0) == 0);
+    }
+
+    invocation_restarts = 0;
+    TEST_ASSERT(revoke(ORIGINAL) == 0);
+    TEST_ASSERT(invocation_restarts >= 3);
+    TEST_ASSERT(is_valid(ORIGINAL));
+
+    for (size_t i = 1; i <= DELETE_STEP_LIMIT * 4; i ++) {
+        TEST_ASSERT_FALSE(is_valid(i));
+    }
+}
+
+/// checks that a batch containing a revoke that's split up into steps returns between each step, and that it's resumed without making the invocations before the revoke again
+static void batch_resumes_after_restart(void) {
+    for (size_t i = 1; i <= DELETE_STEP_LIMIT * 2; i ++) {
+        TEST_ASSERT(copy(ORIGINAL, i, 0) == 0);
+    }
+
+    // the copy would fail if it was made again, since the slot it copies into would already be full
+    struct node_copy_args args = {slot_address(ORIGINAL), SLOT_DEPTH, DELETE_STEP_LIMIT * 2 + 1, UINT8_MAX, 0, 0};
+    struct invocation invocations[] = {
+        {NODE_SLOT, ROOT_CAP_SLOT_BITS, NODE_COPY, (size_t) &args, SIZE_MAX},
+        {NODE_SLOT, ROOT_CAP_SLOT_BITS, NODE_REVOKE, ORIGINAL, SIZE_MAX},
+        {slot_address(ORIGINAL), SLOT_DEPTH, UNTYPED_SIZEOF, 0, SIZE_MAX}
+    };
+
+    invocation_restarts = 0;
+    TEST_ASSERT(syscall_invoke_batch(invocations, 3, BATCH_STOP_ON_ERROR) == 3);
+    TEST_ASSERT(invocation_restarts >= 2);
+
+    TEST_ASSERT(invocations[0].result == 0);
+    TEST_ASSERT(invocations[1].result == 0);
+    TEST_ASSERT(invocations[2].result == ORIGINAL_SIZE);
+
+    for (size_t i = 1; i <= DELETE_STEP_LIMIT * 2 + 1; i ++) {
+        TEST_ASSERT_FALSE(is_valid(i));
+    }
+}
+
+/// checks that deleting a node full of capabilities, including ones in nested nodes, is split up into steps that are each restarted
+static void delete_node_in_steps(void) {
+    struct alloc_args outer = {TYPE_NODE, 8, slot_address(1), SLOT_DEPTH, 0, 0, 0};
+    TEST_ASSERT(syscall_invoke(0, ROOT_CAP_SLOT_BITS, ADDRESS_SPACE_ALLOC, (size_t) &outer) == 0);
+
+    struct alloc_args inner = {TYPE_NODE, 8, slot_address(1) | ((size_t) 0xff << SLOT_DEPTH), SLOT_DEPTH + 8, 0, 0, 0};
+    TEST_ASSERT(syscall_invoke(0, ROOT_CAP_SLOT_BITS, ADDRESS_SPACE_ALLOC, (size_t) &inner) == 0);
+
+    size_t inner_address = slot_address(1) | ((size_t) 0xff << SLOT_DEPTH);
+    struct node_copy_args args = {slot_address(ORIGINAL), SLOT_DEPTH, 0, UINT8_MAX, 0, 0};
+
+    for (args.dest_slot = 0; args.dest_slot < 0xff; args.dest_slot ++) {
+        TEST_ASSERT(syscall_invoke(slot_address(1), SLOT_DEPTH, NODE_COPY, (size_t) &args) == 0);
+        TEST_ASSERT(syscall_invoke(inner_address, SLOT_DEPTH + 8, NODE_COPY, (size_t) &args) == 0);
+    }
+
+    invocation_restarts = 0;
+    TEST_ASSERT(delete(1) == 0);
+    TEST_ASSERT(invocation_restarts >= (0xff * 2) / DELETE_STEP_LIMIT);
+
+    // none of the deleted copies should be left in the original's lists
+    TEST_ASSERT(copy(ORIGINAL, 2, 0) == 0);
+    TEST_ASSERT(revoke(ORIGINAL) == 0);
+    TEST_ASSERT_FALSE(is_valid(2));
+    TEST_ASSERT(delete(ORIGINAL) == 0);
+}
+
+/// checks that ranges of slots can be copied, moved, and deleted in one invocation, including when they overlap
+static void range_operations(void) {
+    for (size_t i = 1; i <= 4; i ++) {
+        TEST_ASSERT(copy(ORIGINAL, i, 0) == 0);
+    }
+
+    // slots 1, 2 and 4 are copied to 11, 12 and 14, while slot 3 is left out
+    struct node_range_args copy_args = {slot_address(1), SLOT_DEPTH, 11, 0b1011};
+    TEST_ASSERT(syscall_invoke(NODE_SLOT, ROOT_CAP_SLOT_BITS, NODE_COPY_RANGE, (size_t) &copy_args) == 0);
+    TEST_ASSERT(is_valid(11));
+    TEST_ASSERT(is_valid(12));
+    TEST_ASSERT_FALSE(is_valid(13));
+    TEST_ASSERT(is_valid(14));
+
+    TEST_ASSERT(syscall_invoke(NODE_SLOT, ROOT_CAP_SLOT_BITS, NODE_COPY_RANGE, (size_t) &copy_args) == ECAPEXISTS);
+
+    // slots 11 to 14 are moved 2 slots later, overlapping with where they started
+    struct node_range_args move_args = {slot_address(11), SLOT_DEPTH, 13, 0b1111};
+    TEST_ASSERT(syscall_invoke(NODE_SLOT, ROOT_CAP_SLOT_BITS, NODE_MOVE_RANGE, (size_t) &move_args) == 0);
+    TEST_ASSERT_FALSE(is_valid(11));
+    TEST_ASSERT_FALSE(is_valid(12));
+    TEST_ASSERT(is_valid(13));
+    TEST_ASSERT(is_valid(14));
+    TEST_ASSERT_FALSE(is_valid(15));
+    TEST_ASSERT(is_valid(16));
+
+    // slots that are empty are skipped over without any errors
+    struct node_delete_range_args delete_args = {1, 0xffff};
+    TEST_ASSERT(syscall_invoke(NODE_SLOT, ROOT_CAP_SLOT_BITS, NODE_DELETE_RANGE, (size_t) &delete_args) == 0);
+
+    for (size_t i = 1; i <= 16; i ++) {
+        TEST_ASSERT_FALSE(is_valid(i));
+    }
+
+    struct node_delete_range_args out_of_range = {(1 << NODE_BITS) - 1, 0b11};
+    TEST_ASSERT(syscall_invoke(NODE_SLOT, ROOT_CAP_SLOT_BITS, NODE_DELETE_RANGE, (size_t) &out_of_range) == EINVAL);
+}
+
+static void *lease(size_t slot) {
+    return (void *) syscall_invoke(slot_address(slot), SLOT_DEPTH, UNTYPED_LEASE, 0);
+}
+
+/// checks that leased objects stay locked until they're released in bulk, and that deleting a leased object drops its lease
+static void leases_released_in_bulk(void) {
+    void *original = lease(ORIGINAL);
+    TEST_ASSERT(original != NULL);
+    uint8_t leased_pins = read_pins(original);
+
+    // leasing an object again doesn't lock it any more
+    TEST_ASSERT(lease(ORIGINAL) == original);
+    TEST_ASSERT(read_pins(original) == leased_pins);
+
+    // the object in this slot is freed while it's leased, so releasing leases afterwards mustn't touch it
+    struct alloc_args untyped = {TYPE_UNTYPED, ORIGINAL_SIZE, slot_address(1), SLOT_DEPTH, 0, 0, 0};
+    TEST_ASSERT(syscall_invoke(0, ROOT_CAP_SLOT_BITS, ADDRESS_SPACE_ALLOC, (size_t) &untyped) == 0);
+    TEST_ASSERT(lease(1) != NULL);
+    TEST_ASSERT(delete(1) == 0);
+
+    TEST_ASSERT(syscall_invoke(0, ROOT_CAP_SLOT_BITS, ADDRESS_SPACE_RELEASE_LEASES, 0) == 0);
+    TEST_ASSERT(read_pins(original) == leased_pins - 1);
+
+    // once the thread has as many objects leased as it can hold, leasing anything else fails until they're released
+    for (size_t i = 1; i <= MAX_LEASES; i ++) {
+        untyped.address = slot_address(i);
+        TEST_ASSERT(syscall_invoke(0, ROOT_CAP_SLOT_BITS, ADDRESS_SPACE_ALLOC, (size_t) &untyped) == 0);
+        TEST_ASSERT(lease(i) != NULL);
+    }
+
+    TEST_ASSERT(lease(ORIGINAL) == NULL);
+    TEST_ASSERT(syscall_invoke(0, ROOT_CAP_SLOT_BITS, ADDRESS_SPACE_RELEASE_LEASES, 0) == 0);
+    TEST_ASSERT(lease(ORIGINAL) == original);
+}
+
+/// checks that several objects can be leased with one invocation, and that none of them are leased if any of them can't be
+static void lease_many_at_once(void) {
+    size_t addresses[MAX_LEASES + 1];
+    void *pointers[MAX_LEASES + 1];
+
+    for (size_t i = 0; i < MAX_LEASES; i ++) {
+        addresses[i] = slot_address(i + 1);
+        struct alloc_args untyped = {TYPE_UNTYPED, ORIGINAL_SIZE, addresses[i], SLOT_DEPTH, 0, 0, 0};
+        TEST_ASSERT(syscall_invoke(0, ROOT_CAP_SLOT_BITS, ADDRESS_SPACE_ALLOC, (size_t) &untyped) == 0);
+    }
+
+    struct lease_args args = {addresses, SLOT_DEPTH, pointers, 2};
+    TEST_ASSERT(syscall_invoke(0, ROOT_CAP_SLOT_BITS, ADDRESS_SPACE_LEASE, (size_t) &args) == 0);
+    TEST_ASSERT(pointers[0] == lease(1));
+    TEST_ASSERT(pointers[1] == lease(2));
+    TEST_ASSERT(read_pins(pointers[0]) == 1);
+
+    // there's only room for as many leases as there are objects in the list, so leasing all of them as well as the original fails part of the way through
+    TEST_ASSERT(lease(ORIGINAL) != NULL);
+    args.count = MAX_LEASES;
+    TEST_ASSERT(syscall_invoke(0, ROOT_CAP_SLOT_BITS, ADDRESS_SPACE_LEASE, (size_t) &args) == ETOOMANYLEASES);
+
+    for (size_t i = 2; i < MAX_LEASES - 1; i ++) {
+        TEST_ASSERT(read_pins(pointers[i]) == 0);
+    }
+
+    TEST_ASSERT(read_pins(pointers[0]) == 1);
+    TEST_ASSERT(syscall_invoke(0, ROOT_CAP_SLOT_BITS, ADDRESS_SPACE_RELEASE_LEASES, 0) == 0);
+    TEST_ASSERT(read_pins(pointers[0]) == 0);
+
+    // an empty slot at the end of the list stops the objects before it from being leased
+    addresses[MAX_LEASES] = slot_address(MAX_LEASES + 1);
+    args.addresses = &addresses[MAX_LEASES - 2];
+    args.count = 3;
+    TEST_ASSERT(syscall_invoke(0, ROOT_CAP_SLOT_BITS, ADDRESS_SPACE_LEASE, (size_t) &args) == ECAPINVAL);
+    TEST_ASSERT(read_pins(pointers[0]) == 0);
+    TEST_ASSERT(read_pins(pointers[1]) == 0);
+
+    args.count = MAX_LEASES + 1;
+    TEST_ASSERT(syscall_invoke(0, ROOT_CAP_SLOT_BITS, ADDRESS_SPACE_LEASE, (size_t) &args) == ETOOMANYLEASES);
+}
+
+/// checks that trying to lock an object fails if it's already locked or leased, even though locks can be nested
+static void try_lock_fails_when_locked(void) {
+    void *original = (void *) syscall_invoke(slot_address(ORIGINAL), SLOT_DEPTH, UNTYPED_TRY_LOCK, 0);
+    TEST_ASSERT(original != NULL);
+    TEST_ASSERT(syscall_invoke(slot_address(ORIGINAL), SLOT_DEPTH, UNTYPED_TRY_LOCK, 0) == (size_t) NULL);
+
+    // untyped_lock still nests on top of it
+    TEST_ASSERT(syscall_invoke(slot_address(ORIGINAL), SLOT_DEPTH, UNTYPED_LOCK, 0) == (size_t) original);
+    TEST_ASSERT(syscall_invoke(slot_address(ORIGINAL), SLOT_DEPTH, UNTYPED_UNLOCK, 0) == 0);
+    TEST_ASSERT(syscall_invoke(slot_address(ORIGINAL), SLOT_DEPTH, UNTYPED_UNLOCK, 0) == 0);
+
+    TEST_ASSERT(lease(ORIGINAL) == original);
+    TEST_ASSERT(syscall_invoke(slot_address(ORIGINAL), SLOT_DEPTH, UNTYPED_TRY_LOCK, 0) == (size_t) NULL);
+    TEST_ASSERT(syscall_invoke(0, ROOT_CAP_SLOT_BITS, ADDRESS_SPACE_RELEASE_LEASES, 0) == 0);
+
+    TEST_ASSERT(syscall_invoke(slot_address(ORIGINAL), SLOT_DEPTH, UNTYPED_TRY_LOCK, 0) == (size_t) original);
+    TEST_ASSERT(syscall_invoke(slot_address(ORIGINAL), SLOT_DEPTH, UNTYPED_UNLOCK, 0) == 0);
+}
+
+/// checks that resizing an untyped object keeps its contents and updates every capability referring to it
+static void resize_keeps_contents(void) {
+    TEST_ASSERT(copy(ORIGINAL, 1, 0) == 0);
+
+    uint8_t *original = lease(ORIGINAL);
+    TEST_ASSERT(original != NULL);
+
+    for (size_t i = 0; i < ORIGINAL_SIZE; i ++) {
+        original[i] = (uint8_t) i;
+    }
+
+    // objects can't be resized while they're locked by anything other than the calling thread's lease
+    TEST_ASSERT(syscall_invoke(slot_address(ORIGINAL), SLOT_DEPTH, UNTYPED_LOCK, 0) == (size_t) original);
+    TEST_ASSERT(syscall_invoke(slot_address(ORIGINAL), SLOT_DEPTH, UNTYPED_RESIZE, 4096) == EBUSY);
+    TEST_ASSERT(syscall_invoke(slot_address(ORIGINAL), SLOT_DEPTH, UNTYPED_UNLOCK, 0) == 0);
+
+    TEST_ASSERT(syscall_invoke(slot_address(ORIGINAL), SLOT_DEPTH, UNTYPED_RESIZE, 4096) == 0);
+    TEST_ASSERT(syscall_invoke(slot_address(1), SLOT_DEPTH, UNTYPED_SIZEOF, 0) == 4096);
+
+    original = lease(1);
+    TEST_ASSERT(original != NULL);
+
+    for (size_t i = 0; i < ORIGINAL_SIZE; i ++) {
+        TEST_ASSERT(original[i] == (uint8_t) i);
+    }
+
+    // the lease follows the object if it's moved, so releasing it doesn't leave it locked
+    TEST_ASSERT(read_pins(original) == 1);
+    TEST_ASSERT(syscall_invoke(0, ROOT_CAP_SLOT_BITS, ADDRESS_SPACE_RELEASE_LEASES, 0) == 0);
+    TEST_ASSERT(read_pins(original) == 0);
+
+    // small objects are rounded up to a power of two when they're shrunk
+    TEST_ASSERT(syscall_invoke(slot_address(ORIGINAL), SLOT_DEPTH, UNTYPED_RESIZE, 12) == 0);
+    TEST_ASSERT(syscall_invoke(slot_address(1), SLOT_DEPTH, UNTYPED_SIZEOF, 0) == 16);
+    TEST_ASSERT(syscall_invoke(slot_address(ORIGINAL), SLOT_DEPTH, UNTYPED_RESIZE, 0) == EINVAL);
+}
+
+int main(void) {
+    UNITY_BEGIN();
+
+    RUN_TEST(copies_share_resource);
+    RUN_TEST(revoke_removes_derivations);
+    RUN_TEST(delete_merges_derivations);
+    RUN_TEST(move_keeps_lists);
+    RUN_TEST(node_nesting);
+    RUN_TEST(revoke_in_steps);
+    RUN_TEST(batch_resumes_after_restart);
+    RUN_TEST(delete_node_in_steps);
+    RUN_TEST(range_operations);
+    RUN_TEST(leases_released_in_bulk);
+    RUN_TEST(lease_many_at_once);
+    RUN_TEST(try_lock_fails_when_locked);
+    RUN_TEST(resize_keeps_contents);
+
+    return UNITY_END();
+}
@@ -0,0 +1,97 @@
+#include "capabilities.h"
+#include <inttypes.h>
+#include <stdio.h>
+#include "sys/kernel.h"
+#include <time.h>
+#include "unity.h"
+#include "unity_internals.h"
+#include "userland_low_level.h"
+
+/// the slot in the root node that the capability node used by the benchmark is placed in
+#define NODE_SLOT 2
+
+/// how many bits of an address the capability node used by the benchmark takes up
+#define NODE_BITS 13
+
+/// how deep the slots in the capability node used by the benchmark are
+#define SLOT_DEPTH (ROOT_CAP_SLOT_BITS + NODE_BITS)
+
+/// the slot in the capability node that the original capability used by the benchmark is placed in
+#define ORIGINAL 0
+
+/// how many derivations of a single capability are made by the benchmark
+#define BENCHMARK_DERIVATIONS 4096
+
+/// gets the address of a slot in the capability node used by the benchmark
+static size_t slot_address(size_t slot) {
+    return NODE_SLOT | (slot << ROOT_CAP_SLOT_BITS);
+}
+
+void custom_setup(void) {
+    struct alloc_args node = {TYPE_NODE, NODE_BITS, NODE_SLOT, ROOT_CAP_SLOT_BITS, 0, 0, 0};
+    TEST_ASSERT(syscall_invoke(0, ROOT_CAP_SLOT_BITS, ADDRESS_SPACE_ALLOC, (size_t) &node) == 0);
+
+    struct alloc_args untyped = {TYPE_UNTYPED, 32, slot_address(ORIGINAL), SLOT_DEPTH, 0, 0, 0};
+    TEST_ASSERT(syscall_invoke(0, ROOT_CAP_SLOT_BITS, ADDRESS_SPACE_ALLOC, (size_t) &untyped) == 0);
+}
+
+static size_t copy(size_t source, size_t dest) {
+    struct node_copy_args args = {slot_address(source), SLOT_DEPTH, dest, UINT8_MAX, 0, 0};
+    return syscall_invoke(NODE_SLOT, ROOT_CAP_SLOT_BITS, NODE_COPY, (size_t) &args);
+}
+
+static size_t delete(size_t slot) {
+    return syscall_invoke(NODE_SLOT, ROOT_CAP_SLOT_BITS, NODE_DELETE, slot);
+}
+
+static uint64_t now(void) {
+    struct timespec time;
+    clock_gettime(CLOCK_MONOTONIC, &time);
+    return (uint64_t) time.tv_sec * 1000000000 + (uint64_t) time.tv_nsec;
+}
+
+/// measures how long copying, deleting, and revoking capabilities takes when a resource has thousands of capabilities derived from it
+static void derivation_benchmark(void) {
+    uint64_t start = now();
+
+    for (size_t i = 1; i <= BENCHMARK_DERIVATIONS; i ++) {
+        TEST_ASSERT(copy(ORIGINAL, i) == 0);
+    }
+
+    uint64_t copy_time = now() - start;
+
+    // delete every other copy, alternating between either end of the range of slots
+    start = now();
+
+    for (size_t i = 1; i <= BENCHMARK_DERIVATIONS / 2; i += 2) {
+        TEST_ASSERT(delete(i) == 0);
+        TEST_ASSERT(delete(BENCHMARK_DERIVATIONS + 1 - i) == 0);
+    }
+
+    uint64_t delete_time = now() - start;
+    size_t deleted = BENCHMARK_DERIVATIONS / 2;
+
+    start = now();
+    TEST_ASSERT(syscall_invoke(NODE_SLOT, ROOT_CAP_SLOT_BITS, NODE_REVOKE, ORIGINAL) == 0);
+    uint64_t revoke_time = now() - start;
+
+    printf(
+        "derivations: %d copies in %" PRIu64 " us (%" PRIu64 " ns each), %zu deletes in %" PRIu64 " us (%" PRIu64 " ns each), revoke of %zu in %" PRIu64 " us\n",
+        BENCHMARK_DERIVATIONS,
+        copy_time / 1000,
+        copy_time / BENCHMARK_DERIVATIONS,
+        deleted,
+        delete_time / 1000,
+        delete_time / deleted,
+        BENCHMARK_DERIVATIONS - deleted,
+        revoke_time / 1000
+    );
+}
+
+int main(void) {
+    UNITY_BEGIN();
+
+    RUN_TEST(derivation_benchmark);
+
+    return UNITY_END();
+}
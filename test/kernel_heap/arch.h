@@ -0,0 +1,14 @@
+#pragma once
+
+#include <stdint.h>
+
+// interrupts don't exist here, so disabling them is a no-op
+typedef uint16_t interrupt_status_t;
+
+static inline interrupt_status_t disable_interrupts(void) {
+    return 0;
+}
+
+static inline void restore_interrupt_status(interrupt_status_t status) {
+    (void) status;
+}
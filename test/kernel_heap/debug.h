@@ -0,0 +1,4 @@
+#pragma once
+
+// the heap's messages are discarded so that they don't drown out the test results
+#define printk(...)
@@ -0,0 +1,706 @@
+#include "capabilities.h"
+#include "heap.h"
+#include <string.h>
+#include "unity.h"
+#include "unity_internals.h"
+
+/// how big the simulated block of memory that the heap is made up of is
+#define MEMORY_SIZE (256 * 1024)
+
+/// where the simulated kernel is located in the simulated memory block
+#define KERNEL_START 0x400
+#define KERNEL_END 0x2400
+
+/// the maximum number of objects that can be allocated by a test at once
+#define MAX_OBJECTS 512
+
+/// \brief mirrors the free list links that heap.c stores in available blocks
+///
+/// these aren't exposed by heap.h since nothing outside of the heap should touch them
+struct free_list_links {
+    struct heap_header *prev;
+    struct heap_header *next;
+};
+
+/// an object allocated on the heap by a test
+struct object {
+    /// the capability that owns this object. its resource is kept up to date by the heap when the object is moved
+    struct capability capability;
+    /// how many bytes of this object have been filled with a pattern
+    size_t size;
+    /// the value used to generate this object's pattern
+    uint8_t pattern;
+    /// how many times this object is currently locked
+    uint8_t pins;
+};
+
+static uint8_t memory[MEMORY_SIZE] __attribute__((aligned(16)));
+static struct heap heap;
+static struct object objects[MAX_OBJECTS];
+
+/// how much memory the heap considers used that isn't in any of its blocks (i.e. the part of the kernel that's below the start of the heap)
+static size_t used_outside_blocks;
+
+/// how much memory the heap considers used once it's been initialized, which is just the memory taken up by the simulated kernel
+static size_t initial_used_memory;
+
+/// the state of the pseudo-random number generator used by the fuzzer
+static uint32_t random_state;
+
+/// xorshift32, which is used instead of rand() so that results are the same everywhere
+static uint32_t next_random(void) {
+    random_state ^= random_state << 13;
+    random_state ^= random_state >> 17;
+    random_state ^= random_state << 5;
+    return random_state;
+}
+
+static size_t random_below(size_t limit) {
+    return (size_t) next_random() % limit;
+}
+
+/// called by the heap when a block belonging to a capability is moved.
+/// this stands in for the version in capabilities.c, since there's no capability space here
+void update_capability_resource(struct capability *capability, void *new_resource_address) {
+    capability->resource = new_resource_address;
+}
+
+static struct free_list_links *links_of(struct heap_header *header) {
+    return (struct free_list_links *) ((uint8_t *) header + sizeof(struct heap_header));
+}
+
+static size_t size_class(size_t size) {
+    size_t class = 0;
+
+    for (; size > 1; size >>= 1, class ++);
+
+    return class;
+}
+
+/// \brief sets up the heap with the given number of regions
+///
+/// the first region contains the simulated kernel. any further regions are split off of the end of the simulated memory block, with gaps between them
+static void init_heap(size_t num_regions, bool use_caches) {
+    memset(memory, 0, sizeof(memory));
+    memset(objects, 0, sizeof(objects));
+
+    const size_t region_size = (MEMORY_SIZE / num_regions) & ~(size_t) 3;
+
+    struct init_block init_block = {
+        .kernel_start = memory + KERNEL_START,
+        .kernel_end = memory + KERNEL_END,
+        .memory_start = memory,
+        .memory_end = memory + region_size
+    };
+    heap_init(&heap, &init_block);
+
+    for (size_t i = 1; i < num_regions; i ++) {
+        heap_add_memory_block(&heap, memory + region_size * i + 256, memory + region_size * (i + 1));
+    }
+
+    TEST_ASSERT(heap.num_regions == num_regions);
+
+    if (use_caches) {
+        // these are the sizes that small untyped objects are rounded up to
+        for (size_t size = SMALL_UNTYPED_MIN_SIZE; size <= SMALL_UNTYPED_MAX_SIZE; size <<= 1) {
+            TEST_ASSERT(heap_add_cache(&heap, size));
+        }
+    }
+
+    size_t used_in_blocks = 0;
+
+    for (size_t i = 0; i < heap.num_regions; i ++) {
+        for (struct heap_header *header = heap.regions[i].base; (void *) header < heap.regions[i].end; header = (struct heap_header *) ((uint8_t *) header + header->size)) {
+            if (GET_KIND(header) != KIND_AVAILABLE) {
+                used_in_blocks += header->size;
+            }
+        }
+    }
+
+    initial_used_memory = heap.used_memory;
+    used_outside_blocks = heap.used_memory - used_in_blocks;
+}
+
+/// \brief checks that the heap is consistent
+///
+/// every region must be completely covered by a chain of blocks with correct back links, the compaction cursor must point to one of those blocks,
+/// and every available block must be in exactly one free list or object cache that matches its size
+static void check_heap(void) {
+    size_t used_memory = used_outside_blocks;
+    size_t available_blocks = 0;
+    bool found_cursor = heap.compact_cursor == NULL;
+
+    for (size_t i = 0; i < heap.num_regions; i ++) {
+        const struct heap_region *region = &heap.regions[i];
+        struct heap_header *prev = NULL;
+        struct heap_header *header = region->base;
+
+        TEST_ASSERT_MESSAGE((void *) header >= region->start, "region's first block is outside of it");
+
+        while ((void *) header < region->end) {
+            TEST_ASSERT_MESSAGE(((size_t) header & 3) == 0, "block isn't aligned");
+            TEST_ASSERT_MESSAGE(header->prev == prev, "block doesn't point to the block before it");
+            TEST_ASSERT_MESSAGE(header->size >= sizeof(struct heap_header) + sizeof(struct free_list_links), "block is too small to be freed");
+            TEST_ASSERT_MESSAGE((header->size & 3) == 0, "block size isn't aligned");
+            TEST_ASSERT_MESSAGE((uint8_t *) header + header->size <= (uint8_t *) region->end, "block runs past the end of its region");
+
+            if (GET_KIND(header) == KIND_AVAILABLE) {
+                available_blocks ++;
+            } else {
+                TEST_ASSERT_MESSAGE((header->flags & FLAG_CACHED) == 0, "allocated block is marked as cached");
+                used_memory += header->size;
+            }
+
+            if (header == heap.compact_cursor) {
+                found_cursor = true;
+            }
+
+            prev = header;
+            header = (struct heap_header *) ((uint8_t *) header + header->size);
+        }
+
+        TEST_ASSERT_MESSAGE((void *) header == region->end, "blocks don't end at the end of their region");
+    }
+
+    TEST_ASSERT_MESSAGE(found_cursor, "compaction cursor doesn't point to a block");
+
+    TEST_ASSERT_MESSAGE(heap.stats.largest_critical_copy <= HEAP_MOVE_CHUNK_SIZE, "interrupts were disabled for longer than one chunk while moving a block");
+
+    TEST_ASSERT_MESSAGE(used_memory == heap.used_memory, "used memory doesn't match the blocks in the heap");
+
+    size_t listed_blocks = 0;
+
+    for (size_t class = 0; class < HEAP_SIZE_CLASSES; class ++) {
+        TEST_ASSERT_MESSAGE((heap.free_lists[class] != NULL) == ((heap.free_list_bitmap & ((size_t) 1 << class)) != 0), "free list bitmap doesn't match free lists");
+
+        size_t count = 0;
+        struct heap_header *prev = NULL;
+
+        for (struct heap_header *header = heap.free_lists[class]; header != NULL; header = links_of(header)->next) {
+            TEST_ASSERT_MESSAGE(GET_KIND(header) == KIND_AVAILABLE, "allocated block is in a free list");
+            TEST_ASSERT_MESSAGE((header->flags & FLAG_CACHED) == 0, "cached block is in a free list");
+            TEST_ASSERT_MESSAGE(size_class(header->size) == class, "block is in the wrong free list");
+            TEST_ASSERT_MESSAGE(links_of(header)->prev == prev, "free list is broken");
+            prev = header;
+            count ++;
+        }
+
+        TEST_ASSERT_MESSAGE(count == heap.stats.free_blocks[class], "free block histogram doesn't match free lists");
+        listed_blocks += count;
+    }
+
+    size_t cached_blocks = 0;
+
+    for (size_t i = 0; i < heap.num_caches; i ++) {
+        size_t count = 0;
+        struct heap_header *prev = NULL;
+
+        for (struct heap_header *header = heap.caches[i].blocks; header != NULL; header = links_of(header)->next) {
+            TEST_ASSERT_MESSAGE(GET_KIND(header) == KIND_AVAILABLE, "allocated block is in an object cache");
+            TEST_ASSERT_MESSAGE((header->flags & FLAG_CACHED) != 0, "block in object cache isn't marked as cached");
+            TEST_ASSERT_MESSAGE(header->size == heap.caches[i].block_size, "block is in the wrong object cache");
+            TEST_ASSERT_MESSAGE(links_of(header)->prev == prev, "object cache is broken");
+            prev = header;
+            count ++;
+        }
+
+        TEST_ASSERT_MESSAGE(count == heap.caches[i].count, "object cache count is wrong");
+        cached_blocks += count;
+    }
+
+    TEST_ASSERT_MESSAGE(cached_blocks == heap.stats.cached_blocks, "cached block count is wrong");
+    TEST_ASSERT_MESSAGE(listed_blocks + cached_blocks == available_blocks, "not every available block is in a free list or object cache");
+}
+
+static void fill_object(struct object *object) {
+    uint8_t *data = object->capability.resource;
+
+    for (size_t i = 0; i < object->size; i ++) {
+        data[i] = (uint8_t) (object->pattern + i * 7);
+    }
+}
+
+static void check_object(const struct object *object) {
+    const uint8_t *data = object->capability.resource;
+
+    TEST_ASSERT_MESSAGE(heap_sizeof(object->capability.resource) >= object->size, "object is smaller than it should be");
+
+    for (size_t i = 0; i < object->size; i ++) {
+        TEST_ASSERT_MESSAGE(data[i] == (uint8_t) (object->pattern + i * 7), "object contents were corrupted");
+    }
+}
+
+/// \brief allocates an object, setting it up to be updated when it's moved
+///
+/// if `use_capability` is true, the object is updated through its capability like an untyped object would be. otherwise its address is updated directly
+static bool alloc_object(struct object *object, size_t size, bool pinned, bool use_capability) {
+    void *ptr = pinned ? heap_alloc_pinned(&heap, size) : heap_alloc(&heap, size);
+
+    if (ptr == NULL) {
+        return false;
+    }
+
+    object->capability.resource = ptr;
+    object->size = size;
+    object->pattern = (uint8_t) next_random();
+    object->pins = 1;
+
+    if (use_capability) {
+        heap_set_update_capability(ptr, &object->capability);
+    } else {
+        heap_set_update_absolute(ptr, &object->capability.resource);
+    }
+
+    fill_object(object);
+
+    return true;
+}
+
+static void free_object(struct object *object) {
+    heap_free(&heap, object->capability.resource);
+    object->capability.resource = NULL;
+}
+
+/// checks that every allocated object still has its contents intact
+static void check_objects(void) {
+    for (size_t i = 0; i < MAX_OBJECTS; i ++) {
+        if (objects[i].capability.resource != NULL) {
+            check_object(&objects[i]);
+        }
+    }
+}
+
+/// \brief runs a number of random operations on the heap, checking its consistency after each one
+///
+/// allocations of many different sizes are made, objects are locked, unlocked, resized and freed at random,
+/// and the heap is compacted every so often. the contents of every object are checked before it's touched
+static void fuzz(uint32_t seed, size_t num_regions, bool use_caches, size_t operations) {
+    random_state = seed;
+    init_heap(num_regions, use_caches);
+    check_heap();
+
+    for (size_t i = 0; i < operations; i ++) {
+        struct object *object = &objects[random_below(MAX_OBJECTS)];
+        size_t choice = random_below(100);
+
+        if (object->capability.resource == NULL) {
+            if (choice >= 70) {
+                continue;
+            }
+
+            size_t size;
+
+            switch (random_below(4)) {
+            case 0:
+                size = random_below(4096);
+                break;
+            case 1:
+                size = (size_t) SMALL_UNTYPED_MIN_SIZE << random_below(4);
+                break;
+            default:
+                size = random_below(200);
+                break;
+            }
+
+            bool pinned = random_below(10) == 0;
+
+            if (alloc_object(object, size, pinned, random_below(2) == 0) && !pinned && random_below(4) != 0) {
+                heap_unlock(object->capability.resource);
+                object->pins = 0;
+            }
+        } else {
+            check_object(object);
+
+            if (choice < 35) {
+                free_object(object);
+            } else if (choice < 45 && object->pins > 0) {
+                void *old_ptr = object->capability.resource;
+                size_t new_size = random_below(8) == 0 ? random_below(4096) : random_below(200);
+                void *new_ptr = heap_realloc(&heap, old_ptr, new_size);
+
+                if (new_ptr == NULL) {
+                    TEST_ASSERT_MESSAGE(object->capability.resource == old_ptr, "failed resize changed the object's address");
+                    check_object(object);
+                } else {
+                    TEST_ASSERT_MESSAGE(object->capability.resource == new_ptr, "resized object's reference wasn't updated");
+
+                    if (new_size < object->size) {
+                        object->size = new_size;
+                    }
+
+                    check_object(object);
+                    object->size = new_size;
+                    fill_object(object);
+                }
+            } else if (choice < 48) {
+                for (size_t steps = random_below(8); steps > 0 && heap_compact_step(&heap); steps --);
+            } else if (choice < 60) {
+                // locks are nested sometimes, the same way that looking up a capability while it's in use does
+                if (object->pins > 0 && random_below(3) != 0) {
+                    heap_unlock(object->capability.resource);
+                    object->pins --;
+                } else {
+                    TEST_ASSERT(heap_lock(object->capability.resource));
+                    object->pins ++;
+                }
+            }
+        }
+
+        if (object->capability.resource != NULL) {
+            const struct heap_header *header = (struct heap_header *) ((uint8_t *) object->capability.resource - sizeof(struct heap_header));
+
+            TEST_ASSERT_MESSAGE(header->pins == object->pins, "object has the wrong number of pins");
+            TEST_ASSERT_MESSAGE(GET_KIND(header) == (object->pins > 0 ? KIND_IMMOVABLE : KIND_MOVABLE), "object is movable while it's locked or locked while it isn't");
+        }
+
+        check_heap();
+    }
+
+    check_objects();
+
+    // once everything is unlocked, compacting the heap should leave no available block directly before a movable one
+    for (size_t i = 0; i < MAX_OBJECTS; i ++) {
+        for (; objects[i].capability.resource != NULL && objects[i].pins > 0; objects[i].pins --) {
+            heap_unlock(objects[i].capability.resource);
+        }
+    }
+
+    while (heap_compact_step(&heap)) {
+        check_heap();
+    }
+
+    for (size_t i = 0; i < heap.num_regions; i ++) {
+        for (struct heap_header *header = heap.regions[i].base; (void *) header < heap.regions[i].end; header = (struct heap_header *) ((uint8_t *) header + header->size)) {
+            struct heap_header *next = (struct heap_header *) ((uint8_t *) header + header->size);
+
+            TEST_ASSERT_MESSAGE(
+                !(GET_KIND(header) == KIND_AVAILABLE && (void *) next < heap.regions[i].end && GET_KIND(next) == KIND_MOVABLE && next->size <= HEAP_COMPACT_MAX_MOVE),
+                "heap wasn't fully compacted"
+            );
+        }
+    }
+
+    check_objects();
+
+    for (size_t i = 0; i < MAX_OBJECTS; i ++) {
+        if (objects[i].capability.resource != NULL) {
+            free_object(&objects[i]);
+            check_heap();
+        }
+    }
+
+    TEST_ASSERT_MESSAGE(heap.used_memory == initial_used_memory, "memory was leaked");
+}
+
+void setUp(void) {
+}
+
+void tearDown(void) {
+}
+
+static void fuzz_single_region(void) {
+    for (uint32_t seed = 1; seed <= 8; seed ++) {
+        fuzz(seed, 1, false, 20000);
+    }
+}
+
+static void fuzz_object_caches(void) {
+    for (uint32_t seed = 1; seed <= 8; seed ++) {
+        fuzz(seed * 7919, 1, true, 20000);
+    }
+}
+
+static void fuzz_multiple_regions(void) {
+    for (uint32_t seed = 1; seed <= 8; seed ++) {
+        fuzz(seed * 104729, 3, seed % 2 == 0, 20000);
+    }
+}
+
+/// checks that a block only becomes movable once every lock on it has been undone, and that permanently locked memory stays locked
+static void nested_locks(void) {
+    init_heap(1, false);
+
+    void *ptr = heap_alloc(&heap, 64);
+    TEST_ASSERT(ptr != NULL);
+
+    const struct heap_header *header = (struct heap_header *) ((uint8_t *) ptr - sizeof(struct heap_header));
+    TEST_ASSERT(GET_KIND(header) == KIND_IMMOVABLE && header->pins == 1);
+
+    TEST_ASSERT(heap_lock(ptr));
+    TEST_ASSERT(heap_lock(ptr));
+    TEST_ASSERT(header->pins == 3);
+
+    heap_unlock(ptr);
+    heap_unlock(ptr);
+    TEST_ASSERT(GET_KIND(header) == KIND_IMMOVABLE);
+
+    heap_unlock(ptr);
+    TEST_ASSERT(GET_KIND(header) == KIND_MOVABLE && header->pins == 0);
+
+    // unbalanced unlocks don't do anything
+    heap_unlock(ptr);
+    TEST_ASSERT(GET_KIND(header) == KIND_MOVABLE && header->pins == 0);
+
+    // a block can't be locked more times than its pin count can hold
+    for (size_t i = 0; i < UINT8_MAX; i ++) {
+        TEST_ASSERT(heap_lock(ptr));
+    }
+
+    TEST_ASSERT_FALSE(heap_lock(ptr));
+
+    for (size_t i = 0; i < UINT8_MAX; i ++) {
+        heap_unlock(ptr);
+    }
+
+    TEST_ASSERT(GET_KIND(header) == KIND_MOVABLE);
+
+    // the kernel can't be locked or unlocked, since it isn't an allocation
+    void *kernel = memory + KERNEL_START;
+    TEST_ASSERT_FALSE(heap_lock(kernel));
+    heap_unlock(kernel);
+    TEST_ASSERT(GET_KIND(((struct heap_header *) ((uint8_t *) kernel - sizeof(struct heap_header)))) == KIND_IMMOVABLE);
+
+    heap_free(&heap, ptr);
+    check_heap();
+}
+
+/// checks that a movable block can be moved into another region to make room for an allocation when sliding blocks around can't
+static void evict_between_regions(void) {
+    init_heap(2, false);
+
+    size_t count = 0;
+
+    for (; count < MAX_OBJECTS && alloc_object(&objects[count], 1024, false, true); count ++);
+
+    TEST_ASSERT(count < MAX_OBJECTS);
+
+    // find two neighboring objects in the second region and an object in the first region that isn't next to either end of it
+    const uint8_t *second_region = heap.regions[1].start;
+    size_t first = 0;
+    size_t hole = 0;
+
+    for (size_t i = 1; i < count - 1; i ++) {
+        if ((uint8_t *) objects[i].capability.resource < second_region) {
+            hole = i;
+        } else if (first == 0) {
+            first = i + 1;
+        }
+    }
+
+    TEST_ASSERT(hole != 0 && first != 0);
+
+    struct object *freed = &objects[first];
+    struct object *movable = &objects[first + 1];
+    void *freed_ptr = freed->capability.resource;
+    TEST_ASSERT((uint8_t *) movable->capability.resource == (uint8_t *) freed_ptr + heap_sizeof(freed_ptr) + sizeof(struct heap_header));
+
+    free_object(&objects[hole]);
+    free_object(freed);
+    heap_unlock(movable->capability.resource);
+    movable->pins = 0;
+    check_heap();
+
+    // neither hole is big enough on its own and there's nothing else to slide, so the movable block has to go to the other region
+    struct object *big = &objects[count];
+    TEST_ASSERT(alloc_object(big, 1900, false, true));
+    TEST_ASSERT(big->capability.resource == freed_ptr);
+    TEST_ASSERT((uint8_t *) movable->capability.resource < second_region);
+    check_heap();
+    check_objects();
+}
+
+/// checks that a block of memory that fills the gap between two regions joins them together
+static void bridged_regions(void) {
+    init_heap(2, false);
+
+    uint8_t *gap_start = heap.regions[0].end;
+    uint8_t *gap_end = heap.regions[1].start;
+    size_t total_memory = heap.total_memory;
+
+    heap_add_memory_block(&heap, gap_start, gap_end);
+
+    TEST_ASSERT(heap.num_regions == 1);
+    TEST_ASSERT(heap.regions[0].end == memory + MEMORY_SIZE);
+    TEST_ASSERT(heap.total_memory == total_memory + (size_t) (gap_end - gap_start));
+    check_heap();
+
+    // the available space on both sides of the gap is merged into one block
+    void *ptr = heap_alloc(&heap, MEMORY_SIZE / 2 + 1024);
+    TEST_ASSERT(ptr != NULL);
+    heap_free(&heap, ptr);
+    check_heap();
+}
+
+/// checks that compaction keeps track of blocks that it's kept from moving by locks
+static void pinned_encounters(void) {
+    init_heap(1, false);
+
+    void *hole = heap_alloc(&heap, 64);
+    void *locked = heap_alloc(&heap, 64);
+    void *movable = heap_alloc(&heap, 64);
+    TEST_ASSERT(hole != NULL && locked != NULL && movable != NULL);
+
+    heap_unlock(movable);
+    heap_free(&heap, hole);
+
+    TEST_ASSERT_FALSE(heap_compact_step(&heap));
+    TEST_ASSERT(heap.stats.pinned_encounters == 1);
+    TEST_ASSERT_FALSE(heap_compact_step(&heap));
+    TEST_ASSERT(heap.stats.pinned_encounters == 2);
+
+    // once the block is unlocked it can be moved, and compaction doesn't count it anymore
+    heap_unlock(locked);
+    TEST_ASSERT(heap_compact_step(&heap));
+    TEST_ASSERT(heap.stats.pinned_encounters == 2);
+
+    check_heap();
+}
+
+/// checks that compaction leaves blocks that would take too long to move in one step where they are
+static void compaction_skips_large_blocks(void) {
+    init_heap(1, false);
+
+    void *first_hole = heap_alloc(&heap, 64);
+    void *large = heap_alloc(&heap, HEAP_COMPACT_MAX_MOVE);
+    void *first_locked = heap_alloc(&heap, 64);
+    void *second_hole = heap_alloc(&heap, 64);
+    void *small = heap_alloc(&heap, 64);
+    void *second_locked = heap_alloc(&heap, 64);
+    TEST_ASSERT(first_hole != NULL && large != NULL && first_locked != NULL && second_hole != NULL && small != NULL && second_locked != NULL);
+
+    heap_unlock(large);
+    heap_unlock(small);
+    heap_free(&heap, first_hole);
+    heap_free(&heap, second_hole);
+
+    // only the small block is moved, and the large one stays behind the hole in front of it
+    TEST_ASSERT(heap_compact_step(&heap));
+    TEST_ASSERT_FALSE(heap_compact_step(&heap));
+    TEST_ASSERT(heap.stats.relocations == 1);
+    const struct heap_header *first_hole_header = (struct heap_header *) ((uint8_t *) first_hole - sizeof(struct heap_header));
+    const struct heap_header *large_header = (struct heap_header *) ((uint8_t *) large - sizeof(struct heap_header));
+    const struct heap_header *second_hole_header = (struct heap_header *) ((uint8_t *) second_hole - sizeof(struct heap_header));
+    TEST_ASSERT(GET_KIND(first_hole_header) == KIND_AVAILABLE);
+    TEST_ASSERT(GET_KIND(large_header) == KIND_MOVABLE);
+    TEST_ASSERT(GET_KIND(second_hole_header) == KIND_MOVABLE);
+    check_heap();
+}
+
+/// checks that compaction only takes blocks out of object caches when they're the available block being filled in
+static void compaction_keeps_caches(void) {
+    init_heap(1, true);
+
+    void *first = heap_alloc(&heap, SMALL_UNTYPED_MIN_SIZE);
+    void *second = heap_alloc(&heap, SMALL_UNTYPED_MIN_SIZE);
+    void *hole = heap_alloc(&heap, 200);
+    void *movable = heap_alloc(&heap, 64);
+    TEST_ASSERT(first != NULL && second != NULL && hole != NULL && movable != NULL);
+
+    struct heap_header *first_header = (struct heap_header *) ((uint8_t *) first - sizeof(struct heap_header));
+
+    heap_unlock(movable);
+    heap_free(&heap, first);
+    heap_free(&heap, hole);
+    TEST_ASSERT(heap.stats.cached_blocks == 1);
+
+    // the movable block fills in the hole, and the cached block in front of a locked block is left where it is
+    TEST_ASSERT(heap_compact_step(&heap));
+    TEST_ASSERT_FALSE(heap_compact_step(&heap));
+    TEST_ASSERT(heap.stats.cached_blocks == 1);
+    TEST_ASSERT((first_header->flags & FLAG_CACHED) != 0);
+    check_heap();
+
+    // once the movable block directly follows a cached block, that block is taken out of its cache to be filled in
+    heap_free(&heap, second);
+    TEST_ASSERT(heap.stats.cached_blocks == 2);
+    TEST_ASSERT(heap_compact_step(&heap));
+    TEST_ASSERT(heap.stats.cached_blocks == 1);
+    TEST_ASSERT((first_header->flags & FLAG_CACHED) != 0);
+    check_heap();
+}
+
+static size_t watermark_notifications;
+
+static void count_watermark_notification(void *data) {
+    TEST_ASSERT(data == &watermark_notifications);
+    watermark_notifications ++;
+}
+
+static void watermark(void) {
+    init_heap(1, false);
+    watermark_notifications = 0;
+
+    size_t available = heap.total_memory - heap.used_memory;
+
+    // notifications are only sent once the heap drops below the watermark, and only once
+    heap_set_watermark(&heap, available - 1024, 0, count_watermark_notification, &watermark_notifications);
+    heap_deliver_watermark(&heap);
+    TEST_ASSERT(watermark_notifications == 0);
+
+    void *small = heap_alloc(&heap, 64);
+    TEST_ASSERT(small != NULL);
+    heap_deliver_watermark(&heap);
+    TEST_ASSERT(watermark_notifications == 0);
+
+    // the allocation that crosses the watermark doesn't send the notification itself, that waits until it's delivered
+    void *large = heap_alloc(&heap, 2048);
+    TEST_ASSERT(large != NULL);
+    TEST_ASSERT(watermark_notifications == 0);
+    TEST_ASSERT(heap.watermark.pending);
+    heap_deliver_watermark(&heap);
+    TEST_ASSERT(watermark_notifications == 1);
+
+    void *another = heap_alloc(&heap, 2048);
+    TEST_ASSERT(another != NULL);
+    heap_deliver_watermark(&heap);
+    TEST_ASSERT(watermark_notifications == 1);
+
+    // setting a watermark that the heap is already below sends a notification as soon as it's delivered
+    heap_set_watermark(&heap, available - 1024, 0, count_watermark_notification, &watermark_notifications);
+    TEST_ASSERT(watermark_notifications == 1);
+    heap_deliver_watermark(&heap);
+    TEST_ASSERT(watermark_notifications == 2);
+
+    heap_free(&heap, large);
+    heap_free(&heap, another);
+
+    // failed allocations always send a notification
+    heap_set_watermark(&heap, 0, 0, count_watermark_notification, &watermark_notifications);
+    TEST_ASSERT(heap_alloc(&heap, MEMORY_SIZE * 2) == NULL);
+    heap_deliver_watermark(&heap);
+    TEST_ASSERT(watermark_notifications == 3);
+
+    // the size of the largest free block can be watched too
+    heap_set_watermark(&heap, 0, heap.total_memory, count_watermark_notification, &watermark_notifications);
+    heap_deliver_watermark(&heap);
+    TEST_ASSERT(watermark_notifications == 4);
+
+    // watermarks can be cleared, even if they've been crossed and haven't been delivered yet
+    heap_set_watermark(&heap, available, 0, count_watermark_notification, &watermark_notifications);
+    heap_set_watermark(&heap, available, 0, NULL, NULL);
+    TEST_ASSERT(heap_alloc(&heap, MEMORY_SIZE * 2) == NULL);
+    heap_deliver_watermark(&heap);
+    TEST_ASSERT(watermark_notifications == 4);
+
+    heap_free(&heap, small);
+    check_heap();
+}
+
+int main(void) {
+    UNITY_BEGIN();
+
+    // random operations with the heap checked after every one
+    RUN_TEST(fuzz_single_region);
+    RUN_TEST(fuzz_object_caches);
+    RUN_TEST(fuzz_multiple_regions);
+    RUN_TEST(evict_between_regions);
+    RUN_TEST(bridged_regions);
+
+    RUN_TEST(nested_locks);
+    RUN_TEST(pinned_encounters);
+    RUN_TEST(compaction_skips_large_blocks);
+    RUN_TEST(compaction_keeps_caches);
+    RUN_TEST(watermark);
+
+    return UNITY_END();
+}
@@ -0,0 +1 @@
+../kernel_heap/arch.h
\ No newline at end of file
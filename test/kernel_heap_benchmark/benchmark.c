@@ -0,0 +1,427 @@
+#include "capabilities.h"
+#include "heap.h"
+#include <inttypes.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include "unity.h"
+#include "unity_internals.h"
+
+/// how big the simulated block of memory that the heap is made up of is
+#define MEMORY_SIZE (256 * 1024)
+
+/// where the simulated kernel is located in the simulated memory block
+#define KERNEL_START 0x400
+#define KERNEL_END 0x2400
+
+/// the maximum number of objects that can be allocated by a trace at once
+#define MAX_OBJECTS 512
+
+/// the maximum number of operations in a trace
+#define MAX_TRACE_LENGTH 65536
+
+static uint8_t memory[MEMORY_SIZE] __attribute__((aligned(16)));
+static struct heap heap;
+
+/// the capabilities that own the objects allocated by a trace, which are updated by the heap when the objects are moved just like untyped objects are
+static struct capability objects[MAX_OBJECTS];
+
+/// the state of the pseudo-random number generator used to generate traces
+static uint32_t random_state;
+
+/// xorshift32, which is used instead of rand() so that traces are the same everywhere
+static uint32_t next_random(void) {
+    random_state ^= random_state << 13;
+    random_state ^= random_state >> 17;
+    random_state ^= random_state << 5;
+    return random_state;
+}
+
+static size_t random_below(size_t limit) {
+    return (size_t) next_random() % limit;
+}
+
+/// called by the heap when a block belonging to a capability is moved.
+/// this stands in for the version in capabilities.c, since there's no capability space here
+void update_capability_resource(struct capability *capability, void *new_resource_address) {
+    capability->resource = new_resource_address;
+}
+
+/// sets up the heap the same way the kernel would, with object caches for the sizes that small untyped objects are rounded up to
+static void init_heap(void) {
+    memset(memory, 0, sizeof(memory));
+    memset(objects, 0, sizeof(objects));
+
+    struct init_block init_block = {
+        .kernel_start = memory + KERNEL_START,
+        .kernel_end = memory + KERNEL_END,
+        .memory_start = memory,
+        .memory_end = memory + MEMORY_SIZE
+    };
+    heap_init(&heap, &init_block);
+
+    for (size_t size = SMALL_UNTYPED_MIN_SIZE; size <= SMALL_UNTYPED_MAX_SIZE; size <<= 1) {
+        TEST_ASSERT(heap_add_cache(&heap, size));
+    }
+}
+
+/// allocates an object, leaving it locked
+static bool alloc_object(struct capability *object, size_t size, bool pinned) {
+    void *ptr = pinned ? heap_alloc_pinned(&heap, size) : heap_alloc(&heap, size);
+
+    if (ptr == NULL) {
+        return false;
+    }
+
+    object->resource = ptr;
+    heap_set_update_capability(ptr, object);
+
+    return true;
+}
+
+void setUp(void) {
+}
+
+void tearDown(void) {
+}
+
+/// the operations that can be performed in an allocation trace
+enum trace_operation {
+    /// allocates an object, leaving it locked
+    TRACE_ALLOC,
+    /// allocates an object that stays locked for its entire lifetime
+    TRACE_ALLOC_PINNED,
+    TRACE_LOCK,
+    TRACE_UNLOCK,
+    /// resizes a locked object to the given size
+    TRACE_REALLOC,
+    TRACE_FREE,
+    /// performs a single step of heap compaction, as the kernel would when the system is idle
+    TRACE_COMPACT
+};
+
+struct trace_entry {
+    uint8_t operation;
+    uint16_t object;
+    uint16_t size;
+};
+
+struct trace {
+    const char *name;
+    size_t length;
+    struct trace_entry entries[MAX_TRACE_LENGTH];
+};
+
+static struct trace trace;
+
+/// objects in a trace that are currently allocated, used when recording traces
+static bool trace_allocated[MAX_OBJECTS];
+
+/// the sizes of objects in a trace, used when recording traces
+static size_t trace_sizes[MAX_OBJECTS];
+
+static void record(uint8_t operation, size_t object, size_t size) {
+    TEST_ASSERT(trace.length < MAX_TRACE_LENGTH);
+
+    trace.entries[trace.length ++] = (struct trace_entry) {
+        .operation = operation,
+        .object = (uint16_t) object,
+        .size = (uint16_t) size
+    };
+
+    if (operation == TRACE_ALLOC || operation == TRACE_ALLOC_PINNED) {
+        trace_allocated[object] = true;
+        trace_sizes[object] = size;
+    } else if (operation == TRACE_REALLOC) {
+        trace_sizes[object] = size;
+    } else if (operation == TRACE_FREE) {
+        trace_allocated[object] = false;
+    }
+}
+
+/// finds an object slot in a trace that isn't in use in the range [start, end), or returns `end` if they're all in use
+static size_t unused_object(size_t start, size_t end) {
+    for (size_t i = start; i < end; i ++) {
+        if (!trace_allocated[i]) {
+            return i;
+        }
+    }
+
+    return end;
+}
+
+/// finds a random object slot in a trace that's in use in the range [start, end), or returns `end` if there aren't any
+static size_t used_object(size_t start, size_t end) {
+    size_t offset = random_below(end - start);
+
+    for (size_t i = 0; i < end - start; i ++) {
+        size_t index = start + (offset + i) % (end - start);
+
+        if (trace_allocated[index]) {
+            return index;
+        }
+    }
+
+    return end;
+}
+
+/// accesses a movable object the way a server accesses an untyped object, by locking it, using it, and then unlocking it
+static void record_access(size_t object) {
+    record(TRACE_LOCK, object, 0);
+    record(TRACE_UNLOCK, object, 0);
+}
+
+static void start_trace(const char *name) {
+    memset(trace_allocated, 0, sizeof(trace_allocated));
+    trace.name = name;
+    trace.length = 0;
+}
+
+/// \brief synthesizes a trace modelled on the way vfs_server uses the heap
+///
+/// vfs_server keeps all of its state in small untyped objects (directory info, mount points, namespaces, per-process data)
+/// which stay unlocked unless a message is being handled, and which are locked and unlocked again every time they're accessed.
+/// directory info objects come and go as directories are opened and closed, while namespaces and mount points are long-lived
+static void record_vfs_server_trace(void) {
+    start_trace("vfs_server");
+    random_state = 0x5eed0001;
+
+    // the id bitmaps and capability nodes allocated by init_vfs_structures, which last forever
+    for (size_t i = 0; i < 6; i ++) {
+        record(TRACE_ALLOC, i, i % 2 == 0 ? 16 : 32 * 16);
+        record(TRACE_UNLOCK, i, 0);
+    }
+
+    // namespaces and mount points
+    for (size_t i = 6; i < 16; i ++) {
+        record(TRACE_ALLOC, i, i < 8 ? 24 : 40);
+        record(TRACE_UNLOCK, i, 0);
+    }
+
+    for (size_t message = 0; message < 4000; message ++) {
+        size_t choice = random_below(100);
+
+        if (choice < 30) {
+            // FD_OPEN on a directory: allocate its directory info, fill it in, and look at its namespace
+            size_t object = unused_object(64, 320);
+
+            if (object < 320) {
+                record(TRACE_ALLOC, object, 48);
+                record_access(6 + random_below(2));
+                record(TRACE_UNLOCK, object, 0);
+            }
+        } else if (choice < 55) {
+            // FD_CLOSE
+            size_t object = used_object(64, 320);
+
+            if (object < 320) {
+                record_access(object);
+                record(TRACE_FREE, object, 0);
+            }
+        } else if (choice < 90) {
+            // FD_READ/FD_STAT: look up the directory info, then whatever mount points it refers to
+            size_t object = used_object(64, 320);
+
+            if (object < 320) {
+                record(TRACE_LOCK, object, 0);
+                record_access(8 + random_below(8));
+                record_access(8 + random_below(8));
+                record(TRACE_UNLOCK, object, 0);
+            }
+        } else if (choice < 97) {
+            // VFS_NEW_PROCESS: allocate the new process's data and bump its namespace's reference count
+            size_t object = unused_object(16, 64);
+
+            if (object < 64) {
+                record(TRACE_ALLOC, object, 16);
+                record_access(6 + random_below(2));
+                record(TRACE_UNLOCK, object, 0);
+            }
+        } else {
+            // process exit
+            size_t object = used_object(16, 64);
+
+            if (object < 64) {
+                record(TRACE_FREE, object, 0);
+            }
+        }
+
+        if (message % 64 == 0) {
+            record(TRACE_COMPACT, 0, 0);
+        }
+    }
+}
+
+/// \brief synthesizes a trace modelled on the way process_server uses the heap
+///
+/// every process started by process_server gets a thread, a capability node and an IPC buffer which are mostly unlocked,
+/// along with a large data segment that it runs from and so stays locked for its whole life.
+/// processes exit in a random order, leaving holes between the long-lived locked segments of the ones still running
+static void record_process_server_trace(void) {
+    start_trace("process_server");
+    random_state = 0x5eed0002;
+
+    // each process uses 4 objects: its data segment, thread, capability node, and IPC buffer
+    const size_t max_processes = 24;
+    size_t running = 0;
+
+    for (size_t event = 0; event < 3000; event ++) {
+        size_t choice = random_below(100);
+
+        if (choice < 20 && running < max_processes) {
+            size_t process = unused_object(0, max_processes * 4) / 4;
+            size_t base = process * 4;
+
+            record(TRACE_ALLOC_PINNED, base, 1024 + random_below(8) * 1024);
+            record(TRACE_ALLOC, base + 1, 120);
+            record(TRACE_UNLOCK, base + 1, 0);
+            record(TRACE_ALLOC, base + 2, 16 * 32);
+            record(TRACE_UNLOCK, base + 2, 0);
+            record(TRACE_ALLOC, base + 3, 256);
+            record(TRACE_UNLOCK, base + 3, 0);
+            running ++;
+        } else if (choice < 40 && running > 0) {
+            size_t object = used_object(0, max_processes * 4);
+            size_t base = object - object % 4;
+
+            for (size_t i = 0; i < 4; i ++) {
+                record(TRACE_FREE, base + i, 0);
+            }
+
+            running --;
+        } else if (running > 0) {
+            // context switches and IPC touch a running process's thread and IPC buffer
+            size_t object = used_object(0, max_processes * 4);
+            size_t base = object - object % 4;
+
+            record_access(base + 1);
+            record_access(base + 3);
+
+            // loading a binary sometimes grows its data segment once its bss size is known
+            if (choice < 45 && trace_sizes[base] < 8192) {
+                record(TRACE_REALLOC, base, trace_sizes[base] + 512);
+            }
+        }
+
+        if (event % 32 == 0) {
+            record(TRACE_COMPACT, 0, 0);
+        }
+    }
+}
+
+/// results from replaying a trace
+struct trace_report {
+    size_t operations;
+    uint64_t total_nanoseconds;
+    uint64_t worst_allocation_nanoseconds;
+    /// the worst ratio of free memory that can't be used by the largest possible allocation to all free memory, in percent
+    size_t peak_fragmentation;
+    struct heap_stats stats;
+};
+
+static uint64_t now(void) {
+    struct timespec time;
+    clock_gettime(CLOCK_MONOTONIC, &time);
+    return (uint64_t) time.tv_sec * 1000000000 + (uint64_t) time.tv_nsec;
+}
+
+/// replays the current trace on a freshly initialized heap, measuring how long each operation takes
+static void replay(struct trace_report *report) {
+    init_heap();
+    memset(report, 0, sizeof(struct trace_report));
+
+    for (size_t i = 0; i < trace.length; i ++) {
+        const struct trace_entry *entry = &trace.entries[i];
+        struct capability *object = &objects[entry->object];
+        uint64_t start = now();
+
+        switch (entry->operation) {
+        case TRACE_ALLOC:
+        case TRACE_ALLOC_PINNED:
+            TEST_ASSERT_MESSAGE(alloc_object(object, entry->size, entry->operation == TRACE_ALLOC_PINNED), "allocation failed");
+            break;
+        case TRACE_LOCK:
+            TEST_ASSERT(heap_lock(object->resource));
+            break;
+        case TRACE_UNLOCK:
+            heap_unlock(object->resource);
+            break;
+        case TRACE_REALLOC:
+            TEST_ASSERT_MESSAGE(heap_realloc(&heap, object->resource, entry->size) != NULL, "resize failed");
+            break;
+        case TRACE_FREE:
+            heap_free(&heap, object->resource);
+            object->resource = NULL;
+            break;
+        case TRACE_COMPACT:
+            heap_compact_step(&heap);
+            break;
+        }
+
+        uint64_t elapsed = now() - start;
+        report->total_nanoseconds += elapsed;
+
+        if ((entry->operation == TRACE_ALLOC || entry->operation == TRACE_ALLOC_PINNED) && elapsed > report->worst_allocation_nanoseconds) {
+            report->worst_allocation_nanoseconds = elapsed;
+        }
+
+        struct heap_stats stats;
+        heap_get_stats(&heap, &stats);
+
+        size_t free_memory = stats.total_memory - stats.used_memory;
+
+        if (free_memory > 0) {
+            size_t fragmentation = 100 - stats.largest_free_block * 100 / free_memory;
+
+            if (fragmentation > report->peak_fragmentation) {
+                report->peak_fragmentation = fragmentation;
+            }
+        }
+    }
+
+    report->operations = trace.length;
+    heap_get_stats(&heap, &report->stats);
+}
+
+/// replays the current trace and reports how well the heap performed on it
+static void run_trace(void) {
+    struct trace_report report;
+
+    replay(&report);
+
+    TEST_ASSERT(report.stats.failed_allocations == 0);
+
+    printf(
+        "%s: %zu operations in %" PRIu64 " us (%" PRIu64 " operations/s), %zu relocations (%zu bytes), peak fragmentation %zu%%, worst allocation %" PRIu64 " ns, largest critical copy %zu bytes, %zu pinned encounters\n",
+        trace.name,
+        report.operations,
+        report.total_nanoseconds / 1000,
+        report.total_nanoseconds == 0 ? 0 : (uint64_t) report.operations * 1000000000 / report.total_nanoseconds,
+        report.stats.relocations,
+        report.stats.bytes_relocated,
+        report.peak_fragmentation,
+        report.worst_allocation_nanoseconds,
+        report.stats.largest_critical_copy,
+        report.stats.pinned_encounters
+    );
+}
+
+static void vfs_server_trace(void) {
+    record_vfs_server_trace();
+    run_trace();
+}
+
+static void process_server_trace(void) {
+    record_process_server_trace();
+    run_trace();
+}
+
+int main(void) {
+    UNITY_BEGIN();
+
+    // the traces are synthesized from how each server uses the heap, rather than being recorded from a running system
+    RUN_TEST(vfs_server_trace);
+    RUN_TEST(process_server_trace);
+
+    return UNITY_END();
+}
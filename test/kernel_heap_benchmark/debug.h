@@ -0,0 +1 @@
+../kernel_heap/debug.h
\ No newline at end of file
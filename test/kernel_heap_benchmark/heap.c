@@ -0,0 +1 @@
+../../core/kernel/heap.c
\ No newline at end of file
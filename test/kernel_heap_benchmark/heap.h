@@ -0,0 +1 @@
+../../core/kernel/heap.h
\ No newline at end of file
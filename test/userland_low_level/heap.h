@@ -4,13 +4,15 @@
 #include <stdbool.h>
 #include <stddef.h>
 #include <stdlib.h>
+#include <string.h>
 #include "capabilities.h"
 
 struct heap {};
 
 struct heap_header {
-    bool is_locked;
+    uint8_t pins;
     size_t size;
+    struct capability *capability;
 };
 
 static inline void *heap_alloc(struct heap *heap, size_t actual_size) {
@@ -22,27 +24,65 @@ static inline void *heap_alloc(struct heap *heap, size_t actual_size) {
         return NULL;
     }
 
-    header->is_locked = true;
+    header->pins = 1;
     header->size = actual_size;
+    header->capability = NULL;
 
     return (uint8_t *) header + sizeof(struct heap_header);
 }
 
+static inline void *heap_alloc_pinned(struct heap *heap, size_t actual_size) {
+    return heap_alloc(heap, actual_size);
+}
+
 static inline void heap_free(struct heap *heap, void *ptr) {
     (void) heap;
 
     return free(ptr - sizeof(struct heap_header));
 }
 
-static inline void heap_set_update_capability(void *ptr, const struct absolute_capability_address *address) {
+static inline bool heap_contains(const struct heap *heap, const void *ptr) {
+    (void) heap;
+    (void) ptr;
+
+    return true;
+}
+
+static inline void heap_set_update_capability(void *ptr, struct capability *capability) {
+    struct heap_header *header = (struct heap_header *) ((uint8_t *) ptr - sizeof(struct heap_header));
+    header->capability = capability;
+}
+
+static inline void *heap_realloc(struct heap *heap, void *ptr, size_t actual_size) {
+    (void) heap;
+
+    struct heap_header *header = realloc((uint8_t *) ptr - sizeof(struct heap_header), sizeof(struct heap_header) + actual_size);
+
+    if (header == NULL) {
+        return NULL;
+    }
+
+    header->size = actual_size;
+
+    void *new_ptr = (uint8_t *) header + sizeof(struct heap_header);
+
+    // this is done by the kernel's heap when a region is moved
+    if (new_ptr != ptr && header->capability != NULL) {
+        update_capability_resource(header->capability, new_ptr);
+    }
+
+    return new_ptr;
+}
+
+static inline void heap_set_update_function(void *ptr, void (*function)(void *)) {
     (void) ptr;
-    (void) address;
+    (void) function;
 }
 
 static inline bool heap_lock(void *ptr) {
     struct heap_header *header = (struct heap_header *) ((uint8_t *) ptr - sizeof(struct heap_header));
-    if (!header->is_locked) {
-        header->is_locked = true;
+    if (header->pins < UINT8_MAX) {
+        header->pins ++;
         return true;
     } else {
         return false;
@@ -51,10 +91,35 @@ static inline bool heap_lock(void *ptr) {
 
 static inline void heap_unlock(void *ptr) {
     struct heap_header *header = (struct heap_header *) ((uint8_t *) ptr - sizeof(struct heap_header));
-    header->is_locked = false;
+    if (header->pins != 0) {
+        header->pins --;
+    }
+}
+
+static inline uint8_t heap_pins(void *ptr) {
+    struct heap_header *header = (struct heap_header *) ((uint8_t *) ptr - sizeof(struct heap_header));
+    return header->pins;
 }
 
 static inline size_t heap_sizeof(void *ptr) {
     struct heap_header *header = (struct heap_header *) ((uint8_t *) ptr - sizeof(struct heap_header));
     return header->size;
 }
+
+static inline void heap_set_watermark(struct heap *heap, size_t free_memory, size_t largest_free_block, void (*notify)(void *), void *data) {
+    (void) heap;
+    (void) free_memory;
+    (void) largest_free_block;
+    (void) notify;
+    (void) data;
+}
+
+static inline void heap_deliver_watermark(struct heap *heap) {
+    (void) heap;
+}
+
+static inline void heap_get_stats(struct heap *heap, struct heap_stats *stats) {
+    (void) heap;
+
+    memset(stats, 0, sizeof(struct heap_stats));
+}
@@ -0,0 +1 @@
+../../core/common/id_alloc.c
\ No newline at end of file
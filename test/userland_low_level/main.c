@@ -100,8 +100,33 @@ struct invocation_handlers endpoint_handlers = {
 
 struct scheduler_state scheduler_state;
 
+size_t invocation_restarts;
+
 size_t syscall_invoke(size_t address, size_t depth, size_t handler_number, size_t argument) {
-    return invoke_capability(address, depth, handler_number, argument);
+    size_t return_value;
+
+    // there's no trap to restart here, so invocations that haven't finished yet are just made again like they would be once the thread is scheduled again
+    while ((return_value = invoke_capability(address, depth, handler_number, argument)) == INVOCATION_RESTART) {
+        invocation_restarts ++;
+    }
+
+    return return_value;
+}
+
+size_t syscall_invoke_batch(struct invocation *invocations, size_t count, uint8_t flags) {
+    size_t made = 0;
+    size_t restart_index;
+    size_t return_value;
+
+    // like the trap handler, the batch is resumed from the invocation that has to be restarted rather than being made again from the start
+    while ((return_value = invoke_capability_batch(invocations, count, flags, &restart_index)) == INVOCATION_RESTART) {
+        invocations += restart_index;
+        count -= restart_index;
+        made += restart_index;
+        invocation_restarts ++;
+    }
+
+    return made + return_value;
 }
 
 size_t read_badge(size_t address, size_t depth, size_t *badge) {
@@ -115,13 +140,20 @@ size_t read_badge(size_t address, size_t depth, size_t *badge) {
     return 0;
 }
 
+uint8_t read_pins(void *pointer) {
+    return ((struct heap_header *) ((uint8_t *) pointer - sizeof(struct heap_header)))->pins;
+}
+
 /// called by unity before each test runs, used to set up the capability space for the program under test
 void setUp(void) {
     struct thread_capability *thread = heap_alloc(NULL, sizeof(struct thread_capability));
     assert(thread != NULL);
 
+    thread->exec_mode = EXEC_MODE_RUNNING;
     thread->thread_id = 0;
     thread->bucket_number = 0;
+    memset(thread->lookup_cache, 0, sizeof(thread->lookup_cache));
+    thread->num_leases = 0;
 
     // mostly copy-pasted from core/kernel/main.c
 
@@ -129,24 +161,20 @@ void setUp(void) {
     memset(&thread->root_capability, 0, sizeof(struct capability));
 
     // allocate the root node resource
-    thread->root_capability.handlers = &node_handlers;
+    thread->root_capability.type = CAP_TYPE_NODE;
     thread->root_capability.resource = alloc_node(NULL, ROOT_CAP_SLOT_BITS);
 
     assert(thread->root_capability.resource != NULL);
 
-    thread->root_capability.flags = CAP_FLAG_IS_HEAP_MANAGED | CAP_FLAG_ORIGINAL;
+    thread->root_capability.flags = CAP_FLAG_IS_HEAP_MANAGED | CAP_FLAG_ORIGINAL | CAP_FLAG_HEAP_REFERENCE;
 
     thread->root_capability.access_rights = UINT8_MAX; // all rights given
 
     LIST_INIT_NO_CONTAINER(&thread->root_capability, resource_list);
 
-    thread->root_capability.heap = NULL;
-
-    thread->root_capability.address.thread_id = thread->thread_id;
-    thread->root_capability.address.bucket_number = thread->bucket_number;
     // everything else here assumes NULL is 0
 
-    heap_set_update_capability(thread->root_capability.resource, &thread->root_capability.address);
+    heap_set_update_capability(thread->root_capability.resource, &thread->root_capability);
     heap_unlock(thread->root_capability.resource);
 
     // set the current thread so that capability lookups work properly while the thread's capability space is being set up
@@ -156,10 +184,11 @@ void setUp(void) {
 
     struct address_space_capability *address_space_resource = heap_alloc(NULL, sizeof(struct address_space_capability));
     address_space_resource->heap_pointer = NULL;
-    populate_capability_slot(NULL, 0, ROOT_CAP_SLOT_BITS, address_space_resource, &address_space_handlers, CAP_FLAG_IS_HEAP_MANAGED);
+    address_space_resource->watermark_endpoint = NULL;
+    populate_capability_slot(NULL, 0, ROOT_CAP_SLOT_BITS, address_space_resource, CAP_TYPE_ADDRESS_SPACE, CAP_FLAG_IS_HEAP_MANAGED);
 
     // add debug capability to thread's root node
-    populate_capability_slot(NULL, 1, ROOT_CAP_SLOT_BITS, NULL, &debug_handlers, 0);
+    populate_capability_slot(NULL, 1, ROOT_CAP_SLOT_BITS, NULL, CAP_TYPE_DEBUG, 0);
 
     // call the custom setup function to allow programs under test to set up their environments further
     custom_setup();
@@ -168,6 +197,7 @@ void setUp(void) {
 /// called by unity after each test runs, used to free all memory allocated for capabilities used by the program under test
 void tearDown(void) {
     custom_teardown();
+    release_leases(scheduler_state.current_thread);
     delete_capability(&scheduler_state.current_thread->root_capability);
     heap_free(NULL, scheduler_state.current_thread);
 }
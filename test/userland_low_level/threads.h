@@ -3,10 +3,16 @@
 #include "capabilities.h"
 #include <stdint.h>
 
+#define EXEC_MODE_RUNNING 0
+
 struct thread_capability {
     struct capability root_capability;
+    uint8_t exec_mode;
     uint16_t thread_id;
     uint8_t bucket_number;
+    struct lookup_cache_entry lookup_cache[LOOKUP_CACHE_SIZE];
+    void *leases[MAX_LEASES];
+    uint8_t num_leases;
 };
 
 extern struct invocation_handlers thread_handlers;
@@ -25,3 +31,7 @@ static inline bool look_up_thread_by_id(uint16_t thread_id, uint8_t bucket_numbe
     *thread = scheduler_state.current_thread;
     return heap_lock(scheduler_state.current_thread);
 }
+
+static inline void drop_leases_on(void *resource) {
+    drop_lease(scheduler_state.current_thread, resource);
+}